@@ -0,0 +1,97 @@
+/****************************************************************************
+ *
+ * argutil.c - Command line helpers shared by the programs and the tools
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "argutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+int arg_match(const char *name, int argc, char *argv[], int *i, const char **value)
+{
+    const size_t len = strlen(name);
+    const char *arg = argv[*i];
+    if (strncmp(arg, name, len) != 0)
+        return 0;
+    if (arg[len] == '=')
+    {
+        *value = arg + len + 1;
+        return 1;
+    }
+    if (arg[len] != '\0')
+        return 0;
+    if (*i + 1 >= argc)
+    {
+        fprintf(stderr, "%s: missing argument for %s\n", argv[0], name);
+        return -1;
+    }
+    *value = argv[++(*i)];
+    return 1;
+}
+
+int arg_split(char *cmd, char *words[], int max)
+{
+    int n = 0;
+    for (char *w = strtok(cmd, " \t"); w != NULL; w = strtok(NULL, " \t"))
+    {
+        if (n + 1 >= max)
+            return -1;
+        words[n++] = w;
+    }
+    words[n] = NULL;
+    return n;
+}
+
+int arg_run(char *const args[], const char *threads, int flags)
+{
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0)
+    {
+        setenv("OMP_NUM_THREADS", threads, 1);
+        if (flags != 0)
+        {
+            const int null = open("/dev/null", O_WRONLY);
+            if (null >= 0 && (flags & ARG_RUN_NO_STDOUT))
+                dup2(null, STDOUT_FILENO);
+            if (null >= 0 && (flags & ARG_RUN_NO_STDERR))
+                dup2(null, STDERR_FILENO);
+        }
+        execvp(args[0], args);
+        perror(args[0]);
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
@@ -0,0 +1,56 @@
+/****************************************************************************
+ *
+ * argutil.h - Command line helpers shared by the programs and the tools
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * The options of all the programs are parsed by the same matcher, and
+ * the tools that launch the programs (bench, validate) split their
+ * command lines and run them with the same fork/exec helper.
+ *
+ ****************************************************************************/
+
+#ifndef ARGUTIL_H
+#define ARGUTIL_H
+
+/* Flags of arg_run(): output of the child sent to /dev/null */
+#define ARG_RUN_NO_STDOUT 1
+#define ARG_RUN_NO_STDERR 2
+
+/**
+ * If argv[*i] is the option `name`, store its value (either after
+ * `=` or in the next argument) into `*value` and return 1; return 0
+ * if it is a different option, -1 if the value is missing.
+ */
+int arg_match(const char *name, int argc, char *argv[], int *i, const char **value);
+
+/**
+ * Split `cmd` in place into words (separated by blanks) into `words`,
+ * which is terminated by NULL; returns the number of words, -1 if
+ * there are `max` or more.
+ */
+int arg_split(char *cmd, char *words[], int max);
+
+/**
+ * Run the program args[0] with the NULL-terminated arguments `args`
+ * and OMP_NUM_THREADS set to `threads`, discarding the outputs
+ * selected by `flags` (ARG_RUN_*), and wait for it. Returns its exit
+ * status, or -1 if it cannot be started or is killed by a signal.
+ */
+int arg_run(char *const args[], const char *threads, int flags);
+
+#endif
@@ -0,0 +1,159 @@
+/****************************************************************************
+ *
+ * asyncwriter.c - Hand frames over to a dedicated writer thread
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "asyncwriter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "memtrack.h"
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *writer_main(void *arg)
+{
+    async_writer_t *aw = (async_writer_t *)arg;
+    pthread_mutex_lock(&aw->lock);
+    for (;;)
+    {
+        while (aw->nfull == 0 && !aw->stop)
+            pthread_cond_wait(&aw->cond, &aw->lock);
+        if (aw->nfull == 0)
+            break;
+        const int b = aw->full_ring[aw->full_head];
+        aw->full_head = (aw->full_head + 1) % aw->nbufs;
+        aw->nfull--;
+        aw->busy = 1;
+        pthread_mutex_unlock(&aw->lock);
+
+        aw->consume(aw->ctx, &aw->bufs[b]);
+
+        pthread_mutex_lock(&aw->lock);
+        aw->busy = 0;
+        aw->free_ring[(aw->free_head + aw->nfree) % aw->nbufs] = b;
+        aw->nfree++;
+        pthread_cond_broadcast(&aw->cond);
+    }
+    pthread_mutex_unlock(&aw->lock);
+    return NULL;
+}
+
+int async_writer_start(async_writer_t *aw, int nbufs, size_t bufsize,
+                       async_consume_t consume, void *ctx)
+{
+    memset(aw, 0, sizeof(*aw));
+    aw->nbufs = nbufs;
+    aw->consume = consume;
+    aw->ctx = ctx;
+    aw->bufs = (async_buffer_t *)calloc(nbufs, sizeof(*aw->bufs));
+    aw->free_ring = (int *)malloc(nbufs * sizeof(*aw->free_ring));
+    aw->full_ring = (int *)malloc(nbufs * sizeof(*aw->full_ring));
+    if (aw->bufs == NULL || aw->free_ring == NULL || aw->full_ring == NULL)
+        goto fail;
+    for (int i = 0; i < nbufs; i++)
+    {
+        aw->bufs[i].cap = bufsize;
+        if ((aw->bufs[i].data = mem_alloc(MEM_OUTPUT, bufsize)) == NULL)
+            goto fail;
+        aw->free_ring[i] = i;
+    }
+    aw->nfree = nbufs;
+    pthread_mutex_init(&aw->lock, NULL);
+    pthread_cond_init(&aw->cond, NULL);
+    if (pthread_create(&aw->thread, NULL, writer_main, aw) != 0)
+    {
+        pthread_mutex_destroy(&aw->lock);
+        pthread_cond_destroy(&aw->cond);
+        goto fail;
+    }
+    return 0;
+fail:
+    for (int i = 0; aw->bufs != NULL && i < nbufs; i++)
+        mem_free(aw->bufs[i].data);
+    free(aw->bufs);
+    free(aw->free_ring);
+    free(aw->full_ring);
+    memset(aw, 0, sizeof(*aw));
+    return -1;
+}
+
+async_buffer_t *async_writer_acquire(async_writer_t *aw)
+{
+    pthread_mutex_lock(&aw->lock);
+    if (aw->nfree == 0)
+    {
+        /* the writer is behind: we have to wait */
+        const double t0 = now();
+        while (aw->nfree == 0)
+            pthread_cond_wait(&aw->cond, &aw->lock);
+        aw->stalls++;
+        aw->stall_time += now() - t0;
+    }
+    const int b = aw->free_ring[aw->free_head];
+    aw->free_head = (aw->free_head + 1) % aw->nbufs;
+    aw->nfree--;
+    pthread_mutex_unlock(&aw->lock);
+    aw->bufs[b].len = 0;
+    return &aw->bufs[b];
+}
+
+void async_writer_submit(async_writer_t *aw, async_buffer_t *buf)
+{
+    const int b = (int)(buf - aw->bufs);
+    pthread_mutex_lock(&aw->lock);
+    aw->full_ring[(aw->full_head + aw->nfull) % aw->nbufs] = b;
+    aw->nfull++;
+    aw->frames++;
+    pthread_cond_broadcast(&aw->cond);
+    pthread_mutex_unlock(&aw->lock);
+}
+
+void async_writer_drain(async_writer_t *aw)
+{
+    pthread_mutex_lock(&aw->lock);
+    while (aw->nfull > 0 || aw->busy)
+        pthread_cond_wait(&aw->cond, &aw->lock);
+    pthread_mutex_unlock(&aw->lock);
+}
+
+void async_writer_stop(async_writer_t *aw)
+{
+    pthread_mutex_lock(&aw->lock);
+    aw->stop = 1;
+    pthread_cond_broadcast(&aw->cond);
+    pthread_mutex_unlock(&aw->lock);
+    pthread_join(aw->thread, NULL);
+    pthread_mutex_destroy(&aw->lock);
+    pthread_cond_destroy(&aw->cond);
+    for (int i = 0; i < aw->nbufs; i++)
+        mem_free(aw->bufs[i].data);
+    free(aw->bufs);
+    free(aw->free_ring);
+    free(aw->full_ring);
+    /* the statistics are kept for the caller */
+    aw->bufs = NULL;
+    aw->free_ring = aw->full_ring = NULL;
+    aw->nbufs = aw->nfree = aw->nfull = 0;
+}
@@ -0,0 +1,102 @@
+/****************************************************************************
+ *
+ * asyncwriter.h - Hand frames over to a dedicated writer thread
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * A fixed pool of buffers circulates between the simulation and a
+ * writer thread:
+ *
+ *        simulation: b = async_writer_acquire(); fill b; async_writer_submit(b);
+ *        writer:     consume(b); give b back to the pool
+ *
+ * Buffers are allocated once, so there is no allocation per frame.
+ * With two buffers the simulation fills one while the other is being
+ * written (double buffering). async_writer_acquire() blocks only when
+ * all the buffers are still queued for writing, i.e., when the disk
+ * cannot keep up; such stalls are counted and timed.
+ *
+ ****************************************************************************/
+
+#ifndef ASYNCWRITER_H
+#define ASYNCWRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+typedef struct
+{
+    void *data;
+    size_t cap;                 /* size of data */
+    size_t len;                 /* bytes used */
+    int64_t tag[2];             /* free for use by the producer */
+} async_buffer_t;
+
+typedef void (*async_consume_t)(void *ctx, async_buffer_t *buf);
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    async_buffer_t *bufs;
+    int nbufs;
+    int *free_ring;             /* [nbufs] indices of the free buffers */
+    int *full_ring;             /* [nbufs] indices of the buffers to write */
+    int free_head, nfree;       /* first element and length of each queue */
+    int full_head, nfull;
+    int busy;                   /* nonzero while the writer consumes a buffer */
+    int stop;
+    async_consume_t consume;    /* runs on the writer thread */
+    void *ctx;
+    uint64_t frames;            /* buffers submitted */
+    uint64_t stalls;            /* acquires that had to wait */
+    double stall_time;          /* seconds spent waiting in acquires */
+} async_writer_t;
+
+/**
+ * Allocate `nbufs` buffers of `bufsize` bytes and start the writer
+ * thread, which will call consume(ctx, buf) on every submitted
+ * buffer in submission order. Returns 0 on success, -1 on failure.
+ */
+int async_writer_start(async_writer_t *aw, int nbufs, size_t bufsize,
+                       async_consume_t consume, void *ctx);
+
+/**
+ * Return a free buffer, waiting for the writer if there is none.
+ */
+async_buffer_t *async_writer_acquire(async_writer_t *aw);
+
+/**
+ * Queue `buf` (obtained from async_writer_acquire()) for writing.
+ */
+void async_writer_submit(async_writer_t *aw, async_buffer_t *buf);
+
+/**
+ * Wait until all the submitted buffers have been consumed.
+ */
+void async_writer_drain(async_writer_t *aw);
+
+/**
+ * Consume the pending buffers, stop the writer thread and release
+ * the buffers. The statistics (frames, stalls, stall_time) remain
+ * valid.
+ */
+void async_writer_stop(async_writer_t *aw);
+
+#endif
@@ -0,0 +1,802 @@
+/****************************************************************************
+ *
+ * bench.c - Strong and weak scaling benchmarks of the circles programs
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***
+% Scaling benchmarks
+% Alessandro Monticelli
+
+Runs one of the circles programs with an increasing number of cores p
+(OpenMP threads for `omp-circles`, MPI processes for `mpi-circles`)
+and measures its strong or weak scaling. For each p the program is
+run a few times without measuring (warmup), then a number of times
+whose elapsed times are summarized by their median, minimum and
+standard deviation. The elapsed time is read from the summary that
+the program writes with `--summary`, so that it only covers the
+iterations.
+
+- Strong scaling: the number of circles n stays the same, and the
+  speedup is S(p) = T(1) / T(p), the efficiency E(p) = S(p) / p.
+
+- Weak scaling: n grows with p so that the work per core stays the
+  same; if the work is proportional to n^K (K = 2 for the all-pairs
+  kernels, K = 1 for a kernel linear in the number of circles)
+  n(p) = n(1) * p^(1/K). The efficiency is E(p) = T(1) / T(p), and
+  the (scaled) speedup S(p) = p * E(p).
+
+For p > 1 the Karp-Flatt metric e = (1/S - 1/p) / (1 - 1/p) estimates
+the serial fraction of the program: if e grows with p, the efficiency
+is lost to overheads (synchronization, communication, imbalance)
+rather than to a fixed serial part. When the first value of p is not
+1, T(1) is estimated from T(p) of the first value: as p * T(p) in
+strong scaling, and as T(p) itself in weak scaling, where each core
+has the same work as a single core would have.
+
+The results are printed as a table, and can be written as CSV and
+JSON. With `--baseline FILE` the medians are compared with those of
+the CSV of an earlier run (same program, backend, mode, workload, p,
+n, iterations, seed and options of the program) and the runs that got
+slower by more than the tolerance are flagged; the exit status is
+then 2, so that the comparison can be used in scripts. The runs
+without a matching row are reported as having no baseline.
+
+With `--scenarios LIST` the measures are repeated for each of the
+synthetic workloads of `workload.c` (see `gencircles`): for each run
+the circles are generated into a temporary snapshot, which is given
+to the program with `--input`. Without it the program places the
+circles by itself (scenario `default`).
+
+To compile:
+
+        gcc -std=c99 -Wall -Wpedantic bench.c argutil.c summary.c pairstats.c workload.c snapshot.c -o bench -lm
+
+To execute:
+
+        ./bench [options] PROGRAM [-- PROGRAM-OPTIONS]
+
+for example
+
+        ./bench --mode weak --procs 1,2,4,8 --size 2000 --csv weak-omp.csv ./omp-circles
+        ./bench --mpirun "mpirun --oversubscribe" --procs 1-4 ./mpi-circles
+        ./bench --baseline weak-omp.csv --mode weak --procs 1,2,4,8 --size 2000 ./omp-circles
+        ./bench --scenarios uniform,clusters,point --procs 1,4 ./omp-circles
+
+Run `./bench` without arguments for the list of the options.
+
+***/
+
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "summary.h"
+#include "argutil.h"
+#include "workload.h"
+
+#define MAX_PROCS 256
+#define MAX_REPS 1000
+#define MAX_ARGS 64
+#define MAX_SCENARIOS 16
+
+typedef enum
+{
+    BACKEND_SERIAL,
+    BACKEND_OMP,
+    BACKEND_MPI
+} backend_t;
+
+static const char *backend_name[] = {"serial", "omp", "mpi"};
+
+typedef struct
+{
+    const char *program;  /* program to measure */
+    backend_t backend;    /* how cores are given to it */
+    int weak;             /* weak (1) or strong (0) scaling */
+    int procs[MAX_PROCS]; /* values of p */
+    int nprocs;
+    int size;             /* circles with p = 1 */
+    int iterations;       /* iterations of each run */
+    double order;         /* the work grows as n^order */
+    int warmup;           /* unmeasured runs for each p */
+    int reps;             /* measured runs for each p */
+    const char *csv;      /* CSV output */
+    const char *json;     /* JSON output */
+    const char *baseline; /* CSV of an earlier run */
+    double tolerance;     /* slowdown (%) flagged as a regression */
+    char *mpirun[MAX_ARGS]; /* launcher of the MPI program, split into words */
+    int verbose;          /* show the output of the program */
+    char **extra;         /* more options for the program */
+    int nextra;
+    const char *scenarios[MAX_SCENARIOS]; /* workloads, NULL for the default one */
+    int nscenarios;
+    unsigned long long seed; /* seed of the workloads */
+    char options[256];    /* the extra options as a single CSV field */
+} bench_opt_t;
+
+typedef struct
+{
+    const char *scenario;
+    int p;
+    int n;             /* circles actually simulated */
+    double times[MAX_REPS];
+    double median, min, stddev;
+    double speedup, efficiency, karp_flatt; /* karp_flatt < 0 if undefined */
+    double base_median; /* median of the baseline, < 0 if none */
+} result_t;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] PROGRAM [-- PROGRAM-OPTIONS]\n"
+            "\n"
+            "Options:\n"
+            "  --mode strong|weak\n"
+            "                  keep n fixed (strong, the default) or grow it\n"
+            "                  with p (weak)\n"
+            "  --procs LIST    values of p, e.g. 1,2,4,8 or 1-8 (default 1 to\n"
+            "                  the number of online cores; 1 for the serial\n"
+            "                  program)\n"
+            "  --size N        circles with p = 1 (default 2000)\n"
+            "  --iterations N  iterations of each run (default 100)\n"
+            "  --order K       the work of the program grows as n^K; weak\n"
+            "                  scaling uses n = N * p^(1/K) (default 2)\n"
+            "  --warmup N      unmeasured runs for each p (default 1)\n"
+            "  --reps N        measured runs for each p (default 5)\n"
+            "  --backend serial|omp|mpi\n"
+            "                  how p is given to the program (default: from its\n"
+            "                  name)\n"
+            "  --mpirun CMD    command that launches the MPI program (default\n"
+            "                  \"mpirun\"); -n p is appended\n"
+            "  --csv FILE      write the results as CSV\n"
+            "  --json FILE     write the results, with all the times, as JSON\n"
+            "  --baseline FILE compare the medians with those of FILE, the CSV\n"
+            "                  of an earlier run\n"
+            "  --tolerance PCT slowdown flagged as a regression (default 5)\n"
+            "  --scenarios LIST\n"
+            "                  measure each of the comma-separated workloads\n"
+            "                  below (\"all\" for all of them)\n"
+            "  --seed N        seed of the workloads (default 1)\n"
+            "  --verbose       show the output of the program\n"
+            "\n"
+            "Workloads:\n",
+            prog);
+    workload_list(stderr);
+}
+
+/**
+ * Parse a list of values of p such as "1,2,4" or "1-4,8" into
+ * `opt->procs`; returns 0 on success, -1 on failure.
+ */
+static int parse_procs(bench_opt_t *opt, const char *list)
+{
+    opt->nprocs = 0;
+    while (*list != '\0')
+    {
+        char *end;
+        const long first = strtol(list, &end, 10);
+        long last = first;
+        if (end == list || first < 1)
+            return -1;
+        if (*end == '-')
+        {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first)
+                return -1;
+        }
+        for (long p = first; p <= last; p++)
+        {
+            if (opt->nprocs == MAX_PROCS)
+                return -1;
+            opt->procs[opt->nprocs++] = (int)p;
+        }
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        list = end;
+    }
+    return opt->nprocs > 0 ? 0 : -1;
+}
+
+/**
+ * Parse a comma-separated list of workloads, or "all", into
+ * `opt->scenarios`; returns 0 on success, -1 on failure.
+ */
+static int parse_scenarios(bench_opt_t *opt, const char *list)
+{
+    static char names[256];
+
+    opt->nscenarios = 0;
+    if (strcmp(list, "all") == 0)
+    {
+        for (int s = 0; s < workload_count() && s < MAX_SCENARIOS; s++)
+            opt->scenarios[opt->nscenarios++] = workload_name(s);
+        return 0;
+    }
+    snprintf(names, sizeof(names), "%s", list);
+    for (char *s = strtok(names, ","); s != NULL; s = strtok(NULL, ","))
+    {
+        if (!workload_valid(s) || opt->nscenarios == MAX_SCENARIOS)
+            return -1;
+        opt->scenarios[opt->nscenarios++] = s;
+    }
+    return opt->nscenarios > 0 ? 0 : -1;
+}
+
+/**
+ * Join the options after `--` into opt->options, separated by spaces,
+ * so that they can be stored in a CSV field and compared with the ones
+ * of a baseline. The commas (e.g. of --traj-roi) become semicolons, and
+ * no options are written as "-", since empty fields are skipped when
+ * the CSV is read.
+ */
+static void join_options(bench_opt_t *opt)
+{
+    size_t len = 0;
+    opt->options[0] = '\0';
+    for (int i = 0; i < opt->nextra; i++)
+    {
+        len += snprintf(opt->options + len, sizeof(opt->options) - len, "%s%s",
+                        i ? " " : "", opt->extra[i]);
+        if (len >= sizeof(opt->options))
+        {
+            len = sizeof(opt->options) - 1;
+            break;
+        }
+    }
+    for (char *c = opt->options; *c != '\0'; c++)
+    {
+        if (*c == ',')
+            *c = ';';
+    }
+    if (len == 0)
+        strcpy(opt->options, "-");
+}
+
+static int parse_options(bench_opt_t *opt, int argc, char *argv[])
+{
+    static char mpirun[256] = "mpirun";
+    int backend_set = 0;
+    const char *procs = NULL;
+
+    memset(opt, 0, sizeof(*opt));
+    opt->size = 2000;
+    opt->iterations = 100;
+    opt->order = 2;
+    opt->warmup = 1;
+    opt->reps = 5;
+    opt->tolerance = 5;
+    opt->seed = 1;
+    opt->nscenarios = 1; /* the default workload of the program */
+    for (int i = 1; i < argc; i++)
+    {
+        const char *val = NULL;
+        int m;
+        if (strcmp(argv[i], "--") == 0)
+        {
+            opt->extra = argv + i + 1;
+            opt->nextra = argc - i - 1;
+            break;
+        }
+        else if (strcmp(argv[i], "--verbose") == 0)
+            opt->verbose = 1;
+        else if ((m = arg_match("--mode", argc, argv, &i, &val)) != 0)
+        {
+            if (m > 0 && strcmp(val, "weak") == 0)
+                opt->weak = 1;
+            else if (m > 0 && strcmp(val, "strong") != 0)
+            {
+                fprintf(stderr, "%s: unknown mode %s\n", argv[0], val);
+                return -1;
+            }
+        }
+        else if ((m = arg_match("--procs", argc, argv, &i, &val)) != 0)
+            procs = val;
+        else if ((m = arg_match("--size", argc, argv, &i, &val)) != 0)
+            opt->size = atoi(val);
+        else if ((m = arg_match("--iterations", argc, argv, &i, &val)) != 0)
+            opt->iterations = atoi(val);
+        else if ((m = arg_match("--order", argc, argv, &i, &val)) != 0)
+            opt->order = atof(val);
+        else if ((m = arg_match("--warmup", argc, argv, &i, &val)) != 0)
+            opt->warmup = atoi(val);
+        else if ((m = arg_match("--reps", argc, argv, &i, &val)) != 0)
+            opt->reps = atoi(val);
+        else if ((m = arg_match("--backend", argc, argv, &i, &val)) != 0)
+        {
+            backend_set = 1;
+            if (m > 0 && strcmp(val, "serial") == 0)
+                opt->backend = BACKEND_SERIAL;
+            else if (m > 0 && strcmp(val, "omp") == 0)
+                opt->backend = BACKEND_OMP;
+            else if (m > 0 && strcmp(val, "mpi") == 0)
+                opt->backend = BACKEND_MPI;
+            else if (m > 0)
+            {
+                fprintf(stderr, "%s: unknown backend %s\n", argv[0], val);
+                return -1;
+            }
+        }
+        else if ((m = arg_match("--mpirun", argc, argv, &i, &val)) != 0)
+            snprintf(mpirun, sizeof(mpirun), "%s", val);
+        else if ((m = arg_match("--csv", argc, argv, &i, &val)) != 0)
+            opt->csv = val;
+        else if ((m = arg_match("--json", argc, argv, &i, &val)) != 0)
+            opt->json = val;
+        else if ((m = arg_match("--baseline", argc, argv, &i, &val)) != 0)
+            opt->baseline = val;
+        else if ((m = arg_match("--tolerance", argc, argv, &i, &val)) != 0)
+            opt->tolerance = atof(val);
+        else if ((m = arg_match("--seed", argc, argv, &i, &val)) != 0)
+            opt->seed = strtoull(val, NULL, 10);
+        else if ((m = arg_match("--scenarios", argc, argv, &i, &val)) != 0)
+        {
+            if (m > 0 && parse_scenarios(opt, val) != 0)
+            {
+                fprintf(stderr, "%s: invalid workloads %s\n", argv[0], val);
+                return -1;
+            }
+        }
+        else if (argv[i][0] == '-' || opt->program != NULL)
+        {
+            fprintf(stderr, "%s: unexpected argument %s\n", argv[0], argv[i]);
+            return -1;
+        }
+        else
+        {
+            opt->program = argv[i];
+            m = 1;
+        }
+        if (m < 0)
+            return -1;
+    }
+    if (opt->program == NULL)
+        return -1;
+    if (!backend_set)
+    {
+        const char *base = strrchr(opt->program, '/');
+        base = (base != NULL) ? base + 1 : opt->program;
+        if (strncmp(base, "mpi-", 4) == 0)
+            opt->backend = BACKEND_MPI;
+        else if (strncmp(base, "omp-", 4) == 0)
+            opt->backend = BACKEND_OMP;
+        else
+            opt->backend = BACKEND_SERIAL;
+    }
+    if (arg_split(mpirun, opt->mpirun, MAX_ARGS - 8) < 1)
+    {
+        fprintf(stderr, "%s: invalid --mpirun\n", argv[0]);
+        return -1;
+    }
+    if (procs == NULL)
+    {
+        const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        char list[32];
+        snprintf(list, sizeof(list), "1-%ld", (opt->backend == BACKEND_SERIAL || cores < 1) ? 1 : cores);
+        parse_procs(opt, list);
+    }
+    else if (parse_procs(opt, procs) != 0)
+    {
+        fprintf(stderr, "%s: invalid list of cores %s\n", argv[0], procs);
+        return -1;
+    }
+    if (opt->backend == BACKEND_SERIAL && (opt->nprocs > 1 || opt->procs[0] != 1))
+    {
+        fprintf(stderr, "%s: the serial program only runs with p = 1\n", argv[0]);
+        return -1;
+    }
+    if (opt->size < 1 || opt->iterations < 0 || opt->order <= 0 || opt->warmup < 0 ||
+        opt->reps < 1 || opt->reps > MAX_REPS || opt->tolerance < 0)
+    {
+        fprintf(stderr, "%s: invalid options\n", argv[0]);
+        return -1;
+    }
+    join_options(opt);
+    return 0;
+}
+
+/**
+ * Number of circles for `p` cores.
+ */
+static int problem_size(const bench_opt_t *opt, int p)
+{
+    if (opt->weak)
+        return (int)lround(opt->size * pow(p, 1.0 / opt->order));
+    return opt->size;
+}
+
+/**
+ * Create an empty temporary file, whose name is stored into `path`;
+ * returns 0 on success, -1 on failure.
+ */
+static int temp_file(char *path)
+{
+    strcpy(path, "/tmp/bench-XXXXXX");
+    const int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("mkstemp");
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/**
+ * Run the program once with `p` cores on `n` circles, or on the
+ * circles of the snapshot `input` if not NULL; store the summary of
+ * the run into `s` and return 0, or return -1 if the run failed.
+ */
+static int run_once(const bench_opt_t *opt, int p, int n, const char *input, run_summary_t *s)
+{
+    char summary[32];
+    char pstr[16], nstr[16], itstr[16];
+    char *args[2 * MAX_ARGS];
+    int nargs = 0;
+
+    if (temp_file(summary) != 0)
+        return -1;
+    snprintf(pstr, sizeof(pstr), "%d", p);
+    snprintf(nstr, sizeof(nstr), "%d", n);
+    snprintf(itstr, sizeof(itstr), "%d", opt->iterations);
+    if (opt->backend == BACKEND_MPI)
+    {
+        for (int i = 0; opt->mpirun[i] != NULL; i++)
+            args[nargs++] = opt->mpirun[i];
+        args[nargs++] = "-n";
+        args[nargs++] = pstr;
+    }
+    args[nargs++] = (char *)opt->program;
+    args[nargs++] = nstr;
+    args[nargs++] = itstr;
+    args[nargs++] = "--summary";
+    args[nargs++] = summary;
+    if (input != NULL)
+    {
+        args[nargs++] = "--input";
+        args[nargs++] = (char *)input;
+    }
+    for (int i = 0; i < opt->nextra && nargs + 1 < 2 * MAX_ARGS; i++)
+        args[nargs++] = opt->extra[i];
+    args[nargs] = NULL;
+
+    /* MPI processes run one thread each */
+    const int status = arg_run(args, (opt->backend == BACKEND_OMP) ? pstr : "1",
+                               opt->verbose ? 0 : ARG_RUN_NO_STDOUT);
+    int result = -1;
+    if (status != 0)
+        fprintf(stderr, "bench: %s failed with p=%d, n=%d\n", opt->program, p, n);
+    else if (summary_read(summary, s) != 0)
+        fprintf(stderr, "bench: %s wrote no summary (does it support --summary?)\n", opt->program);
+    else
+        result = 0;
+    unlink(summary);
+    return result;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Median, minimum and (sample) standard deviation of the times of `r`.
+ */
+static void summarize(result_t *r, int reps)
+{
+    double sorted[MAX_REPS], mean = 0, var = 0;
+    memcpy(sorted, r->times, reps * sizeof(double));
+    qsort(sorted, reps, sizeof(double), compare_doubles);
+    r->min = sorted[0];
+    r->median = (reps % 2) ? sorted[reps / 2] : 0.5 * (sorted[reps / 2 - 1] + sorted[reps / 2]);
+    for (int i = 0; i < reps; i++)
+        mean += r->times[i];
+    mean /= reps;
+    for (int i = 0; i < reps; i++)
+        var += (r->times[i] - mean) * (r->times[i] - mean);
+    r->stddev = (reps > 1) ? sqrt(var / (reps - 1)) : 0;
+}
+
+/**
+ * Speedup, efficiency and Karp-Flatt metric of each result, relative
+ * to the first one.
+ */
+static void derive(result_t *res, int nres, int weak)
+{
+    /* estimate of T(1): in weak scaling the first run has the work of
+       one core on each core */
+    const double t1 = res[0].median * (weak ? 1 : res[0].p);
+    for (int i = 0; i < nres; i++)
+    {
+        const double p = res[i].p;
+        if (weak)
+        {
+            res[i].efficiency = t1 / res[i].median;
+            res[i].speedup = p * res[i].efficiency;
+        }
+        else
+        {
+            res[i].speedup = t1 / res[i].median;
+            res[i].efficiency = res[i].speedup / p;
+        }
+        res[i].karp_flatt = (p > 1) ? (1 / res[i].speedup - 1 / p) / (1 - 1 / p) : -1;
+    }
+}
+
+/**
+ * Name of the program `path` without its directory, so that a
+ * baseline of ./omp-circles also applies to src/omp-circles.
+ */
+static const char *base_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+/**
+ * Fill the base_median of the results with the medians of the rows of
+ * the CSV file `path` with the same program, backend, mode, scenario,
+ * p, n, iterations, seed and options as `opt`; the results without
+ * such a row keep a base_median < 0. Files written before the last
+ * three columns were added have no matching rows. Returns 0 on
+ * success, -1 if the file cannot be read.
+ */
+static int load_baseline(const char *path, const bench_opt_t *opt, result_t *res, int nres)
+{
+    FILE *in = fopen(path, "r");
+    char line[1024];
+    int col_program = -1, col_backend = -1, col_mode = -1, col_scenario = -1;
+    int col_p = -1, col_n = -1, col_median = -1;
+    int col_iterations = -1, col_seed = -1, col_options = -1;
+    const char *mode = opt->weak ? "weak" : "strong";
+
+    for (int i = 0; i < nres; i++)
+        res[i].base_median = -1;
+    if (in == NULL || fgets(line, sizeof(line), in) == NULL)
+    {
+        fprintf(stderr, "bench: cannot read the baseline %s\n", path);
+        if (in != NULL)
+            fclose(in);
+        return -1;
+    }
+    /* the columns are found by name in the header */
+    int col = 0;
+    for (char *f = strtok(line, ",\r\n"); f != NULL; f = strtok(NULL, ",\r\n"), col++)
+    {
+        if (strcmp(f, "program") == 0)
+            col_program = col;
+        else if (strcmp(f, "backend") == 0)
+            col_backend = col;
+        else if (strcmp(f, "mode") == 0)
+            col_mode = col;
+        else if (strcmp(f, "scenario") == 0)
+            col_scenario = col;
+        else if (strcmp(f, "p") == 0)
+            col_p = col;
+        else if (strcmp(f, "n") == 0)
+            col_n = col;
+        else if (strcmp(f, "median") == 0)
+            col_median = col;
+        else if (strcmp(f, "iterations") == 0)
+            col_iterations = col;
+        else if (strcmp(f, "seed") == 0)
+            col_seed = col;
+        else if (strcmp(f, "options") == 0)
+            col_options = col;
+    }
+    if (col_program < 0 || col_backend < 0 || col_mode < 0 || col_p < 0 || col_n < 0 ||
+        col_median < 0)
+    {
+        fprintf(stderr, "bench: %s is not a CSV written by bench\n", path);
+        fclose(in);
+        return -1;
+    }
+    if (col_iterations < 0 || col_seed < 0 || col_options < 0)
+    {
+        fclose(in);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        char *fields[64];
+        int nf = 0;
+        for (char *f = strtok(line, ",\r\n"); f != NULL && nf < 64; f = strtok(NULL, ",\r\n"))
+            fields[nf++] = f;
+        if (nf <= col_program || nf <= col_backend || nf <= col_mode || nf <= col_p ||
+            nf <= col_n || nf <= col_median || nf <= col_iterations || nf <= col_seed ||
+            nf <= col_options || strcmp(fields[col_mode], mode) != 0 ||
+            strcmp(fields[col_backend], backend_name[opt->backend]) != 0 ||
+            strcmp(base_name(fields[col_program]), base_name(opt->program)) != 0 ||
+            atoi(fields[col_iterations]) != opt->iterations ||
+            strtoull(fields[col_seed], NULL, 10) != opt->seed ||
+            strcmp(fields[col_options], opt->options) != 0)
+            continue;
+        /* files without scenarios measured the default workload */
+        const char *scenario = (col_scenario >= 0 && nf > col_scenario) ? fields[col_scenario] : "default";
+        const int p = atoi(fields[col_p]), n = atoi(fields[col_n]);
+        for (int i = 0; i < nres; i++)
+        {
+            if (res[i].p == p && res[i].n == n && strcmp(res[i].scenario, scenario) == 0)
+                res[i].base_median = atof(fields[col_median]);
+        }
+    }
+    fclose(in);
+    return 0;
+}
+
+static int write_csv(const char *path, const bench_opt_t *opt, const result_t *res, int nres)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "bench: cannot create %s\n", path);
+        return -1;
+    }
+    fprintf(out, "program,backend,mode,scenario,p,n,iterations,seed,options,reps,"
+                 "median,min,stddev,speedup,efficiency,karp_flatt\n");
+    for (int i = 0; i < nres; i++)
+    {
+        fprintf(out, "%s,%s,%s,%s,%d,%d,%d,%llu,%s,%d,%.6f,%.6f,%.6f,%.4f,%.4f,",
+                opt->program, backend_name[opt->backend], opt->weak ? "weak" : "strong",
+                res[i].scenario, res[i].p, res[i].n, opt->iterations, opt->seed,
+                opt->options, opt->reps,
+                res[i].median, res[i].min, res[i].stddev,
+                res[i].speedup, res[i].efficiency);
+        if (res[i].karp_flatt >= -0.5)
+            fprintf(out, "%.4f", res[i].karp_flatt);
+        fprintf(out, "\n");
+    }
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+static int write_json(const char *path, const bench_opt_t *opt, const result_t *res, int nres)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "bench: cannot create %s\n", path);
+        return -1;
+    }
+    fprintf(out, "{\n  \"program\": \"%s\",\n  \"backend\": \"%s\",\n  \"mode\": \"%s\",\n"
+                 "  \"iterations\": %d,\n  \"seed\": %llu,\n  \"options\": \"%s\",\n"
+                 "  \"order\": %g,\n  \"warmup\": %d,\n  \"results\": [\n",
+            opt->program, backend_name[opt->backend], opt->weak ? "weak" : "strong",
+            opt->iterations, opt->seed, opt->options, opt->order, opt->warmup);
+    for (int i = 0; i < nres; i++)
+    {
+        fprintf(out, "    {\"scenario\": \"%s\", \"p\": %d, \"n\": %d, \"times\": [",
+                res[i].scenario, res[i].p, res[i].n);
+        for (int k = 0; k < opt->reps; k++)
+            fprintf(out, "%s%.6f", k ? ", " : "", res[i].times[k]);
+        fprintf(out, "], \"median\": %.6f, \"min\": %.6f, \"stddev\": %.6f, "
+                     "\"speedup\": %.4f, \"efficiency\": %.4f, ",
+                res[i].median, res[i].min, res[i].stddev, res[i].speedup, res[i].efficiency);
+        if (res[i].karp_flatt >= -0.5)
+            fprintf(out, "\"karp_flatt\": %.4f", res[i].karp_flatt);
+        else
+            fprintf(out, "\"karp_flatt\": null");
+        if (res[i].base_median >= 0)
+            fprintf(out, ", \"baseline\": %.6f", res[i].base_median);
+        fprintf(out, "}%s\n", (i + 1 < nres) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_opt_t opt;
+
+    if (parse_options(&opt, argc, argv) != 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const int nres = opt.nscenarios * opt.nprocs;
+    result_t *res = (result_t *)calloc(nres, sizeof(*res));
+    if (res == NULL)
+    {
+        fprintf(stderr, "bench: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    printf("%s, %s scaling, %d iterations, %d+%d runs for each p\n",
+           opt.program, opt.weak ? "weak" : "strong", opt.iterations, opt.warmup, opt.reps);
+    for (int w = 0; w < opt.nscenarios; w++)
+    {
+        const char *scenario = opt.scenarios[w];
+        result_t *block = res + w * opt.nprocs;
+        printf("\n%s workload\n", scenario ? scenario : "Default");
+        printf("%4s %9s %11s %11s %11s %8s %8s %8s\n",
+               "p", "n", "median", "min", "stddev", "speedup", "effic.", "K-F");
+        for (int i = 0; i < opt.nprocs; i++)
+        {
+            const int p = opt.procs[i];
+            const int n = problem_size(&opt, p);
+            char input[32];
+            run_summary_t s;
+            block[i].scenario = scenario ? scenario : "default";
+            block[i].p = p;
+            block[i].base_median = -1;
+            if (scenario != NULL &&
+                (temp_file(input) != 0 || workload_save(input, scenario, n, opt.seed) != 0))
+                return EXIT_FAILURE;
+            for (int k = 0; k < opt.warmup + opt.reps; k++)
+            {
+                if (run_once(&opt, p, n, scenario ? input : NULL, &s) != 0)
+                {
+                    if (scenario != NULL)
+                        unlink(input);
+                    return EXIT_FAILURE;
+                }
+                if (k >= opt.warmup)
+                    block[i].times[k - opt.warmup] = s.elapsed;
+            }
+            if (scenario != NULL)
+                unlink(input);
+            /* with --input the number of circles comes from the file */
+            block[i].n = s.ncircles;
+            summarize(&block[i], opt.reps);
+            derive(block, i + 1, opt.weak);
+            printf("%4d %9d %11.6f %11.6f %11.6f %8.2f %8.3f ",
+                   p, block[i].n, block[i].median, block[i].min, block[i].stddev,
+                   block[i].speedup, block[i].efficiency);
+            if (block[i].karp_flatt >= -0.5)
+                printf("%8.4f\n", block[i].karp_flatt);
+            else
+                printf("%8s\n", "-");
+            fflush(stdout);
+        }
+    }
+
+    int regressions = 0;
+    if (opt.baseline)
+    {
+        if (load_baseline(opt.baseline, &opt, res, nres) != 0)
+            return EXIT_FAILURE;
+        printf("\nComparison with %s (tolerance %g%%)\n", opt.baseline, opt.tolerance);
+        printf("%-10s %4s %9s %11s %11s %8s\n", "workload", "p", "n", "baseline", "median", "change");
+        for (int i = 0; i < nres; i++)
+        {
+            if (res[i].base_median < 0)
+            {
+                printf("%-10s %4d %9d %11s %11.6f  no baseline\n", res[i].scenario, res[i].p,
+                       res[i].n, "-", res[i].median);
+                continue;
+            }
+            const double change = 100.0 * (res[i].median / res[i].base_median - 1);
+            const int slower = change > opt.tolerance;
+            regressions += slower;
+            printf("%-10s %4d %9d %11.6f %11.6f %+7.1f%%%s\n", res[i].scenario, res[i].p, res[i].n,
+                   res[i].base_median, res[i].median, change,
+                   slower ? "  REGRESSION" : (change < -opt.tolerance ? "  faster" : ""));
+        }
+        if (regressions > 0)
+            printf("%d regression%s\n", regressions, regressions > 1 ? "s" : "");
+    }
+    if (opt.csv && write_csv(opt.csv, &opt, res, nres) != 0)
+        return EXIT_FAILURE;
+    if (opt.json && write_json(opt.json, &opt, res, nres) != 0)
+        return EXIT_FAILURE;
+    free(res);
+    return regressions > 0 ? 2 : EXIT_SUCCESS;
+}
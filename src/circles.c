@@ -28,20 +28,69 @@ described in the specification.
 
 To compile:
 
-        gcc -std=c99 -Wall -Wpedantic circles.c -o circles -lm
+        gcc -std=c99 -fopenmp -Wall -Wpedantic circles.c options.c argutil.c snapshot.c textimport.c trajectory.c filewriter.c asyncwriter.c render.c shmring.c pairstats.c trace.c summary.c latency.c memtrack.c progress.c telemetry.c libcircles.c engines.c driver.c -o circles -lm -pthread -lrt
 
 To execute:
 
-        ./circles [ncircles [iterations]]
+        ./circles [options] [ncircles [iterations]]
 
 where `ncircles` is the number of circles, and `iterations` is the
-number of iterations to execute.
-
-If you want to produce a movie (this is not required, and should be
-avoided when measuring the performance of the parallel versions of
-this program) compile with:
-
-        gcc -std=c99 -Wall -Wpedantic -DMOVIE circles.c -o circles.movie -lm
+number of iterations to execute. The options are:
+
+- `--input FILE`: read the initial circles from FILE instead of
+  placing `ncircles` circles at random. FILE is either a binary
+  snapshot or a text file with one `x y r` line per circle (blanks
+  and/or commas as separators, as in CSV files or in the data block
+  of the gnuplot files written with -DMOVIE);
+
+- `--output FILE`: write the circles to the binary snapshot FILE at
+  the end of the run; the snapshot can be fed back with `--input` to
+  continue the simulation;
+
+- `--seed N`: seed of the random initial configuration (default 1).
+
+- `--trajectory FILE`: write the positions of the circles at each
+  iteration into a single compact trajectory file; `traj2gp` turns
+  it back into the gnuplot files described below. The trajectory is
+  controlled by `--traj-every N` (one frame every N iterations),
+  `--traj-quantum Q` (positions are rounded to multiples of Q; 0
+  keeps them exact) and `--traj-roi X0,Y0,X1,Y1` (only the circles
+  whose center lies inside the rectangle are stored). Frames are
+  encoded and written by a separate thread, so that the simulation
+  does not wait for the disk; `--traj-buffers N` sets the number of
+  frame buffers (default 2; 0 writes in the simulation thread).
+
+- `--render PATTERN`: draw the circles at each iteration into an
+  image whose name is the printf() pattern PATTERN applied to the
+  iteration number (e.g. `frame-%05d.png`); the image is a PNG if the
+  name ends with `.png`, a binary PPM otherwise;
+
+- `--movie FILE`: draw the circles at each iteration and pipe the
+  frames to `ffmpeg`, which encodes them into FILE;
+
+- `--render-size N`: width and height of the images (default 640).
+  The images show the same region as the gnuplot files below; the
+  circles are drawn by all the OpenMP threads, so no external tool
+  is needed besides `ffmpeg` for movies.
+
+- `--publish NAME`: copy the circles at each iteration into the POSIX
+  shared memory object NAME (e.g. `/circles`), where `ringview` or
+  any other reader can watch the run live; the simulation never
+  waits for the readers.
+
+- `--engine NAME`: run the iterations with another engine of
+  libcircles (see libcircles.h): `serial`, `omp`, `gather` or
+  `omp-gather`; the default is `serial`.
+
+- `--batch K`: advance K iterations at a time with `circles_step()`,
+  as an application embedding libcircles would; the frames are
+  written after each batch.
+
+If you want the gnuplot files of the original movie version (this is
+not required, and should be avoided when measuring the performance of
+the parallel versions of this program) compile with:
+
+        gcc -std=c99 -fopenmp -Wall -Wpedantic -DMOVIE circles.c options.c argutil.c snapshot.c textimport.c trajectory.c filewriter.c asyncwriter.c render.c shmring.c pairstats.c trace.c summary.c latency.c memtrack.c progress.c telemetry.c libcircles.c engines.c driver.c -o circles.movie -lm -pthread -lrt
 
 and execute with:
 
@@ -58,184 +107,14 @@ and then assembled to produce the movie `circles.avi`:
 
 ***/
 
-#include "hpc.h"
-#include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
-#include <math.h>
-
-typedef struct {
-    float x, y;   /* coordinates of center */
-    float r;      /* radius */
-    float dx, dy; /* displacements due to interactions with other circles */
-} circle_t;
-
-/* These constants can be replaced with #define's if necessary */
-const float XMIN = 0.0;
-const float XMAX = 1000.0;
-const float YMIN = 0.0;
-const float YMAX = 1000.0;
-const float RMIN = 10.0;
-const float RMAX = 100.0;
-const float EPSILON = 1e-5;
-const float K = 1.5;
-
-int ncircles;
-circle_t *circles = NULL;
-
-/**
- * Return a random float in [a, b]
- */
-float randab(float a, float b)
-{
-    return a + (((float)rand())/RAND_MAX) * (b-a);
-}
-
-/**
- * Create and populate the array `circles[]` with randomly placed
- * circls.
- *
- * Do NOT parallelize this function.
- */
-void init_circles(int n)
-{
-    assert(circles == NULL);
-    ncircles = n;
-    circles = (circle_t*)malloc(n * sizeof(*circles));
-    assert(circles != NULL);
-    for (int i=0; i<n; i++) {
-        circles[i].x = randab(XMIN, XMAX);
-        circles[i].y = randab(YMIN, YMAX);
-        circles[i].r = randab(RMIN, RMAX);
-        circles[i].dx = circles[i].dy = 0.0;
-    }
-}
-
-/**
- * Set all displacements to zero.
- */
-void reset_displacements( void )
-{
-    for (int i=0; i<ncircles; i++) {
-        circles[i].dx = circles[i].dy = 0.0;
-    }
-}
-
-/**
- * Compute the force acting on each circle; returns the number of
- * overlapping pairs of circles (each overlapping pair must be counted
- * only once).
- */
-int compute_forces( void )
-{
-    int n_intersections = 0;
-    for (int i=0; i<ncircles; i++) {
-        for (int j=i+1; j<ncircles; j++) {
-            const float deltax = circles[j].x - circles[i].x;
-            const float deltay = circles[j].y - circles[i].y;
-            /* hypotf(x,y) computes sqrtf(x*x + y*y) avoiding
-               overflow. This function is defined in <math.h>, and
-               should be available also on CUDA. In case of troubles,
-               it is ok to use sqrtf(x*x + y*y) instead. */
-            const float dist = hypotf(deltax, deltay);
-            const float Rsum = circles[i].r + circles[j].r;
-            if (dist < Rsum - EPSILON) {
-                n_intersections++;
-                const float overlap = Rsum - dist;
-                assert(overlap > 0.0);
-                // avoid division by zero
-                const float overlap_x = overlap / (dist + EPSILON) * deltax;
-                const float overlap_y = overlap / (dist + EPSILON) * deltay;
-                circles[i].dx -= overlap_x / K;
-                circles[i].dy -= overlap_y / K;
-                circles[j].dx += overlap_x / K;
-                circles[j].dy += overlap_y / K;
-            }
-        }
-    }
-    return n_intersections;
-}
-
-/**
- * Move the circles to a new position according to the forces acting
- * on each one.
- */
-void move_circles( void )
-{
-    for (int i=0; i<ncircles; i++) {
-        circles[i].x += circles[i].dx;
-        circles[i].y += circles[i].dy;
-    }
-}
-
-#ifdef MOVIE
-/**
- * Dumps the circles into a text file that can be processed using
- * gnuplot. This function may be used for debugging purposes, or to
- * produce a movie of how the algorithm works.
- *
- * You may want to completely remove this function from the final
- * version.
- */
-void dump_circles( int iterno )
-{
-    char fname[64];
-    snprintf(fname, sizeof(fname), "circles-%05d.gp", iterno);
-    FILE *out = fopen(fname, "w");
-    const float WIDTH = XMAX - XMIN;
-    const float HEIGHT = YMAX - YMIN;
-    fprintf(out, "set term png notransparent large\n");
-    fprintf(out, "set output \"circles-%05d.png\"\n", iterno);
-    fprintf(out, "set xrange [%f:%f]\n", XMIN - WIDTH*.2, XMAX + WIDTH*.2 );
-    fprintf(out, "set yrange [%f:%f]\n", YMIN - HEIGHT*.2, YMAX + HEIGHT*.2 );
-    fprintf(out, "set size square\n");
-    fprintf(out, "plot '-' with circles notitle\n");
-    for (int i=0; i<ncircles; i++) {
-        fprintf(out, "%f %f %f\n", circles[i].x, circles[i].y, circles[i].r);
-    }
-    fprintf(out, "e\n");
-    fclose(out);
-}
-#endif
+#include "driver.h"
 
 int main( int argc, char* argv[] )
 {
-    int n = 10000;
-    int iterations = 20;
-
-    if ( argc > 3 ) {
-        fprintf(stderr, "Usage: %s [ncircles [iterations]]\n", argv[0]);
-        return EXIT_FAILURE;
-    }
-
-    if (argc > 1) {
-        n = atoi(argv[1]);
-    }
-
-    if (argc > 2) {
-        iterations = atoi(argv[2]);
-    }
-
-    init_circles(n);
-    const double tstart_prog = hpc_gettime();
 #ifdef MOVIE
-    dump_circles(0);
+    return driver_main(argc, argv, "circles", "serial", "circles");
+#else
+    return driver_main(argc, argv, "circles", "serial", NULL);
 #endif
-    for (int it=0; it<iterations; it++) {
-        const double tstart_iter = hpc_gettime();
-        reset_displacements();
-        const int n_overlaps = compute_forces();
-        move_circles();
-        const double elapsed_iter = hpc_gettime() - tstart_iter;
-#ifdef MOVIE
-        dump_circles(it+1);
-#endif
-        printf("Iteration %d of %d, %d overlaps (%f s)\n", it+1, iterations, n_overlaps, elapsed_iter);
-    }
-    const double elapsed_prog = hpc_gettime() - tstart_prog;
-    printf("Elapsed time: %f\n", elapsed_prog);
-
-    free(circles);
-
-    return EXIT_SUCCESS;
 }
@@ -0,0 +1,365 @@
+/****************************************************************************
+ *
+ * driver.c - Main program of the shared-memory circles programs
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "hpc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "driver.h"
+#include "libcircles.h"
+#include "options.h"
+#include "trajectory.h"
+#include "render.h"
+#include "shmring.h"
+#include "pairstats.h"
+#include "trace.h"
+#include "summary.h"
+#include "latency.h"
+#include "memtrack.h"
+#include "progress.h"
+#include "telemetry.h"
+
+static circles_t sim;           /* the simulation */
+static traj_writer_t traj;      /* trajectory being written, if any */
+static renderer_t render;       /* renderer of the images or movie, if any */
+static const char *image_pattern = NULL; /* file names of the rendered images */
+static shm_ring_t ring;         /* shared memory the frames are published to, if any */
+
+/**
+ * Create the trajectory file requested on the command line, and
+ * store the radii of the circles into it.
+ */
+static void open_trajectory(const options_t *opt)
+{
+    traj_header_t hdr;
+    traj_header_init(&hdr, sim.n, sim.xmin, sim.xmax, sim.ymin, sim.ymax);
+    hdr.every = opt->traj_every;
+    hdr.quantum = opt->traj_quantum;
+    if (opt->traj_roi && traj_header_set_roi(&hdr, opt->traj_roi) != 0)
+    {
+        fprintf(stderr, "Invalid region of interest \"%s\"\n", opt->traj_roi);
+        exit(EXIT_FAILURE);
+    }
+    if (traj_writer_open(&traj, opt->trajectory, &hdr, &sim.pos, opt->traj_buffers) != 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Prepare the renderer for the images or the movie requested on the
+ * command line.
+ */
+static void open_renderer(const options_t *opt)
+{
+    if (render_init(&render, opt->render_size, sim.xmin, sim.xmax, sim.ymin, sim.ymax) != 0)
+    {
+        fprintf(stderr, "Cannot create the renderer\n");
+        exit(EXIT_FAILURE);
+    }
+    image_pattern = opt->render;
+    if (opt->movie && render_movie_open(&render, opt->movie) != 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Create the shared memory ring requested on the command line.
+ */
+static void open_ring(const options_t *opt)
+{
+    if (shm_ring_create(&ring, opt->publish, &sim.pos, sim.n,
+                        sim.xmin, sim.xmax, sim.ymin, sim.ymax) != 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Append the current positions to the trajectory, render them and
+ * publish them, if requested.
+ */
+static void write_frame(int iterno, int n_overlaps)
+{
+    if (ring.hdr != NULL)
+    {
+        shm_ring_publish(&ring, iterno, n_overlaps, &sim.pos);
+    }
+    if (traj.open && traj_writer_frame(&traj, iterno, n_overlaps, &sim.pos) != 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+    if (render.pixels != NULL)
+    {
+        if (render_frame(&render, &sim.pos, sim.n) != 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        if (image_pattern)
+        {
+            char fname[1024];
+            snprintf(fname, sizeof(fname), image_pattern, iterno);
+            if (render_write(&render, fname) != 0)
+            {
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (render.pipe && render_movie_frame(&render) != 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * Print the memory that the run described by `opt` would allocate
+ * with the engine `e`, without allocating it (--dry-run).
+ */
+static void estimate_memory(const options_t *opt, const char *program,
+                            const circles_engine_t *e)
+{
+    const int count = opt->input ? circles_count(opt->input) : opt->ncircles;
+    if (count < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+    const uint64_t n = count;
+    const uint64_t nframes = opt->iterations / opt->traj_every + 1;
+    const int nthreads = e->threaded ? opt->dry_run : 1;
+    mem_usage_t est;
+    memset(&est, 0, sizeof(est));
+    est.kind[MEM_CIRCLES] = circles_footprint(n);
+    if (opt->trace)
+    {
+        est.kind[MEM_THREADS] = nthreads * trace_footprint();
+    }
+    if (opt->trajectory)
+    {
+        est.kind[MEM_OUTPUT] += traj_writer_footprint(n, nframes, opt->traj_buffers);
+    }
+    if (opt->render || opt->movie)
+    {
+        est.kind[MEM_OUTPUT] += render_footprint(opt->render_size, n);
+    }
+    if (opt->publish)
+    {
+        est.kind[MEM_OUTPUT] += shm_ring_footprint(n, sizeof(circle_t));
+    }
+    if (e->threaded)
+    {
+        printf("Memory needed by %s for %llu circles, %d threads:\n", program,
+               (unsigned long long)n, nthreads);
+    }
+    else
+    {
+        printf("Memory needed by %s for %llu circles:\n", program, (unsigned long long)n);
+    }
+    mem_estimate_print(stdout, &est, nthreads);
+}
+
+int driver_main(int argc, char *argv[], const char *program, const char *engine,
+                const char *movie_prefix)
+{
+    options_t opt;
+
+    options_init(&opt);
+    if (options_parse(&opt, argc, argv) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    const int iterations = opt.iterations;
+    const circles_engine_t *e = circles_engine(opt.engine ? opt.engine : engine);
+    if (e == NULL)
+    {
+        fprintf(stderr, "%s: unknown engine \"%s\"; the engines are:\n", argv[0], opt.engine);
+        circles_engine_list(stderr);
+        return EXIT_FAILURE;
+    }
+    if (opt.dry_run)
+    {
+        estimate_memory(&opt, program, e);
+        return EXIT_SUCCESS;
+    }
+    /* from now on a SIGUSR1 no longer terminates the program, even
+       while loading the circles */
+    if (progress_install() != 0)
+    {
+        fprintf(stderr, "Cannot install the handler of SIGUSR1\n");
+    }
+
+    circles_init(&sim);
+    sim.engine = e;
+#ifdef HPC_TIMERS
+    const circles_timers_t timers = {hpc_timer_begin, hpc_timer_end, hpc_timer_items};
+    sim.timers = timers;
+#endif
+    if (opt.input ? circles_load(&sim, opt.input) : circles_random(&sim, opt.ncircles, opt.seed))
+    {
+        return EXIT_FAILURE;
+    }
+    if (opt.trajectory)
+    {
+        open_trajectory(&opt);
+    }
+    if (opt.render || opt.movie)
+    {
+        open_renderer(&opt);
+    }
+    if (opt.publish)
+    {
+        open_ring(&opt);
+    }
+    if (opt.trace)
+    {
+        trace_open();
+    }
+    pair_stats_t pairs, total_pairs = {0, 0, 0, 0};
+    latency_t latency;
+    if (latency_init(&latency, iterations) != 0)
+    {
+        fprintf(stderr, "Cannot allocate the latency histogram\n");
+        return EXIT_FAILURE;
+    }
+    telemetry_t telemetry;
+    if (telemetry_open(&telemetry, opt.telemetry, program) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    const double tstart_prog = hpc_gettime();
+    if (movie_prefix)
+    {
+        circles_dump_gp(&sim, movie_prefix, 0);
+    }
+    write_frame(0, -1);
+    /* with --batch, each step of the loop runs a batch of iterations
+       through circles_step(), and the output follows its last one */
+    int step = 1;
+    for (int it = 0; it < iterations; it += step)
+    {
+        const double tstart_iter = hpc_gettime();
+        const uint64_t titer = trace_begin();
+        int n_overlaps;
+        HPC_TIMER_BEGIN("iteration");
+        if (opt.batch > 0)
+        {
+            step = (opt.batch < iterations - it) ? opt.batch : iterations - it;
+            n_overlaps = circles_step(&sim, step);
+            pairs = sim.pairs;
+        }
+        else
+        {
+            n_overlaps = circles_iterate(&sim, it + 1, &pairs);
+        }
+        HPC_TIMER_END("iteration");
+        trace_end("iteration", "phase", titer, it + step);
+        const double elapsed_iter = hpc_gettime() - tstart_iter;
+        if (movie_prefix)
+        {
+            circles_dump_gp(&sim, movie_prefix, it + step);
+        }
+        const uint64_t tphase = trace_begin();
+        HPC_TIMER_BEGIN("output");
+        write_frame(it + step, n_overlaps);
+        HPC_TIMER_END("output");
+        trace_end("output", "phase", tphase, it + step);
+        pair_stats_add(&total_pairs, &pairs);
+        /* the latency includes the output of the iteration; the
+           iterations of a batch are given its average */
+        const double latency_iter = hpc_gettime() - tstart_iter;
+        for (int k = 0; k < step; k++)
+        {
+            latency_record(&latency, it + k, latency_iter / step);
+        }
+        const telemetry_record_t rec = {it + step, iterations, elapsed_iter, latency_iter, pairs};
+        telemetry_append(&telemetry, &rec);
+        if (telemetry_shown(opt.verbosity, it + step, iterations))
+        {
+            telemetry_print(stdout, &rec);
+        }
+        if (progress_pending())
+        {
+            telemetry_flush(&telemetry);
+            const progress_t p = {it + step, iterations, hpc_gettime() - tstart_prog, n_overlaps,
+                                  circles_count_active(&sim), sim.n, &total_pairs, &latency};
+            progress_dump(stderr, &p);
+            HPC_TIMER_REPORT(NULL);
+            if (e->threaded)
+            {
+                HPC_TIMER_IMBALANCE("pairs", "idle");
+            }
+        }
+    }
+    const double elapsed_prog = hpc_gettime() - tstart_prog;
+    printf("Elapsed time: %f\n", elapsed_prog);
+    pair_stats_print(stdout, &total_pairs, iterations);
+    latency_print(stdout, &latency);
+    latency_free(&latency);
+    HPC_TIMER_REPORT(NULL);
+    if (e->threaded)
+    {
+        HPC_TIMER_IMBALANCE("pairs", "idle");
+    }
+    if (opt.trace && trace_write(opt.trace, 0, program) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    if (opt.summary)
+    {
+        run_summary_t summary;
+        summary_init(&summary, program);
+        summary.threads = circles_engine_threads(e);
+        summary.ncircles = sim.n;
+        summary.iterations = iterations;
+        summary.elapsed = elapsed_prog;
+        summary.pairs = total_pairs;
+        if (summary_write(opt.summary, &summary) != 0)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (telemetry_close(&telemetry) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    if (opt.trajectory && traj_writer_close(&traj) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    if (render_free(&render) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    if (opt.publish)
+    {
+        shm_ring_close(&ring);
+    }
+    if (opt.output && circles_save(&sim, opt.output, iterations) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    circles_free(&sim);
+    mem_usage_t mem;
+    mem_usage(&mem);
+    mem_print(stdout, "Memory", &mem);
+
+    return EXIT_SUCCESS;
+}
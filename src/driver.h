@@ -0,0 +1,42 @@
+/****************************************************************************
+ *
+ * driver.h - Main program of the shared-memory circles programs
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * circles and omp-circles only differ in the engine they run by
+ * default (see libcircles.h): both are this main program. The driver
+ * is the translation unit of those programs that includes hpc.h, which
+ * defines its functions in the header; mpi-circles has a main program
+ * of its own.
+ *
+ ****************************************************************************/
+
+#ifndef DRIVER_H
+#define DRIVER_H
+
+/**
+ * Parse the command line and run the simulation as the program
+ * `program`, with the engine `engine` unless --engine is given. With
+ * a `movie_prefix`, the circles are also written at each iteration to
+ * the gnuplot files "MOVIE_PREFIX-ITERNO.gp". Returns the exit status
+ * of the program.
+ */
+int driver_main(int argc, char *argv[], const char *program, const char *engine,
+                const char *movie_prefix);
+
+#endif
@@ -0,0 +1,407 @@
+/****************************************************************************
+ *
+ * engines.c - Kernels of the circles simulation
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * The engines described in libcircles.h. Each push is computed with
+ * the same expressions in all of them, in single precision:
+ *
+ *        overlap_x = (Rsum - dist) / (dist + EPSILON) * deltax
+ *        dx = dx -/+ overlap_x / K
+ *
+ * so that the engines differ only in the order in which the pushes
+ * are added.
+ *
+ ****************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <omp.h>
+#include "libcircles.h"
+#include "trace.h"
+
+/**
+ * Set the displacements of the circles [lo, hi) to zero.
+ */
+static void reset_range(circles_t *c, int lo, int hi)
+{
+    for (int i = lo; i < hi; i++)
+    {
+        CIRCLES_DX(c, i) = CIRCLES_DY(c, i) = 0.0;
+    }
+}
+
+static void serial_reset(circles_t *c)
+{
+    reset_range(c, 0, c->n);
+}
+
+static void gather_reset(circles_t *c)
+{
+    reset_range(c, c->start, c->end);
+}
+
+static void omp_reset(circles_t *c)
+{
+#pragma omp parallel for
+    for (int i = 0; i < c->n; i++)
+    {
+        CIRCLES_DX(c, i) = CIRCLES_DY(c, i) = 0.0;
+    }
+}
+
+static void omp_gather_reset(circles_t *c)
+{
+#pragma omp parallel for
+    for (int i = c->start; i < c->end; i++)
+    {
+        CIRCLES_DX(c, i) = CIRCLES_DY(c, i) = 0.0;
+    }
+}
+
+/**
+ * Move the circles to a new position according to the forces acting
+ * on each one.
+ */
+static void serial_move(circles_t *c)
+{
+    for (int i = 0; i < c->n; i++)
+    {
+        CIRCLES_X(c, i) += CIRCLES_DX(c, i);
+        CIRCLES_Y(c, i) += CIRCLES_DY(c, i);
+    }
+}
+
+static void omp_move(circles_t *c)
+{
+#pragma omp parallel for
+    for (int i = 0; i < c->n; i++)
+    {
+        CIRCLES_X(c, i) += CIRCLES_DX(c, i);
+        CIRCLES_Y(c, i) += CIRCLES_DY(c, i);
+    }
+}
+
+/**
+ * Compute the force acting on each circle; returns the number of
+ * overlapping pairs of circles (each overlapping pair is counted only
+ * once). The pairs examined are counted into `pairs`.
+ */
+static int serial_forces(circles_t *c, pair_stats_t *pairs)
+{
+    const int n = c->n;
+    const float EPSILON = c->epsilon;
+    const float K = c->k;
+    int n_intersections = 0;
+    uint64_t tests = 0;
+    for (int i = 0; i < n; i++)
+    {
+        /* every pair is tested, and every test computes hypotf() */
+        tests += n - 1 - i;
+        for (int j = i + 1; j < n; j++)
+        {
+            const float deltax = CIRCLES_X(c, j) - CIRCLES_X(c, i);
+            const float deltay = CIRCLES_Y(c, j) - CIRCLES_Y(c, i);
+            const float dist = hypotf(deltax, deltay);
+            const float Rsum = CIRCLES_R(c, i) + CIRCLES_R(c, j);
+            if (dist < Rsum - EPSILON)
+            {
+                n_intersections++;
+                const float overlap = Rsum - dist;
+                assert(overlap > 0.0);
+                // avoid division by zero
+                const float overlap_x = overlap / (dist + EPSILON) * deltax;
+                const float overlap_y = overlap / (dist + EPSILON) * deltay;
+                CIRCLES_DX(c, i) -= overlap_x / K;
+                CIRCLES_DY(c, i) -= overlap_y / K;
+                CIRCLES_DX(c, j) += overlap_x / K;
+                CIRCLES_DY(c, j) += overlap_y / K;
+            }
+        }
+    }
+    pairs->candidates = pairs->tests = pairs->sqrts = tests;
+    pairs->overlaps = n_intersections;
+    return n_intersections;
+}
+
+/**
+ * The serial kernel with the n*n pairs (i, j) numbered row by row and
+ * split into chunks of about n / (number of threads) pairs, handed out
+ * dynamically; this is what schedule(dynamic, n / threads) does with
+ * the two loops collapsed, but the chunks are explicit so that they
+ * can be traced. The loop does not wait at its end, so that each
+ * thread can stop its timer as soon as it runs out of pairs; the
+ * threads still wait for each other at the end of the parallel
+ * region.
+ */
+static int omp_forces(circles_t *c, pair_stats_t *pairs)
+{
+    const int n = c->n;
+    const float EPSILON = c->epsilon;
+    const float K = c->k;
+    int n_intersections = 0;
+    uint64_t candidates = 0, tests = 0;
+    const long npairs = (long)n * n;
+#pragma omp parallel reduction(+ : n_intersections, candidates, tests)
+    {
+        const long chunk = n / omp_get_num_threads() > 0 ? n / omp_get_num_threads() : 1;
+        const long nchunks = (npairs + chunk - 1) / chunk;
+        /* each thread times its own share of the pairs */
+        CIRCLES_TIMER_BEGIN(c, "pairs");
+#pragma omp for schedule(dynamic) nowait
+        for (long ch = 0; ch < nchunks; ch++)
+        {
+            const uint64_t tstart = trace_begin();
+            const long first = ch * chunk;
+            const long last = (first + chunk < npairs) ? first + chunk : npairs;
+            int i = (int)(first / n), j = (int)(first % n);
+            for (long k = first; k < last; k++)
+            {
+                /* all the n*n pairs are generated, and those with j <= i
+                   are discarded */
+                candidates++;
+                if (j > i)
+                {
+                    tests++;
+                    const float deltax = CIRCLES_X(c, j) - CIRCLES_X(c, i);
+                    const float deltay = CIRCLES_Y(c, j) - CIRCLES_Y(c, i);
+                    const float dist = hypotf(deltax, deltay);
+                    const float Rsum = CIRCLES_R(c, i) + CIRCLES_R(c, j);
+                    if (dist < Rsum - EPSILON)
+                    {
+                        const float overlap = Rsum - dist;
+                        assert(overlap > 0.0); // avoid division by zero
+                        const float overlap_x = overlap / (dist + EPSILON) * deltax;
+                        const float overlap_y = overlap / (dist + EPSILON) * deltay;
+#pragma omp atomic
+                        CIRCLES_DX(c, i) -= overlap_x / K;
+#pragma omp atomic
+                        CIRCLES_DY(c, i) -= overlap_y / K;
+#pragma omp atomic
+                        CIRCLES_DX(c, j) += overlap_x / K;
+#pragma omp atomic
+                        CIRCLES_DY(c, j) += overlap_y / K;
+                        n_intersections++;
+                    }
+                }
+                if (++j == n)
+                {
+                    j = 0;
+                    i++;
+                }
+            }
+            trace_end("chunk", "omp", tstart, ch);
+        }
+        CIRCLES_TIMER_ITEMS(c, tests);
+        CIRCLES_TIMER_END(c, "pairs");
+        /* with the timers, the time each thread waits for the others */
+        if (c->timers.begin)
+        {
+            CIRCLES_TIMER_BEGIN(c, "idle");
+#pragma omp barrier
+            CIRCLES_TIMER_END(c, "idle");
+        }
+    }
+    /* every test computes hypotf() */
+    pairs->candidates = candidates;
+    pairs->tests = pairs->sqrts = tests;
+    pairs->overlaps = n_intersections;
+    return n_intersections;
+}
+
+/**
+ * Sum the pushes of all the other circles on the circles [lo, hi);
+ * returns the overlapping pairs (i, j) with j > i, and adds the pairs
+ * examined to `*candidates`.
+ *
+ * Only circle i is written: the half of the push that belongs to j is
+ * computed again for j. The push is computed exactly as in the serial
+ * kernel (hypotf() and the sum of the radii do not depend on the order
+ * of the two circles), and the pushes on a circle are added in the
+ * same order, by increasing j, so the result is identical to the
+ * serial kernel however the circles are split.
+ */
+static int gather_rows(circles_t *c, int lo, int hi, uint64_t *candidates)
+{
+    const int n = c->n;
+    const float EPSILON = c->epsilon;
+    const float K = c->k;
+    int n_intersections = 0;
+    for (int i = lo; i < hi; i++)
+    {
+        /* every j is generated, and all but i are tested */
+        *candidates += n;
+        for (int j = 0; j < n; j++)
+        {
+            if (i == j)
+                continue;
+            const float deltax = CIRCLES_X(c, j) - CIRCLES_X(c, i);
+            const float deltay = CIRCLES_Y(c, j) - CIRCLES_Y(c, i);
+            const float dist = hypotf(deltax, deltay);
+            const float Rsum = CIRCLES_R(c, i) + CIRCLES_R(c, j);
+            if (dist < Rsum - EPSILON)
+            {
+                if (j > i)
+                    n_intersections++;
+                const float overlap = Rsum - dist;
+                assert(overlap > 0.0);
+                // avoid division by zero
+                const float overlap_x = overlap / (dist + EPSILON) * deltax;
+                const float overlap_y = overlap / (dist + EPSILON) * deltay;
+                CIRCLES_DX(c, i) -= overlap_x / K;
+                CIRCLES_DY(c, i) -= overlap_y / K;
+            }
+        }
+    }
+    return n_intersections;
+}
+
+/**
+ * Compute the force acting on the circles [start, end); returns the
+ * number of overlapping pairs whose first circle is in the range, so
+ * that the sum over all the ranges counts each pair once.
+ */
+static int gather_forces(circles_t *c, pair_stats_t *pairs)
+{
+    uint64_t candidates = 0;
+    const int n_intersections = gather_rows(c, c->start, c->end, &candidates);
+    pairs->candidates = candidates;
+    /* every test computes hypotf() */
+    pairs->tests = pairs->sqrts = candidates - (uint64_t)(c->end - c->start);
+    pairs->overlaps = n_intersections;
+    return n_intersections;
+}
+
+/**
+ * The gather kernel with the rows split into chunks, about four per
+ * thread, handed out dynamically. Each thread writes only the
+ * circles of its rows: no atomics are needed, and the result does not
+ * depend on the number of threads.
+ */
+static int omp_gather_forces(circles_t *c, pair_stats_t *pairs)
+{
+    const int rows = c->end - c->start;
+    int n_intersections = 0;
+    uint64_t candidates = 0;
+#pragma omp parallel reduction(+ : n_intersections, candidates)
+    {
+        const int nchunks = 4 * omp_get_num_threads();
+        const int chunk = (rows + nchunks - 1) / nchunks > 0 ? (rows + nchunks - 1) / nchunks : 1;
+        uint64_t mine = 0;
+        CIRCLES_TIMER_BEGIN(c, "pairs");
+#pragma omp for schedule(dynamic) nowait
+        for (int ch = 0; ch < nchunks; ch++)
+        {
+            const uint64_t tstart = trace_begin();
+            const int lo = c->start + ch * chunk < c->end ? c->start + ch * chunk : c->end;
+            const int hi = lo + chunk < c->end ? lo + chunk : c->end;
+            n_intersections += gather_rows(c, lo, hi, &mine);
+            trace_end("chunk", "omp", tstart, ch);
+        }
+        candidates += mine;
+        CIRCLES_TIMER_ITEMS(c, mine);
+        CIRCLES_TIMER_END(c, "pairs");
+        if (c->timers.begin)
+        {
+            CIRCLES_TIMER_BEGIN(c, "idle");
+#pragma omp barrier
+            CIRCLES_TIMER_END(c, "idle");
+        }
+    }
+    pairs->candidates = candidates;
+    pairs->tests = pairs->sqrts = candidates - (uint64_t)rows;
+    pairs->overlaps = n_intersections;
+    return n_intersections;
+}
+
+/**
+ * k iterations of omp-gather in one parallel region: the threads
+ * split the reset, the rows of the forces and the move of each
+ * iteration, and wait for each other only at the end of each loop.
+ * The displacements are reset while moving the circles, since each
+ * circle is moved and then only written again by the forces of the
+ * next iteration; those of the last iteration are kept.
+ */
+static int omp_gather_step(circles_t *c, int k, pair_stats_t *pairs)
+{
+    const int n = c->n;
+    int overlaps = 0, last = 0;
+    uint64_t candidates = 0, total_candidates = 0, total_overlaps = 0;
+#pragma omp parallel
+    {
+        const int nchunks = 4 * omp_get_num_threads();
+        const int chunk = (n + nchunks - 1) / nchunks > 0 ? (n + nchunks - 1) / nchunks : 1;
+#pragma omp for
+        for (int i = 0; i < n; i++)
+        {
+            CIRCLES_DX(c, i) = CIRCLES_DY(c, i) = 0.0;
+        }
+        for (int it = 0; it < k; it++)
+        {
+#pragma omp for schedule(dynamic) reduction(+ : overlaps, candidates)
+            for (int ch = 0; ch < nchunks; ch++)
+            {
+                const int lo = ch * chunk < n ? ch * chunk : n;
+                const int hi = lo + chunk < n ? lo + chunk : n;
+                overlaps += gather_rows(c, lo, hi, &candidates);
+            }
+            const int keep = (it == k - 1);
+#pragma omp for
+            for (int i = 0; i < n; i++)
+            {
+                CIRCLES_X(c, i) += CIRCLES_DX(c, i);
+                CIRCLES_Y(c, i) += CIRCLES_DY(c, i);
+                if (!keep)
+                {
+                    CIRCLES_DX(c, i) = CIRCLES_DY(c, i) = 0.0;
+                }
+            }
+#pragma omp single
+            {
+                last = overlaps;
+                total_overlaps += overlaps;
+                total_candidates += candidates;
+                overlaps = 0;
+                candidates = 0;
+            }
+        }
+    }
+    pairs->candidates = total_candidates;
+    pairs->tests = pairs->sqrts = total_candidates - (uint64_t)k * n;
+    pairs->overlaps = total_overlaps;
+    return last;
+}
+
+static const circles_engine_t serial_engine = {
+    "serial", "each pair once, pushing both circles (circles)", 0, 0,
+    serial_reset, serial_forces, serial_move, NULL};
+
+static const circles_engine_t omp_engine = {
+    "omp", "each pair once, in chunks of pairs among the threads (omp-circles)", 1, 0,
+    omp_reset, omp_forces, omp_move, NULL};
+
+static const circles_engine_t gather_engine = {
+    "gather", "each circle sums the pushes on itself (mpi-circles)", 0, 1,
+    gather_reset, gather_forces, serial_move, NULL};
+
+static const circles_engine_t omp_gather_engine = {
+    "omp-gather", "gather, with the circles split among the threads", 1, 1,
+    omp_gather_reset, omp_gather_forces, omp_move, omp_gather_step};
+
+const circles_engine_t *const circles_engines[] = {
+    &serial_engine, &omp_engine, &gather_engine, &omp_gather_engine, NULL};
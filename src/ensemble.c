@@ -0,0 +1,492 @@
+/****************************************************************************
+ *
+ * ensemble.c - Run many independent small simulations concurrently
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***
+% Ensembles of simulations
+% Alessandro Monticelli
+
+Runs one simulation for each combination of a number of circles, a
+seed and a stiffness K, for parameter sweeps. A simulation of a few
+thousand circles is too small to be split among the threads
+(omp-circles spends most of the time forking and joining them), so
+here each simulation runs on one thread, with the serial engine of
+libcircles, and the threads run different simulations at the same
+time.
+
+The simulations are dealt to one queue per thread, largest first;
+each thread takes the simulations of its own queue from the front
+and, when it runs out of them, steals from the back of the queues of
+the others. Each thread allocates once, and touches first, an arena
+of five columns (x, y, r, dx, dy) for the largest simulation, which
+every simulation of the thread wraps with circles_wrap(): nothing is
+allocated while the simulations run. The initial circles come from
+the generator of `workload.c`, which has no shared state, so the
+results do not depend on the thread that runs a simulation.
+
+All the results go to a single CSV table, one line per simulation in
+the order of the sweep (circles, then K, then seed): the overlaps and
+the circles moved by the last iteration, the time of the simulation
+and the thread that ran it. The throughput of the whole ensemble, in
+simulations per second, and the work of each thread are printed on
+stderr at the end.
+
+To compile:
+
+        gcc -std=c99 -fopenmp -Wall -Wpedantic -O2 ensemble.c argutil.c libcircles.c engines.c workload.c snapshot.c textimport.c trace.c memtrack.c pairstats.c -o ensemble -lm -pthread
+
+To execute:
+
+        ./ensemble [options]
+
+for example
+
+        OMP_NUM_THREADS=8 ./ensemble --circles 500,1000,2000 --seeds 1-100 --k 1.5,2,3 --output sweep.csv
+
+Run `./ensemble --help` for the list of the options.
+
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "libcircles.h"
+#include "argutil.h"
+#include "workload.h"
+#include "memtrack.h"
+
+#define MAX_VALUES 4096
+/* Largest sweep; each list may have MAX_VALUES values, but not their
+   product */
+#define MAX_SIMS (1 << 22)
+
+typedef struct
+{
+    int circles[MAX_VALUES]; /* numbers of circles */
+    int ncircles;
+    long seeds[MAX_VALUES];  /* seeds */
+    int nseeds;
+    float k[MAX_VALUES];     /* stiffness */
+    int nk;
+    int iterations;          /* iterations of each simulation */
+    const char *scenario;    /* workload of the initial circles */
+    const circles_engine_t *engine;
+    int threads;             /* threads running the simulations */
+    const char *output;      /* CSV table, NULL for stdout */
+} ensemble_opt_t;
+
+typedef struct
+{
+    int n;            /* circles */
+    long seed;
+    float k;
+    int overlaps;     /* overlaps in the last iteration */
+    int moved;        /* circles moved by the last iteration */
+    uint64_t tests;   /* pairs tested by all the iterations */
+    double seconds;   /* time of the simulation */
+    int thread;       /* thread that ran it */
+} sim_t;
+
+/* simulations [head, tail) of `slot` not taken yet; a simulation lasts
+   far longer than a lock, so each queue simply has one */
+typedef struct
+{
+    omp_lock_t lock;
+    int head, tail;
+    char pad[64];     /* keep the queues apart */
+} queue_t;
+
+typedef struct
+{
+    int sims;         /* simulations run */
+    int steals;       /* of which taken from other queues */
+    double busy;      /* time spent in the simulations */
+    char pad[64];
+} worker_t;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "\n"
+            "Options:\n"
+            "  --circles LIST  numbers of circles, e.g. 500,1000,2000 or\n"
+            "                  500-503 (default 1000)\n"
+            "  --seeds LIST    seeds of the initial circles (default 1-8)\n"
+            "  --k LIST        values of K, e.g. 1.5,2,3 (default 1.5)\n"
+            "  --iterations N  iterations of each simulation (default 100)\n"
+            "  --scenario NAME workload of the initial circles (default\n"
+            "                  uniform, see below)\n"
+            "  --engine NAME   kernels of each simulation: serial (default) or\n"
+            "                  gather; the threaded engines are not allowed\n"
+            "  --threads N     threads running the simulations (default: the\n"
+            "                  OpenMP threads)\n"
+            "  --output FILE   write the table to FILE instead of stdout\n"
+            "\n"
+            "Workloads:\n",
+            prog);
+    workload_list(stderr);
+}
+
+/**
+ * Parse a list of integers such as "1,2,4" or "1-100,200" into `v`;
+ * returns the number of values, -1 on failure.
+ */
+static int parse_longs(const char *list, long *v, long min)
+{
+    int count = 0;
+    while (*list != '\0')
+    {
+        char *end;
+        const long first = strtol(list, &end, 10);
+        long last = first;
+        if (end == list || first < min)
+            return -1;
+        if (*end == '-')
+        {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first)
+                return -1;
+        }
+        for (long x = first; x <= last; x++)
+        {
+            if (count == MAX_VALUES)
+                return -1;
+            v[count++] = x;
+        }
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        list = end;
+    }
+    return count > 0 ? count : -1;
+}
+
+/**
+ * Parse a comma-separated list of positive numbers into `v`; returns
+ * the number of values, -1 on failure.
+ */
+static int parse_floats(const char *list, float *v)
+{
+    int count = 0;
+    while (*list != '\0')
+    {
+        char *end;
+        const double x = strtod(list, &end);
+        if (end == list || !(x > 0) || count == MAX_VALUES)
+            return -1;
+        v[count++] = (float)x;
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        list = end;
+    }
+    return count > 0 ? count : -1;
+}
+
+static int parse_options(ensemble_opt_t *opt, int argc, char *argv[])
+{
+    static long values[MAX_VALUES];
+    const char *circles = "1000", *seeds = "1-8", *k = "1.5", *engine = "serial";
+
+    memset(opt, 0, sizeof(*opt));
+    opt->iterations = 100;
+    opt->scenario = "uniform";
+    opt->threads = omp_get_max_threads();
+    for (int i = 1; i < argc; i++)
+    {
+        const char *val = NULL;
+        int m;
+        if ((m = arg_match("--circles", argc, argv, &i, &val)) != 0)
+            circles = val;
+        else if ((m = arg_match("--seeds", argc, argv, &i, &val)) != 0)
+            seeds = val;
+        else if ((m = arg_match("--k", argc, argv, &i, &val)) != 0)
+            k = val;
+        else if ((m = arg_match("--iterations", argc, argv, &i, &val)) != 0)
+            opt->iterations = atoi(val);
+        else if ((m = arg_match("--scenario", argc, argv, &i, &val)) != 0)
+            opt->scenario = val;
+        else if ((m = arg_match("--engine", argc, argv, &i, &val)) != 0)
+            engine = val;
+        else if ((m = arg_match("--threads", argc, argv, &i, &val)) != 0)
+            opt->threads = atoi(val);
+        else if ((m = arg_match("--output", argc, argv, &i, &val)) != 0)
+            opt->output = val;
+        else
+        {
+            if (strcmp(argv[i], "--help") != 0)
+                fprintf(stderr, "%s: unexpected argument %s\n", argv[0], argv[i]);
+            return -1;
+        }
+        if (m < 0)
+            return -1;
+    }
+    opt->ncircles = parse_longs(circles, values, 1);
+    for (int i = 0; i < opt->ncircles; i++)
+    {
+        if (values[i] > 1000000)
+            opt->ncircles = -1;
+        else
+            opt->circles[i] = (int)values[i];
+    }
+    if (opt->ncircles < 0)
+    {
+        fprintf(stderr, "%s: invalid numbers of circles %s\n", argv[0], circles);
+        return -1;
+    }
+    if ((opt->nseeds = parse_longs(seeds, opt->seeds, 0)) < 0)
+    {
+        fprintf(stderr, "%s: invalid seeds %s\n", argv[0], seeds);
+        return -1;
+    }
+    if ((opt->nk = parse_floats(k, opt->k)) < 0)
+    {
+        fprintf(stderr, "%s: invalid values of K %s\n", argv[0], k);
+        return -1;
+    }
+    if (!workload_valid(opt->scenario))
+    {
+        fprintf(stderr, "%s: unknown workload %s\n", argv[0], opt->scenario);
+        return -1;
+    }
+    opt->engine = circles_engine(engine);
+    if (opt->engine == NULL || opt->engine->threaded)
+    {
+        fprintf(stderr, "%s: the engine must be serial or gather\n", argv[0]);
+        return -1;
+    }
+    if (opt->iterations < 0 || opt->threads < 1)
+    {
+        fprintf(stderr, "%s: invalid number of iterations or threads\n", argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+/* simulations ordered by decreasing number of circles (the work grows
+   as its square), then by position in the sweep */
+static const sim_t *sort_sims;
+
+static int by_cost(const void *a, const void *b)
+{
+    const int i = *(const int *)a, j = *(const int *)b;
+    if (sort_sims[i].n != sort_sims[j].n)
+        return sort_sims[i].n > sort_sims[j].n ? -1 : 1;
+    return i - j;
+}
+
+/**
+ * Take the next simulation of `q`, from the front (`front` nonzero)
+ * or from the back; -1 if the queue is empty.
+ */
+static int take(queue_t *q, const int *slot, int front)
+{
+    int s = -1;
+    omp_set_lock(&q->lock);
+    if (q->head < q->tail)
+    {
+        s = front ? slot[q->head++] : slot[--q->tail];
+    }
+    omp_unset_lock(&q->lock);
+    return s;
+}
+
+/**
+ * Run the simulation `sim` on the five columns of `arena`.
+ */
+static void simulate(sim_t *sim, const ensemble_opt_t *opt, float *arena, int maxn)
+{
+    float *x = arena, *y = arena + maxn, *r = arena + 2 * (size_t)maxn;
+    float *dx = arena + 3 * (size_t)maxn, *dy = arena + 4 * (size_t)maxn;
+    const circle_view_t pos = {x, y, r, sizeof(float)};
+    workload_domain_t dom;
+    circles_t c;
+
+    circles_init(&c);
+    workload_fill(opt->scenario, sim->n, sim->seed, &pos, &dom);
+    c.xmin = dom.xmin;
+    c.xmax = dom.xmax;
+    c.ymin = dom.ymin;
+    c.ymax = dom.ymax;
+    c.k = sim->k;
+    c.seed = sim->seed;
+    c.engine = opt->engine;
+    /* the arena still holds the displacements of the previous one */
+    memset(dx, 0, sim->n * sizeof(float));
+    memset(dy, 0, sim->n * sizeof(float));
+    circles_wrap(&c, sim->n, &pos, dx, dy, sizeof(float));
+    sim->overlaps = circles_step(&c, opt->iterations);
+    sim->moved = circles_count_active(&c);
+    sim->tests = c.pairs.tests;
+    circles_free(&c);
+}
+
+int main(int argc, char *argv[])
+{
+    ensemble_opt_t opt;
+    if (parse_options(&opt, argc, argv) != 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    FILE *out = stdout;
+    if (opt.output != NULL && (out = fopen(opt.output, "w")) == NULL)
+    {
+        perror(opt.output);
+        return EXIT_FAILURE;
+    }
+
+    /* the sweep, in the order of the table */
+    const size_t total = (size_t)opt.ncircles * opt.nk * opt.nseeds;
+    if (total > MAX_SIMS)
+    {
+        fprintf(stderr, "%s: %zu simulations, more than %d\n", argv[0], total, MAX_SIMS);
+        return EXIT_FAILURE;
+    }
+    const int nsims = (int)total;
+    sim_t *sims = (sim_t *)calloc(nsims, sizeof(*sims));
+    int *slot = (int *)malloc((size_t)nsims * sizeof(*slot));
+    queue_t *queue = (queue_t *)malloc(opt.threads * sizeof(*queue));
+    worker_t *worker = (worker_t *)calloc(opt.threads, sizeof(*worker));
+    if (sims == NULL || slot == NULL || queue == NULL || worker == NULL)
+    {
+        fprintf(stderr, "Cannot allocate %d simulations\n", nsims);
+        return EXIT_FAILURE;
+    }
+    int maxn = 0;
+    for (int a = 0, s = 0; a < opt.ncircles; a++)
+    {
+        maxn = opt.circles[a] > maxn ? opt.circles[a] : maxn;
+        for (int b = 0; b < opt.nk; b++)
+        {
+            for (int c = 0; c < opt.nseeds; c++, s++)
+            {
+                sims[s].n = opt.circles[a];
+                sims[s].k = opt.k[b];
+                sims[s].seed = opt.seeds[c];
+            }
+        }
+    }
+
+    /* deal the simulations, largest first, so that each queue holds
+       about the same work in decreasing order */
+    int *order = (int *)malloc((size_t)nsims * sizeof(*order));
+    if (order == NULL)
+    {
+        fprintf(stderr, "Cannot allocate %d simulations\n", nsims);
+        return EXIT_FAILURE;
+    }
+    for (int s = 0; s < nsims; s++)
+        order[s] = s;
+    sort_sims = sims;
+    qsort(order, nsims, sizeof(*order), by_cost);
+    for (int t = 0, next = 0; t < opt.threads; t++)
+    {
+        omp_init_lock(&queue[t].lock);
+        queue[t].head = next;
+        for (int s = t; s < nsims; s += opt.threads)
+            slot[next++] = order[s];
+        queue[t].tail = next;
+    }
+    free(order);
+
+    const double tstart = omp_get_wtime();
+    int failed = 0;
+#pragma omp parallel num_threads(opt.threads) reduction(+ : failed)
+    {
+        const int me = omp_get_thread_num();
+        worker_t *w = &worker[me];
+        /* allocated and first touched by the thread that uses it */
+        float *arena = (float *)mem_calloc(MEM_THREADS, 5 * (size_t)maxn, sizeof(float));
+        if (arena == NULL)
+        {
+            fprintf(stderr, "Cannot allocate the arena of thread %d\n", me);
+            failed = 1;
+        }
+        /* the own queue first, then the others in turn; nothing is ever
+           added to a queue, so an empty one stays empty (with fewer
+           threads than asked for, the queues of the missing ones are
+           emptied by stealing) */
+        for (int victim = 0; arena != NULL && victim < opt.threads;)
+        {
+            const int q = (me + victim) % opt.threads;
+            const int s = take(&queue[q], slot, q == me);
+            if (s < 0)
+            {
+                victim++;
+                continue;
+            }
+            const double t0 = omp_get_wtime();
+            simulate(&sims[s], &opt, arena, maxn);
+            sims[s].seconds = omp_get_wtime() - t0;
+            sims[s].thread = me;
+            w->busy += sims[s].seconds;
+            w->sims++;
+            w->steals += (q != me);
+        }
+        mem_free(arena);
+    }
+    const double elapsed = omp_get_wtime() - tstart;
+    if (failed)
+    {
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "circles,seed,k,iterations,overlaps,moved,seconds,thread\n");
+    uint64_t tests = 0;
+    for (int s = 0; s < nsims; s++)
+    {
+        fprintf(out, "%d,%ld,%g,%d,%d,%d,%.6f,%d\n", sims[s].n, sims[s].seed, sims[s].k,
+                opt.iterations, sims[s].overlaps, sims[s].moved, sims[s].seconds, sims[s].thread);
+        tests += sims[s].tests;
+    }
+    if (out != stdout && fclose(out) != 0)
+    {
+        perror(opt.output);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "Ensemble: %d simulations (%d sizes x %d values of K x %d seeds), "
+            "%d iterations each, %s engine, %d threads\n",
+            nsims, opt.ncircles, opt.nk, opt.nseeds, opt.iterations, opt.engine->name,
+            opt.threads);
+    fprintf(stderr, "Elapsed time: %f s, %.2f simulations/s, %.3e pair tests/s\n",
+            elapsed, elapsed > 0 ? nsims / elapsed : 0.0, elapsed > 0 ? tests / elapsed : 0.0);
+    fprintf(stderr, "%10s %8s %8s %12s %8s\n", "thread", "sims", "steals", "busy (s)", "busy %");
+    for (int t = 0; t < opt.threads; t++)
+    {
+        fprintf(stderr, "%10d %8d %8d %12.6f %7.1f%%\n", t, worker[t].sims, worker[t].steals,
+                worker[t].busy, elapsed > 0 ? 100 * worker[t].busy / elapsed : 0.0);
+        omp_destroy_lock(&queue[t].lock);
+    }
+    mem_usage_t mem;
+    mem_usage(&mem);
+    mem_print(stderr, "Memory", &mem);
+
+    free(sims);
+    free(slot);
+    free(queue);
+    free(worker);
+    return EXIT_SUCCESS;
+}
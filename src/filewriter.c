@@ -0,0 +1,189 @@
+/****************************************************************************
+ *
+ * filewriter.c - Positional writes through io_uring or pwrite()
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "filewriter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+/**
+ * Write the whole buffer with pwrite(), retrying after short writes.
+ */
+static int pwrite_all(int fd, const char *data, size_t len, uint64_t offset)
+{
+    while (len > 0)
+    {
+        const ssize_t n = pwrite(fd, data, len, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+int file_writer_open(file_writer_t *fw, const char *path)
+{
+    memset(fw, 0, sizeof(*fw));
+    fw->path = path;
+    fw->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fw->fd < 0)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+#ifdef HAVE_LIBURING
+    struct io_uring *ring = (struct io_uring *)malloc(sizeof(*ring));
+    if (ring != NULL && io_uring_queue_init(FILE_WRITER_QUEUE, ring, 0) == 0)
+    {
+        fw->ring = ring;
+        fw->uring = 1;
+    }
+    else
+    {
+        free(ring);
+    }
+#endif
+    return 0;
+}
+
+int file_writer_write(file_writer_t *fw, const void *data, size_t len, uint64_t offset)
+{
+    /* a flush may also fall back to pwrite() for good */
+    if (fw->uring && fw->nqueued == FILE_WRITER_QUEUE && file_writer_flush(fw) != 0)
+        return -1;
+    if (!fw->uring)
+    {
+        if (pwrite_all(fw->fd, (const char *)data, len, offset) != 0)
+        {
+            fprintf(stderr, "%s: write failed: %s\n", fw->path, strerror(errno));
+            fw->failed = 1;
+            return -1;
+        }
+        return 0;
+    }
+    file_write_t *w = &fw->queue[fw->nqueued++];
+    w->data = data;
+    w->len = len;
+    w->offset = offset;
+    return 0;
+}
+
+int file_writer_flush(file_writer_t *fw)
+{
+#ifdef HAVE_LIBURING
+    if (fw->uring && fw->nqueued > 0)
+    {
+        struct io_uring *ring = (struct io_uring *)fw->ring;
+        for (int i = 0; i < fw->nqueued; i++)
+        {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+            io_uring_prep_write(sqe, fw->fd, fw->queue[i].data, fw->queue[i].len,
+                                fw->queue[i].offset);
+            io_uring_sqe_set_data(sqe, &fw->queue[i]);
+        }
+        /* the kernel may take fewer entries than prepared: submit
+           again as the completions free room, and write the rest with
+           pwrite() if it takes none while nothing is in flight */
+        int submitted = 0, pending = 0;
+        while (submitted < fw->nqueued || pending > 0)
+        {
+            if (submitted < fw->nqueued)
+            {
+                const int s = io_uring_submit(ring);
+                if (s > 0)
+                {
+                    submitted += s;
+                    pending += s;
+                }
+                else if (s != -EINTR && pending == 0)
+                {
+                    break;
+                }
+            }
+            if (pending == 0)
+                continue;
+            struct io_uring_cqe *cqe;
+            const int err = io_uring_wait_cqe(ring, &cqe);
+            if (err == -EINTR)
+                continue;
+            if (err != 0)
+            {
+                fw->failed = 1;
+                break;
+            }
+            pending--;
+            const file_write_t *w = (const file_write_t *)io_uring_cqe_get_data(cqe);
+            const int res = cqe->res;
+            io_uring_cqe_seen(ring, cqe);
+            /* complete short writes synchronously */
+            if (res < 0 ||
+                ((size_t)res < w->len &&
+                 pwrite_all(fw->fd, (const char *)w->data + res, w->len - res, w->offset + res) != 0))
+            {
+                fw->failed = 1;
+            }
+        }
+        if (!fw->failed && submitted < fw->nqueued)
+        {
+            /* the entries left in the ring are never submitted: from now
+               on every write goes through pwrite() */
+            fw->uring = 0;
+            for (int i = submitted; i < fw->nqueued; i++)
+            {
+                if (pwrite_all(fw->fd, (const char *)fw->queue[i].data, fw->queue[i].len,
+                               fw->queue[i].offset) != 0)
+                    fw->failed = 1;
+            }
+        }
+        fw->nqueued = 0;
+        if (fw->failed)
+            fprintf(stderr, "%s: write failed\n", fw->path);
+    }
+#endif
+    return fw->failed ? -1 : 0;
+}
+
+int file_writer_close(file_writer_t *fw)
+{
+    int status = file_writer_flush(fw);
+#ifdef HAVE_LIBURING
+    if (fw->ring != NULL)
+    {
+        io_uring_queue_exit((struct io_uring *)fw->ring);
+        free(fw->ring);
+    }
+#endif
+    if (close(fw->fd) != 0)
+        status = -1;
+    memset(fw, 0, sizeof(*fw));
+    fw->fd = -1;
+    return status;
+}
@@ -0,0 +1,81 @@
+/****************************************************************************
+ *
+ * filewriter.h - Positional writes through io_uring or pwrite()
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * When compiled with -DHAVE_LIBURING (the Makefile does it if
+ * liburing is installed), writes are queued on an io_uring and
+ * submitted together by file_writer_flush(); otherwise, or if the
+ * kernel refuses to create the ring, each write is a pwrite().
+ *
+ * The data passed to file_writer_write() must stay valid until the
+ * next call to file_writer_flush().
+ *
+ ****************************************************************************/
+
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FILE_WRITER_QUEUE 16
+
+typedef struct
+{
+    const void *data;
+    size_t len;
+    uint64_t offset;
+} file_write_t;
+
+typedef struct
+{
+    int fd;
+    const char *path;
+    int uring;                        /* nonzero if the io_uring is in use */
+    void *ring;                       /* struct io_uring, if any */
+    file_write_t queue[FILE_WRITER_QUEUE]; /* writes not yet submitted */
+    int nqueued;
+    int failed;                       /* nonzero after a write error */
+} file_writer_t;
+
+/**
+ * Create (or truncate) the file `path`. Returns 0 on success, -1 on
+ * failure (a message is printed on stderr).
+ */
+int file_writer_open(file_writer_t *fw, const char *path);
+
+/**
+ * Write `len` bytes from `data` at file offset `offset`. The write
+ * may be deferred until the next file_writer_flush(). Returns 0 on
+ * success, -1 on failure.
+ */
+int file_writer_write(file_writer_t *fw, const void *data, size_t len, uint64_t offset);
+
+/**
+ * Wait until all the writes issued so far are complete. Returns 0 on
+ * success, -1 if any of them failed.
+ */
+int file_writer_flush(file_writer_t *fw);
+
+/**
+ * Flush and close the file. Returns 0 on success, -1 on failure.
+ */
+int file_writer_close(file_writer_t *fw);
+
+#endif
@@ -0,0 +1,87 @@
+/****************************************************************************
+ *
+ * gencircles.c - Write a synthetic initial configuration of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***
+% Synthetic workloads
+% Alessandro Monticelli
+
+Writes `N` circles placed according to one of the scenarios of
+`workload.c` (clusters, lattice, bimodal or power-law radii, all the
+circles at one point, sparse domain, ...) to a binary snapshot, which
+the programs read with `--input`. The same scenario, number of
+circles and seed always give the same file.
+
+To compile:
+
+        gcc -std=c99 -Wall -Wpedantic gencircles.c workload.c snapshot.c -o gencircles -lm
+
+To execute:
+
+        ./gencircles [--seed S] SCENARIO N FILE
+
+for example
+
+        ./gencircles --seed 7 clusters 10000 clusters.snap
+        ./omp-circles --input clusters.snap 100
+
+Run `./gencircles` without arguments for the list of the scenarios.
+
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "workload.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--seed S] SCENARIO N FILE\n\nScenarios:\n", prog);
+    workload_list(stderr);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long long seed = 1;
+    int first = 1;
+
+    if (argc > 2 && strcmp(argv[1], "--seed") == 0)
+    {
+        seed = strtoull(argv[2], NULL, 10);
+        first = 3;
+    }
+    if (argc - first != 3)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *scenario = argv[first];
+    const long long n = atoll(argv[first + 1]);
+    const char *path = argv[first + 2];
+    if (!workload_valid(scenario) || n < 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (workload_save(path, scenario, (uint64_t)n, seed) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -25,6 +25,11 @@
  * framework (OpenMP or MPI), if enabled; otherwise, the default is to
  * use the clock_gettime() function.
  *
+ * When HPC_TIMERS is defined, it also provides timers of named
+ * regions (see HPC_TIMER_BEGIN() below); otherwise the timer macros
+ * expand to nothing. When HPC_COUNTERS is defined, the regions also
+ * count hardware events on Linux.
+ *
  * IMPORTANT NOTE: to work reliably this header file must be the FIRST
  * header file that appears in your code.
  *
@@ -33,6 +38,16 @@
 #ifndef HPC_H
 #define HPC_H
 
+#if defined(HPC_COUNTERS)
+#ifndef HPC_TIMERS
+#define HPC_TIMERS
+#endif
+/* syscall() is not part of POSIX */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#endif
+
 #if defined(_OPENMP)
 #include <omp.h>
 /******************************************************************************
@@ -69,6 +84,541 @@ double hpc_gettime( void )
 }
 #endif
 
+/******************************************************************************
+ * Timers of named regions
+ *
+ *     HPC_TIMER_BEGIN("forces");
+ *     ...
+ *     HPC_TIMER_END("forces");
+ *
+ * accumulate the time spent between the two calls, and the number of
+ * calls, into the region "forces". Regions nest: a region begun
+ * while another one is open is a child of the open one, so the same
+ * name may appear under different parents. Each thread accumulates
+ * into its own counters; inside an OpenMP parallel region a thread
+ * that has no open region is placed under the region that was open
+ * when the parallel region started. HPC_TIMER_REPORT(title) prints the
+ * tree of the regions to stderr, with the number of calls, the
+ * number of threads, the time (the maximum over the threads), the
+ * mean time per call and the share of the parent region.
+ *
+ * Time is measured with the time-stamp counter on x86 processors
+ * (calibrated against hpc_gettime()) and with hpc_gettime()
+ * elsewhere. Regions must be static strings, and should not be too
+ * short (at least a few microseconds) to be measured accurately.
+ *
+ * HPC_TIMER_ITEMS(n) adds `n` work items (e.g. pairs of circles
+ * tested) to the innermost region open on the calling thread; the
+ * report then also shows the items and the time per item.
+ *
+ * When HPC_COUNTERS is defined (which implies HPC_TIMERS), each
+ * thread also opens a group of hardware counters with
+ * perf_event_open() (cycles, instructions, L1 data cache read misses,
+ * last-level cache misses, branch mispredictions), reads them when a
+ * region begins and ends, and the report adds a second table with the
+ * counts summed over the threads and the derived metrics: IPC, misses
+ * per item and bytes per item (LLC misses times the size of a cache
+ * line). If the counters are not permitted (see
+ * /proc/sys/kernel/perf_event_paranoid) or not supported, a note is
+ * printed once and only the times are measured; counters that are
+ * missing alone (common in virtual machines) are shown as "-".
+ *
+ * Load imbalance: HPC_TIMER_BARRIER(name), inside an OpenMP parallel
+ * region, times an explicit barrier as region `name`, i.e. the time
+ * each thread waits for the slowest one. HPC_TIMER_IMBALANCE(busy,
+ * idle) prints, for each thread, the time spent in the regions named
+ * `busy` and `idle` and the work items of `busy`, followed by the
+ * max/mean ratio of busy time and of work and the share of the time
+ * lost to the imbalance, 1 - mean/max (the time that the threads,
+ * waiting for the slowest one, do not work). hpc_imbalance_print()
+ * prints the same table for values collected elsewhere, e.g. from
+ * the MPI processes.
+ *
+ * The timers are compiled only when HPC_TIMERS is defined.
+ ******************************************************************************/
+#ifdef HPC_TIMERS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef HPC_COUNTERS
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define HPC_TIMER_MAX_REGIONS 64
+#define HPC_TIMER_MAX_THREADS 64
+#define HPC_TIMER_MAX_DEPTH 16
+
+typedef struct {
+    const char *name;
+    int parent;                 /* -1 for the top-level regions */
+} hpc_timer_region_t;
+
+#ifdef HPC_COUNTERS
+enum { HPC_CYCLES, HPC_INSTRUCTIONS, HPC_L1D_MISSES, HPC_LLC_MISSES,
+       HPC_BRANCH_MISSES, HPC_NCOUNTERS };
+#define HPC_CACHE_LINE 64
+#endif
+
+typedef struct {
+    uint64_t calls[HPC_TIMER_MAX_REGIONS];
+    uint64_t ticks[HPC_TIMER_MAX_REGIONS];
+    uint64_t items[HPC_TIMER_MAX_REGIONS];
+    int stack[HPC_TIMER_MAX_DEPTH];
+    uint64_t start[HPC_TIMER_MAX_DEPTH];
+    int depth;
+#ifdef HPC_COUNTERS
+    int perf_state;             /* 0 not opened yet, 1 open, -1 unavailable */
+    int perf_fd;                /* group leader */
+    int perf_slot[HPC_NCOUNTERS]; /* position in the group, -1 if missing */
+    uint64_t perf_start[HPC_TIMER_MAX_DEPTH][HPC_NCOUNTERS];
+    uint64_t perf_count[HPC_TIMER_MAX_REGIONS][HPC_NCOUNTERS];
+#endif
+    char pad[64];               /* keep the threads apart */
+} hpc_timer_thread_t;
+
+hpc_timer_region_t hpc_timer_regions[HPC_TIMER_MAX_REGIONS];
+int hpc_timer_nregions = 0;
+hpc_timer_thread_t hpc_timer_threads[HPC_TIMER_MAX_THREADS];
+/* region open on the master thread outside parallel regions */
+int hpc_timer_fork = -1;
+uint64_t hpc_timer_tick0;
+double hpc_timer_time0;
+#ifdef HPC_COUNTERS
+/* nonzero if counter i was available on at least one thread */
+int hpc_counter_available[HPC_NCOUNTERS];
+int hpc_counter_warned = 0;
+#endif
+
+uint64_t hpc_timer_ticks( void )
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return (uint64_t)(hpc_gettime() * 1e9);
+#endif
+}
+
+int hpc_timer_thread( void )
+{
+#if defined(_OPENMP)
+    const int t = omp_get_thread_num();
+    return t < HPC_TIMER_MAX_THREADS ? t : HPC_TIMER_MAX_THREADS - 1;
+#else
+    return 0;
+#endif
+}
+
+int hpc_timer_in_parallel( void )
+{
+#if defined(_OPENMP)
+    return omp_in_parallel();
+#else
+    return 0;
+#endif
+}
+
+#ifdef HPC_COUNTERS
+/**
+ * Open the counters of the calling thread, as one group so that they
+ * all count over the same intervals.
+ */
+void hpc_counters_open( hpc_timer_thread_t *t )
+{
+    static const struct { uint32_t type; uint64_t config; } events[HPC_NCOUNTERS] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+    };
+    int n = 0;
+    t->perf_fd = -1;
+    for (int e=0; e<HPC_NCOUNTERS; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[e].type;
+        attr.config = events[e].config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        /* the calling thread, on any CPU */
+        const int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, t->perf_fd, 0);
+        t->perf_slot[e] = -1;
+        if (fd < 0) {
+            if (e == 0) {
+#if defined(_OPENMP)
+#pragma omp critical(hpc_timer)
+#endif
+                if (!hpc_counter_warned) {
+                    fprintf(stderr, "hpc_timer: hardware counters not available (%s), "
+                            "measuring times only\n", strerror(errno));
+                    hpc_counter_warned = 1;
+                }
+                t->perf_state = -1;
+                return;
+            }
+            continue;
+        }
+        if (e == 0)
+            t->perf_fd = fd;
+        t->perf_slot[e] = n++;
+        __atomic_store_n(&hpc_counter_available[e], 1, __ATOMIC_RELAXED);
+    }
+    t->perf_state = 1;
+}
+
+/**
+ * Read the counters of the calling thread into `v`.
+ */
+void hpc_counters_read( hpc_timer_thread_t *t, uint64_t *v )
+{
+    uint64_t buf[1 + HPC_NCOUNTERS];
+    if (t->perf_state <= 0 || read(t->perf_fd, buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t)) {
+        memset(v, 0, HPC_NCOUNTERS * sizeof(*v));
+        return;
+    }
+    for (int e=0; e<HPC_NCOUNTERS; e++) {
+        v[e] = (t->perf_slot[e] >= 0) ? buf[1 + t->perf_slot[e]] : 0;
+    }
+}
+#endif
+
+/**
+ * Return the index of region `name` under `parent`, creating it if
+ * needed.
+ */
+int hpc_timer_region( const char *name, int parent )
+{
+    int n = __atomic_load_n(&hpc_timer_nregions, __ATOMIC_ACQUIRE);
+    for (int i=0; i<n; i++) {
+        if (hpc_timer_regions[i].parent == parent &&
+            (hpc_timer_regions[i].name == name || strcmp(hpc_timer_regions[i].name, name) == 0))
+            return i;
+    }
+    int found = -1;
+#if defined(_OPENMP)
+#pragma omp critical(hpc_timer)
+#endif
+    {
+        /* another thread may have created it meanwhile */
+        n = hpc_timer_nregions;
+        for (int i=0; i<n && found < 0; i++) {
+            if (hpc_timer_regions[i].parent == parent &&
+                strcmp(hpc_timer_regions[i].name, name) == 0)
+                found = i;
+        }
+        if (found < 0 && n < HPC_TIMER_MAX_REGIONS) {
+            if (n == 0) {
+                hpc_timer_time0 = hpc_gettime();
+                hpc_timer_tick0 = hpc_timer_ticks();
+            }
+            hpc_timer_regions[n].name = name;
+            hpc_timer_regions[n].parent = parent;
+            __atomic_store_n(&hpc_timer_nregions, n + 1, __ATOMIC_RELEASE);
+            found = n;
+        }
+    }
+    if (found < 0) {
+        fprintf(stderr, "hpc_timer: too many regions (%s)\n", name);
+        abort();
+    }
+    return found;
+}
+
+void hpc_timer_begin( const char *name )
+{
+    const int in_parallel = hpc_timer_in_parallel();
+    hpc_timer_thread_t *t = &hpc_timer_threads[hpc_timer_thread()];
+    if (t->depth == HPC_TIMER_MAX_DEPTH) {
+        fprintf(stderr, "hpc_timer: regions nested too deeply (%s)\n", name);
+        abort();
+    }
+    int parent = -1;
+    if (t->depth > 0)
+        parent = t->stack[t->depth - 1];
+    else if (in_parallel)
+        parent = hpc_timer_fork;
+    const int r = hpc_timer_region(name, parent);
+    t->stack[t->depth] = r;
+    if (!in_parallel)
+        hpc_timer_fork = r;
+#ifdef HPC_COUNTERS
+    if (t->perf_state == 0)
+        hpc_counters_open(t);
+    hpc_counters_read(t, t->perf_start[t->depth]);
+#endif
+    t->start[t->depth++] = hpc_timer_ticks();
+}
+
+void hpc_timer_end( const char *name )
+{
+    const uint64_t now = hpc_timer_ticks();
+    hpc_timer_thread_t *t = &hpc_timer_threads[hpc_timer_thread()];
+#ifdef HPC_COUNTERS
+    uint64_t counters[HPC_NCOUNTERS];
+    hpc_counters_read(t, counters);
+#endif
+    if (t->depth == 0 || strcmp(hpc_timer_regions[t->stack[t->depth - 1]].name, name) != 0) {
+        fprintf(stderr, "hpc_timer: region %s ended but not open\n", name);
+        abort();
+    }
+    const int r = t->stack[--t->depth];
+    t->calls[r]++;
+    t->ticks[r] += now - t->start[t->depth];
+#ifdef HPC_COUNTERS
+    for (int e=0; e<HPC_NCOUNTERS; e++) {
+        t->perf_count[r][e] += counters[e] - t->perf_start[t->depth][e];
+    }
+#endif
+    if (!hpc_timer_in_parallel())
+        hpc_timer_fork = (t->depth > 0) ? t->stack[t->depth - 1] : -1;
+}
+
+void hpc_timer_items( uint64_t n )
+{
+    hpc_timer_thread_t *t = &hpc_timer_threads[hpc_timer_thread()];
+    if (t->depth > 0)
+        t->items[t->stack[t->depth - 1]] += n;
+}
+
+/**
+ * Print region `r` and, below it, its children.
+ */
+void hpc_timer_report_region( FILE *out, int r, int depth, double sec_per_tick, double parent_time )
+{
+    uint64_t calls = 0, ticks = 0, sum = 0, items = 0;
+    int nthreads = 0;
+    for (int t=0; t<HPC_TIMER_MAX_THREADS; t++) {
+        if (hpc_timer_threads[t].calls[r] > 0) {
+            calls += hpc_timer_threads[t].calls[r];
+            sum += hpc_timer_threads[t].ticks[r];
+            items += hpc_timer_threads[t].items[r];
+            if (hpc_timer_threads[t].ticks[r] > ticks)
+                ticks = hpc_timer_threads[t].ticks[r];
+            nthreads++;
+        }
+    }
+    const double time = ticks * sec_per_tick;
+    char label[64];
+    snprintf(label, sizeof(label), "%*s%s", 2*depth, "", hpc_timer_regions[r].name);
+    fprintf(out, "%-28s %10llu %7d %12.6f %12.3f %8.1f",
+            label, (unsigned long long)calls, nthreads, time,
+            calls ? 1e6 * sum * sec_per_tick / calls : 0.0,
+            parent_time > 0 ? 100.0 * time / parent_time : 0.0);
+    if (items > 0)
+        fprintf(out, " %14llu %10.3f\n", (unsigned long long)items, 1e9 * sum * sec_per_tick / items);
+    else
+        fprintf(out, "\n");
+    for (int c=0; c<hpc_timer_nregions; c++) {
+        if (hpc_timer_regions[c].parent == r)
+            hpc_timer_report_region(out, c, depth + 1, sec_per_tick, time);
+    }
+}
+
+#ifdef HPC_COUNTERS
+/**
+ * Print the value `v` of counter `e`, or "-" if it is missing.
+ */
+void hpc_counters_print( FILE *out, int e, double v, const char *fmt )
+{
+    if (hpc_counter_available[e])
+        fprintf(out, fmt, v);
+    else
+        fprintf(out, " %10s", "-");
+}
+
+/**
+ * Print the counters of each region, summed over the threads, in the
+ * order of the tree.
+ */
+void hpc_counters_report_region( FILE *out, int r, int depth )
+{
+    uint64_t c[HPC_NCOUNTERS] = {0}, items = 0;
+    for (int t=0; t<HPC_TIMER_MAX_THREADS; t++) {
+        for (int e=0; e<HPC_NCOUNTERS; e++) {
+            c[e] += hpc_timer_threads[t].perf_count[r][e];
+        }
+        items += hpc_timer_threads[t].items[r];
+    }
+    char label[64];
+    snprintf(label, sizeof(label), "%*s%s", 2*depth, "", hpc_timer_regions[r].name);
+    fprintf(out, "%-28s %12.4e", label, (double)c[HPC_CYCLES]);
+    hpc_counters_print(out, HPC_INSTRUCTIONS,
+                       c[HPC_CYCLES] ? (double)c[HPC_INSTRUCTIONS] / c[HPC_CYCLES] : 0.0, " %10.3f");
+    hpc_counters_print(out, HPC_L1D_MISSES, (double)c[HPC_L1D_MISSES], " %10.3e");
+    hpc_counters_print(out, HPC_LLC_MISSES, (double)c[HPC_LLC_MISSES], " %10.3e");
+    hpc_counters_print(out, HPC_BRANCH_MISSES, (double)c[HPC_BRANCH_MISSES], " %10.3e");
+    if (items > 0) {
+        hpc_counters_print(out, HPC_L1D_MISSES, (double)c[HPC_L1D_MISSES] / items, " %10.4f");
+        hpc_counters_print(out, HPC_LLC_MISSES, (double)c[HPC_LLC_MISSES] / items, " %10.4f");
+        hpc_counters_print(out, HPC_LLC_MISSES,
+                           (double)c[HPC_LLC_MISSES] * HPC_CACHE_LINE / items, " %10.4f");
+    }
+    fprintf(out, "\n");
+    for (int k=0; k<hpc_timer_nregions; k++) {
+        if (hpc_timer_regions[k].parent == r)
+            hpc_counters_report_region(out, k, depth + 1);
+    }
+}
+
+void hpc_counters_report( FILE *out )
+{
+    fprintf(out, "%-28s %12s %10s %10s %10s %10s %10s %10s %10s\n",
+            "Region", "Cycles", "IPC", "L1D miss", "LLC miss", "Br miss",
+            "L1D/item", "LLC/item", "B/item");
+    for (int r=0; r<hpc_timer_nregions; r++) {
+        if (hpc_timer_regions[r].parent < 0)
+            hpc_counters_report_region(out, r, 0);
+    }
+}
+#endif
+
+double hpc_timer_sec_per_tick( void )
+{
+    const double elapsed = hpc_gettime() - hpc_timer_time0;
+    const uint64_t ticks = hpc_timer_ticks() - hpc_timer_tick0;
+    return ticks > 0 ? elapsed / ticks : 0.0;
+}
+
+/**
+ * Return the time spent by `thread` in all the regions named `name`
+ * (wherever they are in the tree) and their work items.
+ */
+double hpc_timer_total( const char *name, int thread, uint64_t *items )
+{
+    uint64_t ticks = 0, n = 0;
+    const hpc_timer_thread_t *t = &hpc_timer_threads[thread];
+    for (int r=0; r<hpc_timer_nregions; r++) {
+        if (strcmp(hpc_timer_regions[r].name, name) == 0) {
+            ticks += t->ticks[r];
+            n += t->items[r];
+        }
+    }
+    if (items)
+        *items = n;
+    return ticks * hpc_timer_sec_per_tick();
+}
+
+/**
+ * Print the busy time, idle time and work of the `n` units (threads
+ * or processes, as told by `unit`) that executed phase `phase`, and
+ * the imbalance; `idle` and `work` may be NULL.
+ */
+void hpc_imbalance_print( FILE *out, const char *phase, const char *unit, int n,
+                          const double *busy, const double *idle, const double *work )
+{
+    double max_busy = 0, sum_busy = 0, max_work = 0, sum_work = 0;
+    fprintf(out, "Load balance of %s (%d %ss)\n", phase, n, unit);
+    fprintf(out, "  %8s %12s %12s %16s\n", unit, "Busy (s)", "Idle (s)", "Work");
+    for (int i=0; i<n; i++) {
+        fprintf(out, "  %8d %12.6f", i, busy[i]);
+        if (idle)
+            fprintf(out, " %12.6f", idle[i]);
+        else
+            fprintf(out, " %12s", "-");
+        if (work)
+            fprintf(out, " %16.0f\n", work[i]);
+        else
+            fprintf(out, " %16s\n", "-");
+        sum_busy += busy[i];
+        if (busy[i] > max_busy)
+            max_busy = busy[i];
+        if (work) {
+            sum_work += work[i];
+            if (work[i] > max_work)
+                max_work = work[i];
+        }
+    }
+    if (n == 0)
+        return;
+    const double mean_busy = sum_busy / n;
+    fprintf(out, "  busy time: max %.6f s, mean %.6f s, max/mean %.3f, %.1f%% of the time lost to imbalance\n",
+            max_busy, mean_busy, mean_busy > 0 ? max_busy / mean_busy : 1.0,
+            max_busy > 0 ? 100.0 * (1.0 - mean_busy / max_busy) : 0.0);
+    if (work && sum_work > 0)
+        fprintf(out, "  work: max %.0f, mean %.0f, max/mean %.3f\n",
+                max_work, sum_work / n, max_work * n / sum_work);
+}
+
+/**
+ * Print the imbalance among the threads of this process in the
+ * regions named `busy`, with the waiting time of the regions named
+ * `idle`.
+ */
+void hpc_timer_imbalance( FILE *out, const char *busy, const char *idle )
+{
+    double b[HPC_TIMER_MAX_THREADS], w[HPC_TIMER_MAX_THREADS], i[HPC_TIMER_MAX_THREADS];
+    int n = 0;
+    for (int t=0; t<HPC_TIMER_MAX_THREADS; t++) {
+        uint64_t items;
+        b[t] = hpc_timer_total(busy, t, &items);
+        w[t] = (double)items;
+        i[t] = hpc_timer_total(idle, t, NULL);
+        if (b[t] > 0)
+            n = t + 1;
+    }
+    if (n == 0)
+        return;
+    hpc_imbalance_print(out, busy, "thread", n, b, i, w);
+    fflush(out);
+}
+
+/**
+ * Print the tree of the regions timed so far, under the heading
+ * `title` (which may be NULL).
+ */
+void hpc_timer_report( FILE *out, const char *title )
+{
+    if (hpc_timer_nregions == 0)
+        return;
+    const double elapsed = hpc_gettime() - hpc_timer_time0;
+    const double sec_per_tick = hpc_timer_sec_per_tick();
+    if (title)
+        fprintf(out, "%s\n", title);
+    fprintf(out, "%-28s %10s %7s %12s %12s %8s %14s %10s\n",
+            "Region", "Calls", "Threads", "Time (s)", "Mean (us)", "% parent",
+            "Items", "ns/item");
+    for (int r=0; r<hpc_timer_nregions; r++) {
+        if (hpc_timer_regions[r].parent < 0)
+            hpc_timer_report_region(out, r, 0, sec_per_tick, elapsed);
+    }
+#ifdef HPC_COUNTERS
+    if (hpc_counter_available[HPC_CYCLES])
+        hpc_counters_report(out);
+#endif
+    fflush(out);
+}
+
+#define HPC_TIMER_BEGIN(name) hpc_timer_begin(name)
+#define HPC_TIMER_END(name) hpc_timer_end(name)
+#define HPC_TIMER_ITEMS(n) hpc_timer_items(n)
+#define HPC_TIMER_REPORT(title) hpc_timer_report(stderr, title)
+#define HPC_TIMER_IMBALANCE(busy, idle) hpc_timer_imbalance(stderr, busy, idle)
+#if defined(_OPENMP)
+#define HPC_TIMER_BARRIER(name) do { hpc_timer_begin(name); _Pragma("omp barrier") hpc_timer_end(name); } while (0)
+#else
+#define HPC_TIMER_BARRIER(name) ((void)0)
+#endif
+
+#else
+
+#define HPC_TIMER_BEGIN(name) ((void)0)
+#define HPC_TIMER_END(name) ((void)0)
+#define HPC_TIMER_ITEMS(n) ((void)0)
+#define HPC_TIMER_REPORT(title) ((void)0)
+#define HPC_TIMER_IMBALANCE(busy, idle) ((void)0)
+#define HPC_TIMER_BARRIER(name) ((void)0)
+
+#endif
+
 #ifdef __CUDACC__
 
 #include <stdio.h>
@@ -0,0 +1,145 @@
+/****************************************************************************
+ *
+ * latency.c - Histogram of the duration of the iterations
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "latency.h"
+
+/* position of the most significant bit of v > 0 */
+static int msb(uint64_t v)
+{
+    int b = 0;
+    while (v >>= 1)
+        b++;
+    return b;
+}
+
+/**
+ * Bucket of `v`: values below 2 * LATENCY_SUB_BUCKETS have a bucket
+ * each; above, a value with e more bits is counted in steps of 2^e.
+ */
+static int bucket_of(uint64_t v)
+{
+    const int e = (v < 2 * LATENCY_SUB_BUCKETS) ? 0 : msb(v) - LATENCY_SUB_BITS;
+    return e * LATENCY_SUB_BUCKETS + (int)(v >> e);
+}
+
+/* largest value counted in bucket `b` */
+static uint64_t bucket_top(int b)
+{
+    if (b < 2 * LATENCY_SUB_BUCKETS)
+        return (uint64_t)b;
+    const int e = b / LATENCY_SUB_BUCKETS - 1;
+    const uint64_t sub = (uint64_t)(b - e * LATENCY_SUB_BUCKETS);
+    return (sub << e) + ((uint64_t)1 << e) - 1;
+}
+
+int latency_init(latency_t *l, int iterations)
+{
+    memset(l, 0, sizeof(*l));
+    l->min = UINT64_MAX;
+    l->iterations = iterations;
+    l->iteration = (uint64_t *)calloc(iterations > 0 ? iterations : 1, sizeof(*l->iteration));
+    return l->iteration != NULL ? 0 : -1;
+}
+
+void latency_record_ns(latency_t *l, int it, uint64_t ns)
+{
+    l->counts[bucket_of(ns)]++;
+    l->n++;
+    if (ns < l->min)
+        l->min = ns;
+    if (ns > l->max)
+        l->max = ns;
+    if (it >= 0 && it < l->iterations)
+        l->iteration[it] = ns;
+}
+
+void latency_record(latency_t *l, int it, double seconds)
+{
+    latency_record_ns(l, it, seconds > 0 ? (uint64_t)(seconds * 1e9 + 0.5) : 0);
+}
+
+uint64_t latency_percentile(const latency_t *l, double pct)
+{
+    if (l->n == 0)
+        return 0;
+    if (pct >= 100)
+        return l->max;
+    /* the smallest bucket that reaches ceil(pct% of the values) */
+    uint64_t rank = (uint64_t)(pct / 100 * l->n + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        seen += l->counts[b];
+        if (seen >= rank)
+        {
+            const uint64_t top = bucket_top(b);
+            return top < l->max ? top : l->max;
+        }
+    }
+    return l->max;
+}
+
+void latency_print(FILE *out, const latency_t *l)
+{
+    if (l->n == 0)
+        return;
+    const uint64_t p50 = latency_percentile(l, 50);
+    fprintf(out, "Iteration latency: p50 %f s, p90 %f s, p99 %f s, max %f s\n",
+            p50 * 1e-9, latency_percentile(l, 90) * 1e-9,
+            latency_percentile(l, 99) * 1e-9, l->max * 1e-9);
+    /* selection of the slowest iterations above 2 * p50, by repeated
+       scans: there are at most LATENCY_OUTLIERS of them */
+    int chosen[LATENCY_OUTLIERS], nchosen = 0;
+    uint64_t bound = UINT64_MAX;
+    int bound_it = -1;
+    while (nchosen < LATENCY_OUTLIERS)
+    {
+        int worst = -1;
+        for (int it = 0; it < l->iterations; it++)
+        {
+            const uint64_t v = l->iteration[it];
+            /* below the previous one, ties broken by index */
+            const int below = (v < bound) || (v == bound && it > bound_it);
+            if (v > 2 * p50 && below && (worst < 0 || v > l->iteration[worst]))
+                worst = it;
+        }
+        if (worst < 0)
+            break;
+        chosen[nchosen++] = worst;
+        bound = l->iteration[worst];
+        bound_it = worst;
+    }
+    fprintf(out, "Slowest iterations (over 2 x p50):");
+    if (nchosen == 0)
+        fprintf(out, " none");
+    for (int k = 0; k < nchosen; k++)
+        fprintf(out, "%s %d (%f s)", k ? "," : "", chosen[k] + 1, l->iteration[chosen[k]] * 1e-9);
+    fprintf(out, "\n");
+}
+
+void latency_free(latency_t *l)
+{
+    free(l->iteration);
+    l->iteration = NULL;
+}
@@ -0,0 +1,83 @@
+/****************************************************************************
+ *
+ * latency.h - Histogram of the duration of the iterations
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * The duration of each iteration (in nanoseconds) is counted into a
+ * histogram whose buckets grow with the value, as in HdrHistogram:
+ * the values in [2^k, 2^(k+1)) are split into LATENCY_SUB_BUCKETS
+ * equal buckets, so that every value is known within 1 /
+ * LATENCY_SUB_BUCKETS of itself (about 3%) over the whole range, with
+ * a fixed, small table. The percentiles are read from the histogram;
+ * the duration of each iteration is also kept, so that the slowest
+ * iterations can be named.
+ *
+ ****************************************************************************/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define LATENCY_SUB_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS (64 * LATENCY_SUB_BUCKETS)
+#define LATENCY_OUTLIERS 10 /* slowest iterations printed */
+
+typedef struct
+{
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t n;          /* values counted */
+    uint64_t min, max;   /* exact extremes */
+    uint64_t *iteration; /* [iterations] duration of each iteration, ns */
+    int iterations;
+} latency_t;
+
+/**
+ * Prepare `l` for `iterations` iterations; returns 0 on success, -1
+ * if out of memory.
+ */
+int latency_init(latency_t *l, int iterations);
+
+/**
+ * Record that iteration `it` (0-based) took `ns` nanoseconds.
+ */
+void latency_record_ns(latency_t *l, int it, uint64_t ns);
+
+/**
+ * Record that iteration `it` (0-based) took `seconds` seconds.
+ */
+void latency_record(latency_t *l, int it, double seconds);
+
+/**
+ * Value (in nanoseconds) below which `pct` percent of the recorded
+ * values lie, as the upper end of its bucket; the exact maximum for
+ * pct = 100.
+ */
+uint64_t latency_percentile(const latency_t *l, double pct);
+
+/**
+ * Print p50, p90, p99 and the maximum, and the iterations that took
+ * more than twice the median (the slowest LATENCY_OUTLIERS of them).
+ */
+void latency_print(FILE *out, const latency_t *l);
+
+void latency_free(latency_t *l);
+
+#endif
@@ -0,0 +1,405 @@
+/****************************************************************************
+ *
+ * libcircles.c - Simulation core shared by the circles programs
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <limits.h>
+#include <omp.h>
+#include "libcircles.h"
+#include "textimport.h"
+#include "memtrack.h"
+#include "trace.h"
+
+/* defined in engines.c, terminated by NULL */
+extern const circles_engine_t *const circles_engines[];
+
+void circles_init(circles_t *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->xmin = CIRCLES_XMIN;
+    c->xmax = CIRCLES_XMAX;
+    c->ymin = CIRCLES_YMIN;
+    c->ymax = CIRCLES_YMAX;
+    c->k = CIRCLES_K;
+    c->epsilon = CIRCLES_EPSILON;
+    c->seed = 1;
+    c->engine = circles_engines[0];
+}
+
+/**
+ * Use the `n` records `r` as the circles of `c`.
+ */
+static void use_records(circles_t *c, circle_t *r, int n)
+{
+    const circle_view_t v = {&r[0].x, &r[0].y, &r[0].r, sizeof(circle_t)};
+    c->n = n;
+    c->records = r;
+    c->pos = v;
+    c->dx = &r[0].dx;
+    c->dy = &r[0].dy;
+    c->dstride = sizeof(circle_t);
+    c->start = 0;
+    c->end = n;
+}
+
+int circles_alloc(circles_t *c, int n)
+{
+    circle_t *r = (circle_t *)mem_calloc(MEM_CIRCLES, n, sizeof(*r));
+    if (r == NULL)
+    {
+        fprintf(stderr, "Cannot allocate %d circles\n", n);
+        return -1;
+    }
+    use_records(c, r, n);
+    return 0;
+}
+
+int circles_wrap(circles_t *c, int n, const circle_view_t *pos,
+                 float *dx, float *dy, size_t dstride)
+{
+    circles_free(c);
+    if (dx == NULL)
+    {
+        c->scratch = (float *)mem_calloc(MEM_CIRCLES, 2 * (size_t)n, sizeof(float));
+        if (c->scratch == NULL)
+        {
+            fprintf(stderr, "Cannot allocate the displacements of %d circles\n", n);
+            return -1;
+        }
+        dx = c->scratch;
+        dy = c->scratch + n;
+        dstride = sizeof(float);
+    }
+    c->n = n;
+    c->pos = *pos;
+    c->dx = dx;
+    c->dy = dy;
+    c->dstride = dstride;
+    c->records = NULL;
+    c->start = 0;
+    c->end = n;
+    return 0;
+}
+
+/**
+ * Return a random float in [a, b]
+ */
+static float randab(float a, float b)
+{
+    return a + (((float)rand()) / RAND_MAX) * (b - a);
+}
+
+int circles_random(circles_t *c, int n, unsigned seed)
+{
+    if (circles_alloc(c, n) != 0)
+    {
+        return -1;
+    }
+    c->seed = seed;
+    srand(seed);
+    for (int i = 0; i < n; i++)
+    {
+        c->records[i].x = randab(c->xmin, c->xmax);
+        c->records[i].y = randab(c->ymin, c->ymax);
+        c->records[i].r = randab(CIRCLES_RMIN, CIRCLES_RMAX);
+    }
+    return 0;
+}
+
+/**
+ * Parse the text file `path`, with one "x y r" line per circle.
+ */
+static int import_circles(circles_t *c, const char *path)
+{
+    text_import_t ti;
+    if (text_import_open(&ti, path) != 0)
+    {
+        return -1;
+    }
+    int status = -1;
+    if (ti.ncircles > INT_MAX)
+    {
+        fprintf(stderr, "%s: too many circles\n", path);
+    }
+    else if (circles_alloc(c, (int)ti.ncircles) == 0)
+    {
+        status = text_import_read(&ti, &c->pos);
+    }
+    text_import_close(&ti);
+    return status;
+}
+
+/**
+ * Load the binary snapshot `path`. If it stores circle_t records, the
+ * (private) memory mapping of the file is used without copying
+ * anything; otherwise the coordinates are copied into new records.
+ */
+static int map_circles(circles_t *c, const char *path)
+{
+    if (snapshot_open(&c->snap, path) != 0)
+    {
+        return -1;
+    }
+    const uint64_t n = c->snap.header.ncircles;
+    if (n > INT_MAX)
+    {
+        fprintf(stderr, "%s: too many circles\n", path);
+        snapshot_close(&c->snap);
+        return -1;
+    }
+    c->seed = c->snap.header.seed;
+    c->iter0 = c->snap.header.iteration;
+    /* the domain of the workload (e.g. the sparse one of gencircles) is
+       kept for the images, the trajectory and the output snapshot */
+    c->xmin = c->snap.header.xmin;
+    c->xmax = c->snap.header.xmax;
+    c->ymin = c->snap.header.ymin;
+    c->ymax = c->snap.header.ymax;
+    circle_t *r = (circle_t *)snapshot_adopt(&c->snap, sizeof(circle_t),
+                                             offsetof(circle_t, x),
+                                             offsetof(circle_t, y),
+                                             offsetof(circle_t, r));
+    if (r != NULL)
+    {
+        mem_account(MEM_CIRCLES, (int64_t)(n * sizeof(*r)));
+        use_records(c, r, (int)n);
+        return 0;
+    }
+    const int status = circles_alloc(c, (int)n);
+    if (status == 0)
+    {
+        snapshot_read(&c->snap, &c->pos);
+    }
+    snapshot_close(&c->snap);
+    return status;
+}
+
+int circles_load(circles_t *c, const char *path)
+{
+    const int status = snapshot_probe(path) ? map_circles(c, path) : import_circles(c, path);
+    if (status != 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < c->n; i++)
+    {
+        CIRCLES_DX(c, i) = CIRCLES_DY(c, i) = 0.0;
+    }
+    return 0;
+}
+
+int circles_count(const char *path)
+{
+    uint64_t n;
+    if (snapshot_probe(path))
+    {
+        snapshot_t s;
+        if (snapshot_open(&s, path) != 0)
+        {
+            return -1;
+        }
+        n = s.header.ncircles;
+        snapshot_close(&s);
+    }
+    else
+    {
+        text_import_t ti;
+        if (text_import_open(&ti, path) != 0)
+        {
+            return -1;
+        }
+        n = ti.ncircles;
+        text_import_close(&ti);
+    }
+    if (n > INT_MAX)
+    {
+        fprintf(stderr, "%s: too many circles\n", path);
+        return -1;
+    }
+    return (int)n;
+}
+
+uint64_t circles_footprint(uint64_t n)
+{
+    return n * sizeof(circle_t);
+}
+
+int circles_save(const circles_t *c, const char *path, int iterno)
+{
+    snapshot_header_t hdr;
+    snapshot_header_init(&hdr, c->n, c->xmin, c->xmax, c->ymin, c->ymax);
+    hdr.seed = c->seed;
+    hdr.iteration = c->iter0 + iterno;
+    /* records are saved as they are, so that they can be mapped back */
+    return snapshot_save(path, &hdr, &c->pos, c->records ? SNAPSHOT_AOS : SNAPSHOT_SOA);
+}
+
+void circles_free(circles_t *c)
+{
+    if (c->snap.map != NULL)
+    {
+        mem_account(MEM_CIRCLES, -(int64_t)(c->n * sizeof(circle_t)));
+        snapshot_close(&c->snap);
+    }
+    else
+    {
+        mem_free(c->records);
+    }
+    mem_free(c->scratch);
+    c->records = NULL;
+    c->scratch = NULL;
+    c->n = c->start = c->end = 0;
+}
+
+circle_view_t circles_owned_view(const circles_t *c)
+{
+    circle_view_t v = c->pos;
+    v.x = &CIRCLES_X(c, c->start);
+    v.y = &CIRCLES_Y(c, c->start);
+    v.r = &CIRCLES_R(c, c->start);
+    return v;
+}
+
+const circles_engine_t *circles_engine(const char *name)
+{
+    for (int e = 0; circles_engines[e] != NULL; e++)
+    {
+        if (strcmp(circles_engines[e]->name, name) == 0)
+            return circles_engines[e];
+    }
+    return NULL;
+}
+
+const circles_engine_t *circles_engine_at(int i)
+{
+    for (int e = 0; circles_engines[e] != NULL; e++)
+    {
+        if (e == i)
+            return circles_engines[e];
+    }
+    return NULL;
+}
+
+void circles_engine_list(FILE *out)
+{
+    for (int e = 0; circles_engines[e] != NULL; e++)
+    {
+        fprintf(out, "  %-12s %s\n", circles_engines[e]->name, circles_engines[e]->description);
+    }
+}
+
+int circles_engine_threads(const circles_engine_t *e)
+{
+    return e->threaded ? omp_get_max_threads() : 1;
+}
+
+int circles_iterate(circles_t *c, int iterno, pair_stats_t *pairs)
+{
+    const circles_engine_t *e = c->engine;
+    uint64_t tphase = trace_begin();
+    CIRCLES_TIMER_BEGIN(c, "reset");
+    e->reset(c);
+    CIRCLES_TIMER_END(c, "reset");
+    trace_end("reset", "phase", tphase, iterno);
+    tphase = trace_begin();
+    CIRCLES_TIMER_BEGIN(c, "forces");
+    const int n_overlaps = e->forces(c, pairs);
+    CIRCLES_TIMER_ITEMS(c, pairs->tests);
+    CIRCLES_TIMER_END(c, "forces");
+    trace_end("forces", "phase", tphase, iterno);
+    tphase = trace_begin();
+    CIRCLES_TIMER_BEGIN(c, "move");
+    e->move(c);
+    CIRCLES_TIMER_END(c, "move");
+    trace_end("move", "phase", tphase, iterno);
+    c->overlaps = n_overlaps;
+    c->iterations++;
+    return n_overlaps;
+}
+
+int circles_step(circles_t *c, int k)
+{
+    const circles_engine_t *e = c->engine;
+    if (e->partitioned && (c->start != 0 || c->end != c->n))
+    {
+        return -1;
+    }
+    const pair_stats_t none = {0, 0, 0, 0};
+    c->pairs = none;
+    if (k <= 0)
+    {
+        return c->overlaps;
+    }
+    if (e->step != NULL)
+    {
+        c->overlaps = e->step(c, k, &c->pairs);
+        c->iterations += k;
+        return c->overlaps;
+    }
+    /* the phases themselves, without the timers and the trace of
+       circles_iterate() */
+    for (int it = 0; it < k; it++)
+    {
+        pair_stats_t pairs;
+        e->reset(c);
+        c->overlaps = e->forces(c, &pairs);
+        e->move(c);
+        pair_stats_add(&c->pairs, &pairs);
+    }
+    c->iterations += k;
+    return c->overlaps;
+}
+
+int circles_count_active(const circles_t *c)
+{
+    int active = 0;
+    for (int i = 0; i < c->n; i++)
+    {
+        active += (CIRCLES_DX(c, i) != 0.0f || CIRCLES_DY(c, i) != 0.0f);
+    }
+    return active;
+}
+
+int circles_dump_gp(const circles_t *c, const char *prefix, int iterno)
+{
+    char fname[1024];
+    snprintf(fname, sizeof(fname), "%s-%05d.gp", prefix, iterno);
+    FILE *out = fopen(fname, "w");
+    if (out == NULL)
+    {
+        perror(fname);
+        return -1;
+    }
+    const float WIDTH = c->xmax - c->xmin;
+    const float HEIGHT = c->ymax - c->ymin;
+    fprintf(out, "set term png notransparent large\n");
+    fprintf(out, "set output \"%s-%05d.png\"\n", prefix, iterno);
+    fprintf(out, "set xrange [%f:%f]\n", c->xmin - WIDTH * .2, c->xmax + WIDTH * .2);
+    fprintf(out, "set yrange [%f:%f]\n", c->ymin - HEIGHT * .2, c->ymax + HEIGHT * .2);
+    fprintf(out, "set size square\n");
+    fprintf(out, "plot '-' with circles notitle\n");
+    for (int i = 0; i < c->n; i++)
+    {
+        fprintf(out, "%f %f %f\n", CIRCLES_X(c, i), CIRCLES_Y(c, i), CIRCLES_R(c, i));
+    }
+    fprintf(out, "e\n");
+    return fclose(out) == 0 ? 0 : -1;
+}
@@ -0,0 +1,284 @@
+/****************************************************************************
+ *
+ * libcircles.h - Simulation core shared by the circles programs
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * A simulation is a circles_t context: the circles, the parameters of
+ * the force and the engine that runs the iterations. There are no
+ * global variables, so that any number of contexts can live in the
+ * same program; two threads may work on two different contexts at the
+ * same time, but not on the same one.
+ *
+ * The engines compute the same forces with different kernels; they
+ * are selected by name at run time (see engines.c):
+ *
+ * - "serial": each pair (i, j), i < j, is examined once and pushes
+ *   both circles;
+ *
+ * - "omp": the same pairs, split among the OpenMP threads in chunks
+ *   handed out dynamically; the pushes are added with atomics, so the
+ *   result depends on the order in which the threads add them;
+ *
+ * - "gather": each circle i in [start, end) sums the pushes of all
+ *   the other circles and only i is written; this is the kernel of
+ *   the MPI program, where each process owns a block of circles;
+ *
+ * - "omp-gather": the gather kernel with the circles split among the
+ *   OpenMP threads; no atomics are needed.
+ *
+ * The pushes on a circle are added in the same order (by increasing
+ * j) by "serial", "gather" and "omp-gather", which therefore give the
+ * same positions, to the last bit, for any number of threads and
+ * processes.
+ *
+ * The coordinates are addressed through a circle_view_t and the
+ * displacements through a second pointer pair with its own stride,
+ * so the engines do not depend on the layout of the circles. An
+ * application that keeps its own arrays (an array of its structures,
+ * separate columns, ...) wraps them with circles_wrap() and advances
+ * them in place with circles_step(), which runs any number of
+ * iterations in one call; the positions and the overlaps are then
+ * read from the context, nothing is copied:
+ *
+ *        circles_t c;
+ *        circle_view_t pos = {x, y, r, sizeof(float)};
+ *        circles_init(&c);
+ *        c.engine = circles_engine("omp-gather");
+ *        circles_wrap(&c, n, &pos, NULL, NULL, 0);
+ *        while (...)
+ *        {
+ *            circles_step(&c, 10);
+ *            ... c.overlaps, x[i], y[i] ...
+ *        }
+ *        circles_free(&c);
+ *
+ ****************************************************************************/
+
+#ifndef LIBCIRCLES_H
+#define LIBCIRCLES_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "view.h"
+#include "snapshot.h"
+#include "pairstats.h"
+
+typedef struct
+{
+    float x, y;   /* coordinates of center */
+    float r;      /* radius */
+    float dx, dy; /* displacements due to interactions with other circles */
+} circle_t;
+
+/* Domain and radii of the random circles, and parameters of the force */
+#define CIRCLES_XMIN 0.0f
+#define CIRCLES_XMAX 1000.0f
+#define CIRCLES_YMIN 0.0f
+#define CIRCLES_YMAX 1000.0f
+#define CIRCLES_RMIN 10.0f
+#define CIRCLES_RMAX 100.0f
+#define CIRCLES_EPSILON 1e-5f
+#define CIRCLES_K 1.5f
+
+typedef struct circles circles_t;
+
+typedef struct
+{
+    const char *name;        /* name given to --engine */
+    const char *description; /* one line for the list of the engines */
+    int threaded;            /* uses the OpenMP threads */
+    int partitioned;         /* computes the forces of [start, end) only;
+                                the other engines ignore start and end */
+    /* set the displacements of the circles [start, end) to zero */
+    void (*reset)(circles_t *c);
+    /* add the pushes to the displacements and return the overlaps */
+    int (*forces)(circles_t *c, pair_stats_t *pairs);
+    /* move all the circles by their displacements */
+    void (*move)(circles_t *c);
+    /* run `k` iterations at once and return the overlaps of the last
+       one; NULL if the engine has no faster way than calling the
+       three functions above in turn */
+    int (*step)(circles_t *c, int k, pair_stats_t *pairs);
+} circles_engine_t;
+
+/* Timers of the phases, called with a static name (NULL to skip) */
+typedef struct
+{
+    void (*begin)(const char *name);
+    void (*end)(const char *name);
+    void (*items)(uint64_t n);
+} circles_timers_t;
+
+struct circles
+{
+    int n;                  /* number of circles */
+    circle_view_t pos;      /* coordinates and radii */
+    float *dx, *dy;         /* displacements */
+    size_t dstride;         /* distance in bytes between two displacements */
+    int start, end;         /* circles whose forces this context computes */
+    float xmin, xmax;       /* domain, recorded in the output files */
+    float ymin, ymax;
+    float k;                /* stiffness: a push is the overlap / k */
+    float epsilon;          /* smallest overlap, and guard of the division */
+    unsigned seed;          /* seed of the initial configuration */
+    unsigned long iter0;    /* iteration the initial configuration comes from */
+    const circles_engine_t *engine;
+    circles_timers_t timers;
+    circle_t *records;      /* storage of the circles, NULL if not ours */
+    snapshot_t snap;        /* snapshot mapped as `records`, if any */
+    float *scratch;         /* displacements allocated by circles_wrap() */
+    uint64_t iterations;    /* iterations run so far */
+    int overlaps;           /* overlapping pairs in the last iteration */
+    pair_stats_t pairs;     /* pairs examined by the last circles_step() */
+};
+
+#define CIRCLES_X(c, i) VIEW_X(&(c)->pos, i)
+#define CIRCLES_Y(c, i) VIEW_Y(&(c)->pos, i)
+#define CIRCLES_R(c, i) VIEW_R(&(c)->pos, i)
+#define CIRCLES_DX(c, i) (*(float *)((char *)(c)->dx + (size_t)(i) * (c)->dstride))
+#define CIRCLES_DY(c, i) (*(float *)((char *)(c)->dy + (size_t)(i) * (c)->dstride))
+
+#define CIRCLES_TIMER_BEGIN(c, name) do { if ((c)->timers.begin) (c)->timers.begin(name); } while (0)
+#define CIRCLES_TIMER_END(c, name) do { if ((c)->timers.end) (c)->timers.end(name); } while (0)
+#define CIRCLES_TIMER_ITEMS(c, n) do { if ((c)->timers.items) (c)->timers.items(n); } while (0)
+
+/**
+ * Initialize `c` with no circles, the default domain and force, and
+ * the "serial" engine.
+ */
+void circles_init(circles_t *c);
+
+/**
+ * Allocate `n` circle_t records, all zero. Returns 0 on success, -1
+ * on failure.
+ */
+int circles_alloc(circles_t *c, int n);
+
+/**
+ * Allocate `n` circles placed at random with rand(), seeded with
+ * `seed`, as the original programs did. rand() has a single state per
+ * program: this is the one function of the library that must not run
+ * concurrently with another call to rand().
+ */
+int circles_random(circles_t *c, int n, unsigned seed);
+
+/**
+ * Use the `n` circles of the caller, whose coordinates are described
+ * by `pos` and whose displacements are `dx` and `dy`, `dstride` bytes
+ * apart; the arrays are used in place, and are never released by the
+ * library. With `dx` NULL the displacements are allocated by the
+ * library. Whatever `c` owned before (circles allocated or loaded,
+ * displacements of an earlier call) is released first, so a context
+ * can be wrapped again around other arrays. Returns 0 on success, -1
+ * on failure.
+ */
+int circles_wrap(circles_t *c, int n, const circle_view_t *pos,
+                 float *dx, float *dy, size_t dstride);
+
+/**
+ * Load the circles from `path`, a binary snapshot or a text file of
+ * "x y r" lines. A snapshot of circle_t records is used in place (the
+ * private mapping of the file), without copying. Returns 0 on success,
+ * -1 (after printing a message) on failure.
+ */
+int circles_load(circles_t *c, const char *path);
+
+/**
+ * Number of circles stored in `path`, without loading them; -1 (after
+ * printing a message) if the file cannot be read.
+ */
+int circles_count(const char *path);
+
+/**
+ * Bytes needed for `n` circles.
+ */
+uint64_t circles_footprint(uint64_t n);
+
+/**
+ * Save the circles to the binary snapshot `path` as the state at
+ * iteration `iterno` of this run. Returns 0 on success, -1 on failure.
+ */
+int circles_save(const circles_t *c, const char *path, int iterno);
+
+/**
+ * Release the circles, however they have been obtained.
+ */
+void circles_free(circles_t *c);
+
+/**
+ * View of the circles [start, end).
+ */
+circle_view_t circles_owned_view(const circles_t *c);
+
+/**
+ * The engine called `name`, NULL if there is none.
+ */
+const circles_engine_t *circles_engine(const char *name);
+
+/**
+ * The `i`-th engine, in the order of the list, NULL if i is past the
+ * last one.
+ */
+const circles_engine_t *circles_engine_at(int i);
+
+/**
+ * Print the names and descriptions of the engines to `out`.
+ */
+void circles_engine_list(FILE *out);
+
+/**
+ * Threads used by the engine `e`.
+ */
+int circles_engine_threads(const circles_engine_t *e);
+
+/**
+ * Run one iteration (the iteration `iterno`, as shown in the trace)
+ * with the engine of `c`: reset the displacements, compute the forces
+ * and move the circles, timing and tracing each phase. Returns the
+ * number of overlapping pairs, and stores the pairs examined into
+ * `pairs`.
+ */
+int circles_iterate(circles_t *c, int iterno, pair_stats_t *pairs);
+
+/**
+ * Run `k` iterations without returning in between, with the fastest
+ * way the engine has: "omp-gather" keeps its threads for all the
+ * iterations, so that small problems do not pay a parallel region per
+ * phase. The phases of a batch are neither timed nor traced, whatever
+ * the engine (see circles_iterate() for that). Stores
+ * the pairs examined by the `k` iterations into `c->pairs` and returns
+ * the overlaps of the last one (also in `c->overlaps`), or -1 if the
+ * context computes the forces of part of the circles only (their
+ * displacements must be exchanged after each iteration, see
+ * mpi-circles.c).
+ */
+int circles_step(circles_t *c, int k);
+
+/**
+ * Number of circles that the last iteration moved.
+ */
+int circles_count_active(const circles_t *c);
+
+/**
+ * Write the circles into "PREFIX-ITERNO.gp", a gnuplot script that
+ * draws them into "PREFIX-ITERNO.png". Returns 0 on success, -1 on
+ * failure.
+ */
+int circles_dump_gp(const circles_t *c, const char *prefix, int iterno);
+
+#endif
@@ -0,0 +1,179 @@
+/****************************************************************************
+ *
+ * memtrack.c - Accounting of the large allocations
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "memtrack.h"
+
+/* header in front of each block; the union keeps the block aligned
+   for any type */
+typedef union
+{
+    struct
+    {
+        size_t size;
+        int kind;
+    } h;
+    long double align_ld;
+    void *align_p;
+} mem_header_t;
+
+static const char *kind_name[MEM_KINDS] = {"circles", "threads", "MPI", "output"};
+
+/* the allocations are few and large: a lock is cheap enough, and the
+   trace buffers are allocated by the OpenMP threads */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t current[MEM_KINDS];
+static int64_t at_peak[MEM_KINDS];
+static int64_t peak;
+
+void mem_account(mem_kind_t kind, int64_t bytes)
+{
+    pthread_mutex_lock(&lock);
+    current[kind] += bytes;
+    int64_t total = 0;
+    for (int k = 0; k < MEM_KINDS; k++)
+        total += current[k];
+    if (total > peak)
+    {
+        peak = total;
+        memcpy(at_peak, current, sizeof(at_peak));
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void *mem_alloc(mem_kind_t kind, size_t size)
+{
+    mem_header_t *h = (mem_header_t *)malloc(sizeof(*h) + size);
+    if (h == NULL)
+        return NULL;
+    h->h.size = size;
+    h->h.kind = kind;
+    mem_account(kind, (int64_t)size);
+    return h + 1;
+}
+
+void *mem_calloc(mem_kind_t kind, size_t n, size_t size)
+{
+    if (size != 0 && n > (SIZE_MAX - sizeof(mem_header_t)) / size)
+        return NULL;
+    void *p = mem_alloc(kind, n * size);
+    if (p != NULL)
+        memset(p, 0, n * size);
+    return p;
+}
+
+void *mem_realloc(mem_kind_t kind, void *p, size_t size)
+{
+    if (p == NULL)
+        return mem_alloc(kind, size);
+    mem_header_t *h = (mem_header_t *)p - 1;
+    const size_t old = h->h.size;
+    h = (mem_header_t *)realloc(h, sizeof(*h) + size);
+    if (h == NULL)
+        return NULL;
+    h->h.size = size;
+    mem_account((mem_kind_t)h->h.kind, (int64_t)size - (int64_t)old);
+    return h + 1;
+}
+
+void mem_free(void *p)
+{
+    if (p == NULL)
+        return;
+    mem_header_t *h = (mem_header_t *)p - 1;
+    mem_account((mem_kind_t)h->h.kind, -(int64_t)h->h.size);
+    free(h);
+}
+
+/**
+ * Peak resident set size in bytes, from the VmHWM line of
+ * /proc/self/status; -1 where there is no such file.
+ */
+static int64_t peak_rss(void)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL)
+        return -1;
+    char line[256];
+    long long kib = -1;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (sscanf(line, "VmHWM: %lld kB", &kib) == 1)
+            break;
+    }
+    fclose(f);
+    return kib < 0 ? -1 : (int64_t)kib * 1024;
+}
+
+void mem_usage(mem_usage_t *u)
+{
+    pthread_mutex_lock(&lock);
+    u->peak = peak;
+    memcpy(u->kind, at_peak, sizeof(u->kind));
+    pthread_mutex_unlock(&lock);
+    u->rss = peak_rss();
+}
+
+/* `bytes` with a binary prefix */
+static const char *human(char *buf, size_t size, int64_t bytes)
+{
+    static const char *unit[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double v = (double)bytes;
+    int u = 0;
+    while (v >= 1024 && u < 4)
+    {
+        v /= 1024;
+        u++;
+    }
+    if (u == 0)
+        snprintf(buf, size, "%lld B", (long long)bytes);
+    else
+        snprintf(buf, size, "%.2f %s", v, unit[u]);
+    return buf;
+}
+
+void mem_print(FILE *out, const char *title, const mem_usage_t *u)
+{
+    char a[32], b[32];
+    fprintf(out, "%s: tracked peak %s (", title, human(a, sizeof(a), u->peak));
+    for (int k = 0; k < MEM_KINDS; k++)
+        fprintf(out, "%s%s %s", k ? ", " : "", kind_name[k], human(a, sizeof(a), u->kind[k]));
+    if (u->rss < 0)
+        fprintf(out, "), peak RSS unknown\n");
+    else
+        fprintf(out, "), peak RSS %s\n", human(b, sizeof(b), u->rss));
+}
+
+void mem_estimate_print(FILE *out, const mem_usage_t *e, int nthreads)
+{
+    char a[32], b[32];
+    int64_t total = 0;
+    for (int k = 0; k < MEM_KINDS; k++)
+    {
+        total += e->kind[k];
+        fprintf(out, "  %-8s %12s", kind_name[k], human(a, sizeof(a), e->kind[k]));
+        if (k == MEM_THREADS && nthreads > 1 && e->kind[k] > 0)
+            fprintf(out, " (%d x %s)", nthreads, human(b, sizeof(b), e->kind[k] / nthreads));
+        fprintf(out, "\n");
+    }
+    fprintf(out, "  %-8s %12s\n", "total", human(a, sizeof(a), total));
+}
@@ -0,0 +1,97 @@
+/****************************************************************************
+ *
+ * memtrack.h - Accounting of the large allocations
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * The arrays whose size grows with the number of circles, the number
+ * of threads or the number of processes are allocated with
+ * mem_alloc() and friends, which keep a few bytes in front of each
+ * block with its size and kind, and count the bytes in use of each
+ * kind; memory obtained otherwise (a mapping of a file or of a shared
+ * memory object) is counted with mem_account(). The largest total
+ * seen is the tracked peak, to be compared with the peak resident
+ * set size of the process (VmHWM in /proc/self/status), which also
+ * includes the program, the libraries and the small allocations.
+ *
+ * The same categories are used to estimate the memory of a run before
+ * starting it (--dry-run), from the *_footprint() functions of the
+ * modules.
+ *
+ ****************************************************************************/
+
+#ifndef MEMTRACK_H
+#define MEMTRACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum
+{
+    MEM_CIRCLES, /* the array of the circles */
+    MEM_THREADS, /* buffers of each thread */
+    MEM_MPI,     /* buffers for the communications */
+    MEM_OUTPUT,  /* trajectory, images and live frames */
+    MEM_KINDS
+} mem_kind_t;
+
+/* all int64_t, so that a process can reduce it with MPI_INT64_T */
+typedef struct
+{
+    int64_t peak;            /* tracked bytes at the peak */
+    int64_t kind[MEM_KINDS]; /* bytes of each kind at the peak */
+    int64_t rss;             /* peak resident set size, -1 if unknown */
+} mem_usage_t;
+
+void *mem_alloc(mem_kind_t kind, size_t size);
+void *mem_calloc(mem_kind_t kind, size_t n, size_t size);
+
+/**
+ * Resize the block `p` (NULL for a new one) of kind `kind`; as
+ * realloc(), `p` is still valid if NULL is returned.
+ */
+void *mem_realloc(mem_kind_t kind, void *p, size_t size);
+
+/**
+ * Release a block returned by the functions above; NULL is ignored.
+ */
+void mem_free(void *p);
+
+/**
+ * Count `bytes` (negative when released) of kind `kind` that were not
+ * allocated with mem_alloc().
+ */
+void mem_account(mem_kind_t kind, int64_t bytes);
+
+/**
+ * Tracked peak of this process, and its peak resident set size.
+ */
+void mem_usage(mem_usage_t *u);
+
+/**
+ * Print `u` on one line, after `title`.
+ */
+void mem_print(FILE *out, const char *title, const mem_usage_t *u);
+
+/**
+ * Print the estimate `e` (peak and rss are ignored), one kind per
+ * line; `nthreads` threads share the MEM_THREADS bytes.
+ */
+void mem_estimate_print(FILE *out, const mem_usage_t *e, int nthreads);
+
+#endif
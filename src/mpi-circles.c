@@ -31,20 +31,72 @@ If you want to compile manually, follow the instructions below.
 
 To compile:
 
-        mpicc -std=c99 -Wall -Wpedantic mpi-circles.c -o mpi-circles -lm
+        mpicc -std=c99 -fopenmp -Wall -Wpedantic mpi-circles.c options.c argutil.c snapshot.c textimport.c trajectory.c filewriter.c asyncwriter.c render.c shmring.c pairstats.c trace.c summary.c latency.c memtrack.c progress.c telemetry.c libcircles.c engines.c mpiio.c -o mpi-circles -lm -pthread -lrt
 
 To execute:
 
-        mpirun mpi-circles [ncircles] [iterations]
+        mpirun mpi-circles [options] [ncircles [iterations]]
 
 where `ncircles` is the number of circles, and `iterations` is the
-number of iterations to execute.
-
-If you want to produce a movie (this is not required, and should be
-avoided when measuring the performance of the parallel versions of
-this program) compile with:
-
-        mpicc -std=c99 -Wall -Wpedantic -DMOVIE mpi-circles.c -o mpi-circles.movie -lm
+number of iterations to execute. The options are:
+
+- `--input FILE`: read the initial circles from FILE instead of
+  placing `ncircles` circles at random. FILE is either a binary
+  snapshot or a text file with one `x y r` line per circle (blanks
+  and/or commas as separators, as in CSV files or in the data block
+  of the gnuplot files written with -DMOVIE);
+
+- `--output FILE`: write the circles to the binary snapshot FILE at
+  the end of the run; the snapshot can be fed back with `--input` to
+  continue the simulation. Each process writes the circles it owns
+  with collective MPI-IO (see mpiio.h), nothing is gathered on the
+  root process;
+
+- `--seed N`: seed of the random initial configuration (default 1).
+
+- `--trajectory FILE`: write the positions of the circles at each
+  iteration into a single compact trajectory file; `traj2gp` turns
+  it back into the gnuplot files described below. The trajectory is
+  controlled by `--traj-every N` (one frame every N iterations),
+  `--traj-quantum Q` (positions are rounded to multiples of Q; 0
+  keeps them exact) and `--traj-roi X0,Y0,X1,Y1` (only the circles
+  whose center lies inside the rectangle are stored). As for
+  `--output`, every process encodes and writes its own circles with
+  collective MPI-IO, as one block of each frame (`--traj-buffers` is
+  ignored).
+
+- `--io-hints KEY=VALUE,...`: MPI-IO hints for the output files, e.g.
+  `cb_buffer_size=16777216,romio_cb_write=enable,cb_nodes=4` to tune
+  the collective buffering.
+
+- `--render PATTERN`: draw the circles at each iteration into an
+  image whose name is the printf() pattern PATTERN applied to the
+  iteration number (e.g. `frame-%05d.png`); the image is a PNG if the
+  name ends with `.png`, a binary PPM otherwise;
+
+- `--movie FILE`: draw the circles at each iteration and pipe the
+  frames to `ffmpeg`, which encodes them into FILE;
+
+- `--render-size N`: width and height of the images (default 640).
+  The images show the same region as the gnuplot files below; the
+  circles are drawn by all the OpenMP threads, so no external tool
+  is needed besides `ffmpeg` for movies.
+
+- `--publish NAME`: copy the circles at each iteration into the POSIX
+  shared memory object NAME (e.g. `/circles`), where `ringview` or
+  any other reader can watch the run live; the simulation never
+  waits for the readers.
+
+- `--engine NAME`: compute the forces of the circles of each process
+  with the `gather` engine of libcircles (the default, see
+  libcircles.h) or with `omp-gather`, which also splits them among the
+  OpenMP threads of the process; the positions are the same.
+
+If you want the gnuplot files of the original movie version (this is
+not required, and should be avoided when measuring the performance of
+the parallel versions of this program) compile with:
+
+        mpicc -std=c99 -fopenmp -Wall -Wpedantic -DMOVIE mpi-circles.c options.c argutil.c snapshot.c textimport.c trajectory.c filewriter.c asyncwriter.c render.c shmring.c pairstats.c trace.c summary.c latency.c memtrack.c progress.c telemetry.c libcircles.c engines.c mpiio.c -o mpi-circles.movie -lm -pthread -lrt
 
 and execute with:
 
@@ -66,235 +118,633 @@ and then assembled to produce the movie `circles.avi`:
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
-#include <math.h>
 #include <string.h>
-
+#include "libcircles.h"
+#include "options.h"
+#include "trajectory.h"
+#include "render.h"
+#include "shmring.h"
+#include "mpiio.h"
+#include "pairstats.h"
+#include "trace.h"
+#include "summary.h"
+#include "latency.h"
+#include "memtrack.h"
+#include "progress.h"
+#include "telemetry.h"
+
+/* What the processes add up at each iteration: the pairs examined
+   and the requests of a dump (see progress.h); all uint64_t */
 typedef struct
 {
-    float x, y;   /* coordinates of center */
-    float r;      /* radius */
-    float dx, dy; /* displacements due to interactions with other circles */
-} circle_t;
-
-/* These constants can be replaced with #define's if necessary */
-const float XMIN = 0.0;
-const float XMAX = 1000.0;
-const float YMIN = 0.0;
-const float YMAX = 1000.0;
-const float RMIN = 10.0;
-const float RMAX = 100.0;
-const float EPSILON = 1e-5;
-const float K = 1.5;
-
-int ncircles;
-circle_t *circles = NULL;
+    pair_stats_t pairs;
+    uint64_t dump;
+} iteration_sums_t;
+
+#define ITERATION_SUMS_FIELDS (PAIR_STATS_FIELDS + 1)
+
+circles_t sim;           /* the simulation; this process computes the forces
+                            of the circles [sim.start, sim.end) */
+mpiio_traj_t traj;       /* trajectory being written, if any */
+MPI_Info io_info = MPI_INFO_NULL; /* MPI-IO hints for the output files */
+renderer_t render;       /* renderer of the images or movie, if any */
+const char *image_pattern = NULL; /* file names of the rendered images */
+shm_ring_t ring;         /* shared memory the frames are published to, if any */
 
 /**
- * Return a random float in [a, b]
+ * Write the circles to the snapshot `path`, as the state at iteration
+ * `iterno` of this run. Collective: each process writes the circles
+ * it owns.
  */
-float randab(float a, float b)
+void save_circles(const char *path, int iterno)
 {
-    return a + (((float)rand()) / RAND_MAX) * (b - a);
+    snapshot_header_t hdr;
+    snapshot_header_init(&hdr, sim.n, sim.xmin, sim.xmax, sim.ymin, sim.ymax);
+    hdr.seed = sim.seed;
+    hdr.iteration = sim.iter0 + iterno;
+    const circle_view_t v = circles_owned_view(&sim);
+    if (mpiio_snapshot_save(MPI_COMM_WORLD, path, &hdr, &v, sim.end - sim.start, io_info) != 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
 }
 
 /**
- * Create and populate the array `circles[]` with randomly placed
- * circls.
- *
- * Do NOT parallelize this function.
+ * Create the trajectory file requested on the command line, and
+ * store the radii of the circles into it. Collective: each process
+ * writes the circles it owns.
+ */
+void open_trajectory(const options_t *opt)
+{
+    traj_header_t hdr;
+    traj_header_init(&hdr, sim.n, sim.xmin, sim.xmax, sim.ymin, sim.ymax);
+    hdr.every = opt->traj_every;
+    hdr.quantum = opt->traj_quantum;
+    if (opt->traj_roi && traj_header_set_roi(&hdr, opt->traj_roi) != 0)
+    {
+        fprintf(stderr, "Invalid region of interest \"%s\"\n", opt->traj_roi);
+        exit(EXIT_FAILURE);
+    }
+    const circle_view_t v = circles_owned_view(&sim);
+    if (mpiio_traj_open(&traj, MPI_COMM_WORLD, opt->trajectory, &hdr, &v,
+                        sim.end - sim.start, io_info) != 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+}
+
+/**
+ * Prepare the renderer for the images or the movie requested on the
+ * command line.
  */
-void init_circles(int n)
+void open_renderer(const options_t *opt)
 {
-    assert(circles == NULL);
-    ncircles = n;
-    circles = (circle_t *)malloc(n * sizeof(*circles));
-    assert(circles != NULL);
-    for (int i = 0; i < n; i++)
+    if (render_init(&render, opt->render_size, sim.xmin, sim.xmax, sim.ymin, sim.ymax) != 0)
     {
-        circles[i].x = randab(XMIN, XMAX);
-        circles[i].y = randab(YMIN, YMAX);
-        circles[i].r = randab(RMIN, RMAX);
-        circles[i].dx = circles[i].dy = 0.0;
+        fprintf(stderr, "Cannot create the renderer\n");
+        exit(EXIT_FAILURE);
+    }
+    image_pattern = opt->render;
+    if (opt->movie && render_movie_open(&render, opt->movie) != 0)
+    {
+        exit(EXIT_FAILURE);
     }
 }
 
 /**
- * Set all displacements to zero.
+ * Create the shared memory ring requested on the command line.
  */
-void reset_displacements(int start, int end)
+void open_ring(const options_t *opt)
 {
-    for (int i = start; i < end; i++)
+    if (shm_ring_create(&ring, opt->publish, &sim.pos, sim.n,
+                        sim.xmin, sim.xmax, sim.ymin, sim.ymax) != 0)
     {
-        circles[i].dx = circles[i].dy = 0.0;
+        exit(EXIT_FAILURE);
     }
 }
 
 /**
- * Compute the force acting on each circle; returns the number of
- * overlapping pairs of circles (each overlapping pair must be counted
- * only once).
+ * Append the current positions to the trajectory, render them and
+ * publish them, if requested. Must be called by all the processes,
+ * since the trajectory is written collectively.
  */
-int compute_forces(int start, int end)
+void write_frame(int iterno, int n_overlaps)
 {
-    int n_intersections = 0;
-    for (int i = start; i < end; i++)
+    const circle_view_t owned = circles_owned_view(&sim);
+    if (ring.hdr != NULL)
     {
-        for (int j = 0; j < ncircles; j++)
+        shm_ring_publish(&ring, iterno, n_overlaps, &sim.pos);
+    }
+    if (traj.open && mpiio_traj_frame(&traj, iterno, n_overlaps, &owned) != 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    if (render.pixels != NULL)
+    {
+        if (render_frame(&render, &sim.pos, sim.n) != 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        if (image_pattern)
         {
-            if (i == j)
-                continue;
-            const float deltax = circles[j].x - circles[i].x;
-            const float deltay = circles[j].y - circles[i].y;
-            const float dist = hypotf(deltax, deltay);
-            const float Rsum = circles[i].r + circles[j].r;
-            if (dist < Rsum - EPSILON)
+            char fname[1024];
+            snprintf(fname, sizeof(fname), image_pattern, iterno);
+            if (render_write(&render, fname) != 0)
             {
-                n_intersections++;
-                const float overlap = Rsum - dist;
-                assert(overlap > 0.0);
-                float overlap_x, overlap_y;
-                if (dist < EPSILON)
-                {
-                    // If the distance is very small, distribute the overlap equally in an arbitrary direction
-                    overlap_x = overlap / sqrtf(2.0);
-                    overlap_y = overlap / sqrtf(2.0);
-                }
-                else
-                {
-                    overlap_x = overlap / dist * deltax;
-                    overlap_y = overlap / dist * deltay;
-                }
-                circles[i].dx -= overlap_x / K;
-                circles[i].dy -= overlap_y / K;
-                circles[j].dx += overlap_x / K;
-                circles[j].dy += overlap_y / K;
+                exit(EXIT_FAILURE);
             }
         }
+        if (render.pipe && render_movie_frame(&render) != 0)
+        {
+            exit(EXIT_FAILURE);
+        }
     }
-    return n_intersections;
 }
 
+#ifdef HPC_TIMERS
 /**
- * Move the circles to a new position according to the forces acting
- * on each one.
+ * Print (on rank 0) the busy time and the work of each process in
+ * each phase, and the time spent waiting for the other processes
+ * after the forces.
  */
-void move_circles()
+void report_imbalance(int rank, int size)
 {
-    for (int i = 0; i < ncircles; i++)
+    static const char *phases[] = {"reset", "forces", "move", "output"};
+    double *busy = NULL, *idle = NULL, *work = NULL;
+    if (rank == 0)
     {
-        circles[i].x += circles[i].dx;
-        circles[i].y += circles[i].dy;
+        busy = (double *)malloc(size * sizeof(*busy));
+        idle = (double *)malloc(size * sizeof(*idle));
+        work = (double *)malloc(size * sizeof(*work));
     }
+    const double my_idle = hpc_timer_total("idle", 0, NULL);
+    MPI_Gather(&my_idle, 1, MPI_DOUBLE, idle, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    for (size_t p = 0; p < sizeof(phases) / sizeof(phases[0]); p++)
+    {
+        uint64_t items;
+        const double my_busy = hpc_timer_total(phases[p], 0, &items);
+        const double my_work = (double)items;
+        MPI_Gather(&my_busy, 1, MPI_DOUBLE, busy, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Gather(&my_work, 1, MPI_DOUBLE, work, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        if (rank == 0)
+        {
+            const int forces = strcmp(phases[p], "forces") == 0;
+            hpc_imbalance_print(stderr, phases[p], "rank", size, busy,
+                                forces ? idle : NULL, forces ? work : NULL);
+        }
+    }
+    free(busy);
+    free(idle);
+    free(work);
 }
+#endif
 
-#ifdef MOVIE
 /**
- * Dumps the circles into a text file that can be processed using
- * gnuplot. This function may be used for debugging purposes, or to
- * produce a movie of how the algorithm works.
- *
- * You may want to completely remove this function from the final
- * version.
+ * Print the imbalance of the phases, then the timers of each process
+ * in rank order. Collective; nothing without HPC_TIMERS.
  */
-void dump_circles(int iterno)
+void report_timers(int rank, int size)
 {
-    char fname[64];
-    snprintf(fname, sizeof(fname), "mpi-circles-%05d.gp", iterno);
-    FILE *out = fopen(fname, "w");
-    const float WIDTH = XMAX - XMIN;
-    const float HEIGHT = YMAX - YMIN;
-    fprintf(out, "set term png notransparent large\n");
-    fprintf(out, "set output \"mpi-circles-%05d.png\"\n", iterno);
-    fprintf(out, "set xrange [%f:%f]\n", XMIN - WIDTH * .2, XMAX + WIDTH * .2);
-    fprintf(out, "set yrange [%f:%f]\n", YMIN - HEIGHT * .2, YMAX + HEIGHT * .2);
-    fprintf(out, "set size square\n");
-    fprintf(out, "plot '-' with circles notitle\n");
-    for (int i = 0; i < ncircles; i++)
-    {
-        fprintf(out, "%f %f %f\n", circles[i].x, circles[i].y, circles[i].r);
-    }
-    fprintf(out, "e\n");
-    fclose(out);
-}
+#ifdef HPC_TIMERS
+    report_imbalance(rank, size);
+    /* one table per process, in rank order */
+    for (int r = 0; r < size; r++)
+    {
+        if (r == rank)
+        {
+            char title[32];
+            snprintf(title, sizeof(title), "Rank %d", rank);
+            HPC_TIMER_REPORT(title);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+#else
+    (void)rank;
+    (void)size;
 #endif
+}
 
-int main(int argc, char *argv[])
+/**
+ * Print the memory that each process of a run described by `opt`
+ * with `nprocs` processes would allocate, without allocating it
+ * (--dry-run).
+ */
+void estimate_memory(const options_t *opt, int nprocs)
 {
-    int n = 10000;
-    int iterations = 20;
-
-    if (argc > 3)
+    const int count = opt->input ? circles_count(opt->input) : opt->ncircles;
+    if (count < 0)
     {
-        fprintf(stderr, "Usage: %s [ncircles [iterations]]\n", argv[0]);
-        return EXIT_FAILURE;
+        return;
+    }
+    const uint64_t n = count;
+    const uint64_t nframes = opt->iterations / opt->traj_every + 1;
+    const uint64_t owned = (n + nprocs - 1) / nprocs;
+    printf("Memory needed by mpi-circles for %llu circles, %d processes:\n",
+           (unsigned long long)n, nprocs);
+    /* the root process also draws the images and publishes the frames */
+    for (int rank = 0; rank < (nprocs > 1 ? 2 : 1); rank++)
+    {
+        mem_usage_t e;
+        memset(&e, 0, sizeof(e));
+        /* every process holds all the circles */
+        e.kind[MEM_CIRCLES] = circles_footprint(n);
+        e.kind[MEM_MPI] = 2 * (uint64_t)nprocs * sizeof(int);
+        if (opt->trace)
+        {
+            e.kind[MEM_THREADS] = trace_footprint();
+        }
+        if (opt->trajectory)
+        {
+            e.kind[MEM_OUTPUT] += mpiio_traj_footprint(owned, nframes, rank);
+        }
+        if (rank == 0 && (opt->render || opt->movie))
+        {
+            e.kind[MEM_OUTPUT] += render_footprint(opt->render_size, n);
+        }
+        if (rank == 0 && opt->publish)
+        {
+            e.kind[MEM_OUTPUT] += shm_ring_footprint(n, sizeof(circle_t));
+        }
+        printf("%s:\n", rank == 0 ? "Rank 0" : "Each of the other ranks");
+        mem_estimate_print(stdout, &e, 1);
     }
+}
 
-    if (argc > 1)
+/**
+ * Align the trace timeline of this process with the one of rank 0
+ * (--trace). The clocks of different nodes have different origins, so
+ * each process estimates the difference between the clock of rank 0
+ * and its own with a few ping-pong exchanges, keeping the one with the
+ * shortest round trip, which bounds the error best (Cristian's
+ * algorithm). The time of rank 0 after a barrier then becomes time 0 of
+ * all the timelines.
+ */
+void align_trace_clocks(int rank, int nprocs)
+{
+    enum { ROUNDS = 8 };
+    int64_t skew = 0; /* clock of rank 0 minus the local clock */
+    if (rank == 0)
     {
-        n = atoi(argv[1]);
+        for (int p = 1; p < nprocs; p++)
+        {
+            for (int k = 0; k < ROUNDS; k++)
+            {
+                MPI_Recv(NULL, 0, MPI_BYTE, p, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                const uint64_t now = trace_clock();
+                MPI_Send(&now, 1, MPI_UINT64_T, p, 0, MPI_COMM_WORLD);
+            }
+        }
     }
+    else
+    {
+        uint64_t best = UINT64_MAX;
+        for (int k = 0; k < ROUNDS; k++)
+        {
+            uint64_t root;
+            const uint64_t t0 = trace_clock();
+            MPI_Send(NULL, 0, MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+            MPI_Recv(&root, 1, MPI_UINT64_T, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            const uint64_t t1 = trace_clock();
+            if (t1 - t0 < best)
+            {
+                /* rank 0 read its clock halfway through the round trip */
+                best = t1 - t0;
+                skew = (int64_t)(root + best / 2) - (int64_t)t1;
+            }
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    uint64_t start = trace_clock();
+    MPI_Bcast(&start, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    trace_set_offset(skew - (int64_t)start);
+}
 
-    if (argc > 2)
+int main(int argc, char *argv[])
+{
+    options_t opt;
+
+    options_init(&opt);
+    if (options_parse(&opt, argc, argv) != 0)
     {
-        iterations = atoi(argv[2]);
+        return EXIT_FAILURE;
     }
+    const int iterations = opt.iterations;
 
     /* Initialize MPI */
     MPI_Init(&argc, &argv);
     int rank, size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    const circles_engine_t *engine = circles_engine(opt.engine ? opt.engine : "gather");
+    if (engine == NULL || !engine->partitioned)
+    {
+        /* the other engines compute the forces of all the circles */
+        if (rank == 0)
+        {
+            fprintf(stderr, "%s: the engine must be gather or omp-gather\n", argv[0]);
+        }
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+    if (opt.batch > 0)
+    {
+        /* each iteration ends with the exchange of the blocks */
+        if (rank == 0)
+        {
+            fprintf(stderr, "%s: --batch is not supported by the MPI program\n", argv[0]);
+        }
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+    if (opt.dry_run)
+    {
+        if (rank == 0)
+        {
+            estimate_memory(&opt, opt.dry_run);
+        }
+        MPI_Finalize();
+        return EXIT_SUCCESS;
+    }
+    /* from now on a SIGUSR1 no longer terminates the program, even
+       while loading the circles */
+    if (progress_install() != 0)
+    {
+        fprintf(stderr, "Cannot install the handler of SIGUSR1\n");
+    }
 
+    circles_init(&sim);
+    sim.engine = engine;
+#ifdef HPC_TIMERS
+    const circles_timers_t timers = {hpc_timer_begin, hpc_timer_end, hpc_timer_items};
+    sim.timers = timers;
+#endif
     if (rank == 0)
     {
-        init_circles(n);
+        if (opt.input ? circles_load(&sim, opt.input) : circles_random(&sim, opt.ncircles, opt.seed))
+        {
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
     }
 
     /* Broadcasting the number of circles and the circles array
      * to all processes to allocate the memory for the circles.*/
+    int ncircles = sim.n;
     MPI_Bcast(&ncircles, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    int start = (rank * ncircles) / size;
-    int end = ((rank + 1) * ncircles) / size;
-    if (rank != 0)
+    if (rank != 0 && circles_alloc(&sim, ncircles) != 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    /* the circles are sent as records of a contiguous type, so that the
+       counts and displacements are in circles, not in bytes, and do not
+       overflow an int */
+    MPI_Datatype circle_type;
+    MPI_Type_contiguous((int)sizeof(circle_t), MPI_BYTE, &circle_type);
+    MPI_Type_commit(&circle_type);
+    MPI_Bcast(sim.records, ncircles, circle_type, 0, MPI_COMM_WORLD);
+    sim.start = (int)(((long)rank * ncircles) / size);
+    sim.end = (int)(((long)(rank + 1) * ncircles) / size);
+    /* circles of the block of each process, which differ by one when
+       size does not divide ncircles */
+    int *block_counts = (int *)mem_alloc(MEM_MPI, size * sizeof(*block_counts));
+    int *block_displs = (int *)mem_alloc(MEM_MPI, size * sizeof(*block_displs));
+    assert(block_counts != NULL && block_displs != NULL);
+    for (int r = 0; r < size; r++)
     {
-        circles = (circle_t *)malloc(ncircles * sizeof(*circles));
+        const int first = (int)(((long)r * ncircles) / size);
+        const int last = (int)(((long)(r + 1) * ncircles) / size);
+        block_counts[r] = last - first;
+        block_displs[r] = first;
     }
-    MPI_Bcast(circles, ncircles * sizeof(circle_t), MPI_BYTE, 0, MPI_COMM_WORLD);
 
+    if (mpiio_hints(&io_info, opt.io_hints) != 0)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Invalid MPI-IO hints \"%s\"\n", opt.io_hints);
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    /* The trajectory is written by all the processes; only the root
+       process draws the images and publishes the frames. */
+    if (opt.trajectory)
+    {
+        open_trajectory(&opt);
+    }
+    if (rank == 0 && (opt.render || opt.movie))
+    {
+        open_renderer(&opt);
+    }
+    if (rank == 0 && opt.publish)
+    {
+        open_ring(&opt);
+    }
+    if (opt.trace)
+    {
+        trace_open();
+        align_trace_clocks(rank, size);
+    }
+    pair_stats_t pairs, total_pairs = {0, 0, 0, 0};
+    latency_t latency;
+    if (latency_init(&latency, iterations) != 0)
+    {
+        fprintf(stderr, "Cannot allocate the latency histogram\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    /* only the root process logs the iterations: the other ones drop
+       the records */
+    telemetry_t telemetry;
+    if (telemetry_open(&telemetry, rank == 0 ? opt.telemetry : NULL, "mpi-circles") != 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
     const double tstart_prog = hpc_gettime();
 #ifdef MOVIE
-    dump_circles(0);
+    if (rank == 0)
+    {
+        circles_dump_gp(&sim, "mpi-circles", 0);
+    }
 #endif
+    write_frame(0, -1);
     for (int it = 0; it < iterations; it++)
     {
         const double tstart_iter = hpc_gettime();
 
-        reset_displacements(start, end);
-
-        int local_overlaps = compute_forces(start, end);
-        int total_overlaps;
-        /* Calculate the number of all the overlaps into all processes. */
-        MPI_Allreduce(&local_overlaps, &total_overlaps, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+        const uint64_t titer = trace_begin();
+        uint64_t tphase, tcall;
+        HPC_TIMER_BEGIN("iteration");
+        tphase = trace_begin();
+        HPC_TIMER_BEGIN("reset");
+        sim.engine->reset(&sim);
+        HPC_TIMER_END("reset");
+        trace_end("reset", "phase", tphase, it + 1);
+
+        tphase = trace_begin();
+        HPC_TIMER_BEGIN("forces");
+        pair_stats_t local_pairs;
+        sim.engine->forces(&sim, &local_pairs);
+        HPC_TIMER_ITEMS(local_pairs.tests);
+        HPC_TIMER_END("forces");
+        trace_end("forces", "phase", tphase, it + 1);
+#ifdef HPC_TIMERS
+        /* time waiting for the slowest process */
+        HPC_TIMER_BEGIN("idle");
+        tcall = trace_begin();
+        MPI_Barrier(MPI_COMM_WORLD);
+        trace_end("MPI_Barrier", "mpi", tcall, 0);
+        HPC_TIMER_END("idle");
+#endif
+        tphase = trace_begin();
+        HPC_TIMER_BEGIN("comm");
+        /* Calculate the number of all the overlaps (and of all the pairs
+           examined) into all processes. A SIGUSR1 received by any
+           process is added up by the same call, so that all of them
+           dump the state at the end of this iteration. */
+        HPC_TIMER_BEGIN("allreduce");
+        tcall = trace_begin();
+        iteration_sums_t local_sums = {local_pairs, (uint64_t)progress_pending()}, sums;
+        MPI_Allreduce(&local_sums, &sums, ITERATION_SUMS_FIELDS, MPI_UINT64_T, MPI_SUM,
+                      MPI_COMM_WORLD);
+        trace_end("MPI_Allreduce", "mpi", tcall, sizeof(local_sums));
+        HPC_TIMER_END("allreduce");
+        pairs = sums.pairs;
+        const int total_overlaps = (int)pairs.overlaps;
         /* Gather the updated circles for all processes to move them correctly. */
-        MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, circles, ncircles / size * sizeof(circle_t), MPI_BYTE, MPI_COMM_WORLD);        
-        move_circles();
+        HPC_TIMER_BEGIN("allgather");
+        tcall = trace_begin();
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, sim.records, block_counts, block_displs, circle_type, MPI_COMM_WORLD);
+        trace_end("MPI_Allgatherv", "mpi", tcall, (int64_t)block_counts[rank] * sizeof(circle_t));
+        HPC_TIMER_END("allgather");
+        HPC_TIMER_END("comm");
+        trace_end("comm", "phase", tphase, it + 1);
+        tphase = trace_begin();
+        HPC_TIMER_BEGIN("move");
+        sim.engine->move(&sim);
+        HPC_TIMER_END("move");
+        trace_end("move", "phase", tphase, it + 1);
+        HPC_TIMER_END("iteration");
+        trace_end("iteration", "phase", titer, it + 1);
         const double elapsed_iter = hpc_gettime() - tstart_iter;
+#ifdef MOVIE
         if (rank == 0)
         {
-            printf("Iteration %d of %d, %d overlaps (%f s)\n", it + 1, iterations, total_overlaps, elapsed_iter);
-#ifdef MOVIE
-            dump_circles(it + 1);
+            circles_dump_gp(&sim, "mpi-circles", it + 1);
+        }
 #endif
+        tphase = trace_begin();
+        HPC_TIMER_BEGIN("output");
+        write_frame(it + 1, total_overlaps);
+        HPC_TIMER_END("output");
+        trace_end("output", "phase", tphase, it + 1);
+        pair_stats_add(&total_pairs, &pairs);
+        /* the latency includes the output of the iteration */
+        const double latency_iter = hpc_gettime() - tstart_iter;
+        latency_record(&latency, it, latency_iter);
+        const telemetry_record_t rec = {it + 1, iterations, elapsed_iter, latency_iter, pairs};
+        telemetry_append(&telemetry, &rec);
+        if (rank == 0 && telemetry_shown(opt.verbosity, it + 1, iterations))
+        {
+            telemetry_print(stdout, &rec);
+        }
+        if (sums.dump)
+        {
+            if (rank == 0)
+            {
+                telemetry_flush(&telemetry);
+                const progress_t p = {it + 1, iterations, hpc_gettime() - tstart_prog,
+                                      total_overlaps, circles_count_active(&sim), ncircles,
+                                      &total_pairs, &latency};
+                progress_dump(stderr, &p);
+            }
+            report_timers(rank, size);
         }
     }
 
     const double elapsed_prog = hpc_gettime() - tstart_prog;
+    /* an iteration lasts as long as on its slowest process: the
+       durations are reduced once, at the end, rather than at each
+       iteration */
+    latency_t slowest;
+    if (rank == 0 && latency_init(&slowest, iterations) != 0)
+    {
+        fprintf(stderr, "Cannot allocate the latency histogram\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    MPI_Reduce(latency.iteration, rank == 0 ? slowest.iteration : NULL, iterations,
+               MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+    latency_free(&latency);
     if (rank == 0)
     {
+        for (int it = 0; it < iterations; it++)
+        {
+            latency_record_ns(&slowest, it, slowest.iteration[it]);
+        }
         printf("Elapsed time: %f\n", elapsed_prog);
+        pair_stats_print(stdout, &total_pairs, iterations);
+        latency_print(stdout, &slowest);
+        latency_free(&slowest);
+        if (opt.summary)
+        {
+            run_summary_t summary;
+            summary_init(&summary, "mpi-circles");
+            summary.procs = size;
+            summary.threads = circles_engine_threads(engine);
+            summary.ncircles = ncircles;
+            summary.iterations = iterations;
+            summary.elapsed = elapsed_prog;
+            summary.pairs = total_pairs;
+            if (summary_write(opt.summary, &summary) != 0)
+            {
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+        }
+        if (telemetry_close(&telemetry) != 0)
+        {
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        if (render_free(&render) != 0)
+        {
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        if (opt.publish)
+        {
+            shm_ring_close(&ring);
+        }
+    }
+    if (opt.trace)
+    {
+        char path[1024], name[32];
+        trace_rank_path(path, sizeof(path), opt.trace, rank);
+        snprintf(name, sizeof(name), "rank %d", rank);
+        if (trace_write(path, rank, name) != 0)
+        {
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    }
+    report_timers(rank, size);
+    if (opt.trajectory && mpiio_traj_close(&traj) != 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    if (opt.output)
+    {
+        save_circles(opt.output, iterations);
+    }
+    if (io_info != MPI_INFO_NULL)
+    {
+        MPI_Info_free(&io_info);
     }
 
-    free(circles);
+    mem_free(block_counts);
+    mem_free(block_displs);
+    MPI_Type_free(&circle_type);
+    circles_free(&sim);
+    /* each figure is the largest over the processes */
+    mem_usage_t mem, largest;
+    mem_usage(&mem);
+    MPI_Reduce(&mem, &largest, sizeof(mem) / sizeof(int64_t), MPI_INT64_T, MPI_MAX, 0,
+               MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        mem_print(stdout, "Memory (largest process)", &largest);
+    }
     MPI_Finalize();
 
     return EXIT_SUCCESS;
@@ -0,0 +1,279 @@
+/****************************************************************************
+ *
+ * mpiio.c - Collective output of snapshots and trajectories with MPI-IO
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "mpiio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memtrack.h"
+
+/**
+ * Print a message if `rc` is an MPI error; return 1 iff it is not.
+ */
+static int check(int rc, const char *path)
+{
+    if (rc == MPI_SUCCESS)
+        return 1;
+    char msg[MPI_MAX_ERROR_STRING];
+    int len;
+    MPI_Error_string(rc, msg, &len);
+    fprintf(stderr, "%s: %s\n", path, msg);
+    return 0;
+}
+
+/**
+ * Return 1 iff `ok` is nonzero on all the processes of `comm`.
+ */
+static int all_ok(MPI_Comm comm, int ok)
+{
+    int all;
+    MPI_Allreduce(&ok, &all, 1, MPI_INT, MPI_LAND, comm);
+    return all;
+}
+
+/**
+ * Compute the index of the first local circle, given that each
+ * process owns `count` circles in rank order, and the total number
+ * of circles.
+ */
+static void ownership(MPI_Comm comm, uint64_t count, uint64_t *first, uint64_t *total)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    *first = 0;
+    MPI_Exscan(&count, first, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (rank == 0)
+        *first = 0; /* the result of MPI_Exscan is undefined on rank 0 */
+    MPI_Allreduce(&count, total, 1, MPI_UINT64_T, MPI_SUM, comm);
+}
+
+/**
+ * Collectively write `size` bytes of `buf` at `offset`. The counts of
+ * MPI are int, so the bytes are written as blocks of a contiguous type
+ * followed by the remainder; every process makes the same two calls,
+ * even when it has nothing to write.
+ */
+static int write_bytes_all(MPI_File fh, MPI_Offset offset, const void *buf,
+                           uint64_t size, const char *path)
+{
+    enum { BLOCK = 1 << 20 };
+    const uint64_t nblocks = size / BLOCK, rest = size % BLOCK;
+    MPI_Datatype block;
+    MPI_Type_contiguous(BLOCK, MPI_BYTE, &block);
+    MPI_Type_commit(&block);
+    int ok = check(MPI_File_write_at_all(fh, offset, buf, (int)nblocks, block,
+                                         MPI_STATUS_IGNORE), path);
+    ok = check(MPI_File_write_at_all(fh, offset + (MPI_Offset)(nblocks * BLOCK),
+                                     (const char *)buf + nblocks * BLOCK, (int)rest,
+                                     MPI_BYTE, MPI_STATUS_IGNORE), path) && ok;
+    MPI_Type_free(&block);
+    return ok;
+}
+
+int mpiio_hints(MPI_Info *info, const char *hints)
+{
+    *info = MPI_INFO_NULL;
+    if (hints == NULL || *hints == '\0')
+        return 0;
+    char *copy = strdup(hints);
+    if (copy == NULL)
+        return -1;
+    MPI_Info_create(info);
+    int status = 0;
+    for (char *tok = strtok(copy, ","); tok != NULL; tok = strtok(NULL, ","))
+    {
+        char *eq = strchr(tok, '=');
+        if (eq == NULL || eq == tok || eq[1] == '\0')
+        {
+            status = -1;
+            break;
+        }
+        *eq = '\0';
+        MPI_Info_set(*info, tok, eq + 1);
+    }
+    free(copy);
+    if (status != 0)
+        MPI_Info_free(info);
+    return status;
+}
+
+int mpiio_snapshot_save(MPI_Comm comm, const char *path, const snapshot_header_t *hdr,
+                        const circle_view_t *local, uint64_t count, MPI_Info info)
+{
+    int rank;
+    uint64_t first, total;
+    MPI_Comm_rank(comm, &rank);
+    ownership(comm, count, &first, &total);
+
+    snapshot_header_t h = *hdr;
+    const char *base = (const char *)local->x;
+    h.ncircles = total;
+    snapshot_header_layout(&h, SNAPSHOT_AOS, local->stride,
+                           (const char *)local->y - base,
+                           (const char *)local->r - base);
+
+    MPI_File fh;
+    if (!all_ok(comm, check(MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                                          info, &fh), path)))
+        return -1;
+    /* the records are written as a contiguous type, so that more than
+       2^31 bytes per process can be written */
+    MPI_Datatype record;
+    MPI_Type_contiguous((int)local->stride, MPI_BYTE, &record);
+    MPI_Type_commit(&record);
+    int ok = check(MPI_File_set_size(fh, (MPI_Offset)h.file_size), path);
+    if (rank == 0)
+    {
+        ok = ok && check(MPI_File_write_at(fh, 0, &h, sizeof(h), MPI_BYTE,
+                                           MPI_STATUS_IGNORE), path);
+    }
+    const MPI_Offset offset = SNAPSHOT_DATA_OFFSET + first * local->stride;
+    ok = check(MPI_File_write_at_all(fh, offset, local->x, (int)count, record,
+                                     MPI_STATUS_IGNORE), path) && ok;
+    ok = check(MPI_File_close(&fh), path) && ok;
+    MPI_Type_free(&record);
+    return all_ok(comm, ok) ? 0 : -1;
+}
+
+int mpiio_traj_open(mpiio_traj_t *t, MPI_Comm comm, const char *path,
+                    const traj_header_t *hdr, const circle_view_t *local,
+                    uint64_t count, MPI_Info info)
+{
+    uint64_t total;
+    memset(t, 0, sizeof(*t));
+    t->comm = comm;
+    MPI_Comm_rank(comm, &t->rank);
+    ownership(comm, count, &t->first, &total);
+    t->count = count;
+    t->hdr = *hdr;
+    t->hdr.ncircles = total;
+    t->hdr.radii_offset = sizeof(t->hdr);
+    t->hdr.frames_offset = t->hdr.radii_offset + total * sizeof(float);
+    t->hdr.index_offset = 0;
+    t->hdr.nframes = 0;
+    if (t->hdr.every < 1)
+        t->hdr.every = 1;
+
+    float *r = (float *)mem_alloc(MEM_OUTPUT, (count + 1) * sizeof(*r));
+    int ok = r != NULL && traj_encoder_init(&t->enc, &t->hdr, t->first, count) == 0;
+    if (!ok)
+        fprintf(stderr, "%s: out of memory\n", path);
+    if (!all_ok(comm, ok) ||
+        !all_ok(comm, check(MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                                          info, &t->fh), path)))
+    {
+        traj_encoder_free(&t->enc);
+        mem_free(r);
+        return -1;
+    }
+    for (uint64_t i = 0; i < count; i++)
+    {
+        r[i] = VIEW_R(local, i);
+    }
+    ok = check(MPI_File_set_size(t->fh, 0), path);
+    if (t->rank == 0)
+    {
+        ok = ok && check(MPI_File_write_at(t->fh, 0, &t->hdr, sizeof(t->hdr), MPI_BYTE,
+                                           MPI_STATUS_IGNORE), path);
+    }
+    const MPI_Offset offset = t->hdr.radii_offset + t->first * sizeof(float);
+    ok = check(MPI_File_write_at_all(t->fh, offset, r, (int)count, MPI_FLOAT,
+                                     MPI_STATUS_IGNORE), path) && ok;
+    mem_free(r);
+    t->offset = t->hdr.frames_offset;
+    t->open = 1;
+    if (!all_ok(comm, ok))
+    {
+        mpiio_traj_close(t);
+        return -1;
+    }
+    return 0;
+}
+
+int mpiio_traj_frame(mpiio_traj_t *t, int64_t iteration, int64_t overlaps,
+                     const circle_view_t *local)
+{
+    if (iteration % t->hdr.every != 0)
+        return 0;
+    const int key = traj_is_keyframe(&t->hdr, t->hdr.nframes);
+    uint64_t size = traj_encode_block(&t->enc, local, key);
+    uint64_t before = 0, total;
+    MPI_Exscan(&size, &before, 1, MPI_UINT64_T, MPI_SUM, t->comm);
+    if (t->rank == 0)
+        before = 0;
+    MPI_Allreduce(&size, &total, 1, MPI_UINT64_T, MPI_SUM, t->comm);
+
+    int ok = 1;
+    if (t->rank == 0)
+    {
+        int nprocs;
+        MPI_Comm_size(t->comm, &nprocs);
+        traj_frame_header_t *fh = &t->frame;
+        memset(fh, 0, sizeof(*fh));
+        fh->magic = TRAJ_FRAME_MAGIC;
+        fh->flags = key ? TRAJ_KEYFRAME : 0;
+        fh->iteration = iteration;
+        fh->overlaps = overlaps;
+        fh->nblocks = nprocs;
+        fh->size = total;
+        ok = check(MPI_File_write_at(t->fh, t->offset, fh, sizeof(*fh), MPI_BYTE,
+                                     MPI_STATUS_IGNORE), "trajectory") &&
+             traj_index_append(&t->index, &t->index_cap, t->hdr.nframes, iteration,
+                               t->offset, sizeof(*fh) + total, fh->flags) == 0;
+    }
+    const MPI_Offset offset = t->offset + sizeof(traj_frame_header_t) + before;
+    ok = write_bytes_all(t->fh, offset, t->enc.buf, size, "trajectory") && ok;
+    t->offset += sizeof(traj_frame_header_t) + total;
+    t->hdr.nframes++;
+    return ok ? 0 : -1;
+}
+
+uint64_t mpiio_traj_footprint(uint64_t count, uint64_t nframes, int rank)
+{
+    return traj_encoder_footprint(count) + (count + 1) * sizeof(float) +
+           (rank == 0 ? traj_index_footprint(nframes) : 0);
+}
+
+int mpiio_traj_close(mpiio_traj_t *t)
+{
+    int ok = 1;
+    if (t->rank == 0)
+    {
+        /* the header is rewritten with the position of the index; the
+           entries are written as a contiguous type, as the records of
+           the snapshots */
+        MPI_Datatype entry;
+        MPI_Type_contiguous((int)sizeof(*t->index), MPI_BYTE, &entry);
+        MPI_Type_commit(&entry);
+        t->hdr.index_offset = t->offset;
+        ok = check(MPI_File_write_at(t->fh, t->offset, t->index, (int)t->hdr.nframes,
+                                     entry, MPI_STATUS_IGNORE), "trajectory") &&
+             check(MPI_File_write_at(t->fh, 0, &t->hdr, sizeof(t->hdr), MPI_BYTE,
+                                     MPI_STATUS_IGNORE), "trajectory");
+        MPI_Type_free(&entry);
+    }
+    ok = check(MPI_File_close(&t->fh), "trajectory") && ok;
+    traj_encoder_free(&t->enc);
+    mem_free(t->index);
+    const MPI_Comm comm = t->comm;
+    memset(t, 0, sizeof(*t));
+    return all_ok(comm, ok) ? 0 : -1;
+}
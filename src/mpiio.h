@@ -0,0 +1,110 @@
+/****************************************************************************
+ *
+ * mpiio.h - Collective output of snapshots and trajectories with MPI-IO
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Each process passes only the circles it owns, a contiguous range
+ * whose length may differ from process to process; the position of
+ * the range in the global numbering is computed with MPI_Exscan(), in
+ * rank order. Every process then writes its own part of the file with
+ * MPI_File_write_at_all(), so that nothing is gathered on rank 0 and
+ * the MPI library can aggregate the writes (collective buffering).
+ * The files are the same as those written by snapshot_save() and
+ * traj_writer_*(); in trajectories each frame has one block per
+ * process.
+ *
+ * The collective buffering can be tuned with MPI-IO hints, given as
+ * a string "key=value,key=value" (e.g. "cb_buffer_size=16777216,
+ * romio_cb_write=enable,cb_nodes=4").
+ *
+ ****************************************************************************/
+
+#ifndef MPIIO_H
+#define MPIIO_H
+
+#include <mpi.h>
+#include <stdint.h>
+#include "view.h"
+#include "snapshot.h"
+#include "trajectory.h"
+
+/* Trajectory written collectively by all the processes of `comm` */
+typedef struct
+{
+    int open;                   /* nonzero between open and close */
+    MPI_Comm comm;
+    int rank;
+    MPI_File fh;
+    traj_header_t hdr;          /* the same on all the processes */
+    traj_encoder_t enc;         /* encoder of the local block */
+    uint64_t first, count;      /* range of the local circles */
+    uint64_t offset;            /* current end of file */
+    traj_index_entry_t *index;  /* rank 0 only */
+    size_t index_cap;
+    traj_frame_header_t frame;  /* rank 0 only */
+} mpiio_traj_t;
+
+/**
+ * Create `*info` from the hints string `hints` (which may be NULL).
+ * Returns 0 on success, -1 if the string is malformed.
+ */
+int mpiio_hints(MPI_Info *info, const char *hints);
+
+/**
+ * Write the snapshot `path`, with header `hdr` (whose ncircles is
+ * ignored), in AoS layout. `local` describes the `count` circles
+ * owned by the calling process, stored as contiguous records.
+ * Collective over `comm`; returns 0 on success, -1 on failure on any
+ * process.
+ */
+int mpiio_snapshot_save(MPI_Comm comm, const char *path, const snapshot_header_t *hdr,
+                        const circle_view_t *local, uint64_t count, MPI_Info info);
+
+/**
+ * Create the trajectory `path` with header `hdr` (whose ncircles is
+ * ignored) and store the radii. `local` describes the `count` circles
+ * owned by the calling process. Collective over `comm`; returns 0 on
+ * success, -1 on failure on any process.
+ */
+int mpiio_traj_open(mpiio_traj_t *t, MPI_Comm comm, const char *path,
+                    const traj_header_t *hdr, const circle_view_t *local,
+                    uint64_t count, MPI_Info info);
+
+/**
+ * Append the local circles `local` at iteration `iteration` as the
+ * calling process' block of a new frame, unless the iteration is
+ * skipped because of subsampling. Collective; returns 0 on success,
+ * -1 if the write failed on the calling process.
+ */
+int mpiio_traj_frame(mpiio_traj_t *t, int64_t iteration, int64_t overlaps,
+                     const circle_view_t *local);
+
+/**
+ * Write the frame index and close the file. Collective; returns 0 on
+ * success, -1 on failure on any process.
+ */
+int mpiio_traj_close(mpiio_traj_t *t);
+
+/**
+ * Bytes that a process owning `count` circles allocates at most for a
+ * trajectory of `nframes` frames; only the process of rank 0 keeps
+ * the frame index.
+ */
+uint64_t mpiio_traj_footprint(uint64_t count, uint64_t nframes, int rank);
+
+#endif
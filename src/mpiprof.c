@@ -0,0 +1,561 @@
+/****************************************************************************
+ *
+ * mpiprof.c - Profiler of the MPI calls, through the PMPI interface
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Every MPI function is also available as PMPI_xxx, so a library can
+ * define its own MPI_xxx that does some bookkeeping around the call to
+ * PMPI_xxx. This file wraps the communication functions used by
+ * mpi-circles (and the usual point-to-point ones) and counts, per
+ * function and per process, the calls, the bytes sent, the time spent
+ * in the calls and the time spent waiting for the other processes
+ * (the bytes written, for the file functions).
+ * It also counts the bytes sent from each process to each other
+ * process; for collectives this is the logical volume (e.g. each
+ * process of an MPI_Allgather sends its block to all the others),
+ * whatever algorithm the library actually uses.
+ *
+ * The waiting time of a collective is measured by entering a barrier
+ * before the collective itself: the time in the barrier is the time
+ * lost waiting for the last process to arrive, and what remains is
+ * the time of the collective proper. The extra barrier costs a few
+ * microseconds per call; set MPIPROF_SYNC=0 to skip it (the waiting
+ * time is then included in the time of the call and reported as 0).
+ * Point-to-point calls report all their time as time in the call.
+ *
+ * At MPI_Finalize() rank 0 collects the counters of all the processes
+ * and prints, to stderr or to the file named by MPIPROF_OUT, one
+ * table per process, the totals per function and the communication
+ * matrix.
+ *
+ * Use it either by preloading the shared library:
+ *
+ *        mpirun -x LD_PRELOAD=./libmpiprof.so -n 4 ./mpi-circles 10000 100
+ *
+ * or by linking mpiprof.o into the program (`make mpi MPIPROF=1`).
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+enum
+{
+    F_BCAST, F_REDUCE, F_ALLREDUCE, F_GATHER, F_ALLGATHER, F_ALLGATHERV,
+    F_SCATTER, F_ALLTOALL, F_EXSCAN, F_SCAN, F_BARRIER,
+    F_SEND, F_RECV, F_ISEND, F_IRECV, F_SENDRECV, F_WAIT, F_WAITALL,
+    F_FILE_WRITE_AT, F_FILE_WRITE_AT_ALL,
+    NFUNCS
+};
+
+static const char *func_names[NFUNCS] = {
+    "MPI_Bcast", "MPI_Reduce", "MPI_Allreduce", "MPI_Gather", "MPI_Allgather",
+    "MPI_Allgatherv", "MPI_Scatter", "MPI_Alltoall", "MPI_Exscan", "MPI_Scan",
+    "MPI_Barrier", "MPI_Send", "MPI_Recv", "MPI_Isend", "MPI_Irecv",
+    "MPI_Sendrecv", "MPI_Wait", "MPI_Waitall", "MPI_File_write_at",
+    "MPI_File_write_at_all"
+};
+
+/* Counters of one function; all doubles, so that they can be gathered
+   as one array */
+typedef struct
+{
+    double calls, bytes, time, wait;
+} func_stats_t;
+
+#define STATS_FIELDS 4
+
+static func_stats_t stats[NFUNCS];
+static double *sent = NULL; /* bytes sent to each process of MPI_COMM_WORLD */
+static int world_rank = 0, world_size = 1;
+static int sync_collectives = 1;
+static double t_init;
+
+static void profiler_init(void)
+{
+    PMPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    PMPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    sent = (double *)calloc(world_size, sizeof(*sent));
+    const char *sync = getenv("MPIPROF_SYNC");
+    sync_collectives = !(sync && strcmp(sync, "0") == 0);
+    t_init = PMPI_Wtime();
+}
+
+/**
+ * Return the rank in MPI_COMM_WORLD of process `rank` of `comm`.
+ */
+static int to_world(MPI_Comm comm, int rank)
+{
+    if (comm == MPI_COMM_WORLD || rank < 0)
+        return rank;
+    MPI_Group group, world;
+    int r;
+    PMPI_Comm_group(comm, &group);
+    PMPI_Comm_group(MPI_COMM_WORLD, &world);
+    PMPI_Group_translate_ranks(group, 1, &rank, world, &r);
+    PMPI_Group_free(&group);
+    PMPI_Group_free(&world);
+    return r == MPI_UNDEFINED ? -1 : r;
+}
+
+static double type_bytes(int count, MPI_Datatype type)
+{
+    int size;
+    PMPI_Type_size(type, &size);
+    return (double)count * size;
+}
+
+/**
+ * Count `bytes` sent to process `dest` of `comm`.
+ */
+static void send_to(MPI_Comm comm, int dest, double bytes)
+{
+    const int w = to_world(comm, dest);
+    if (sent != NULL && w >= 0 && w < world_size)
+        sent[w] += bytes;
+}
+
+/**
+ * Count `bytes` sent to every other process of `comm`.
+ */
+static void send_to_all(MPI_Comm comm, double bytes)
+{
+    int rank, size;
+    PMPI_Comm_rank(comm, &rank);
+    PMPI_Comm_size(comm, &size);
+    for (int p = 0; p < size; p++)
+    {
+        if (p != rank)
+            send_to(comm, p, bytes);
+    }
+}
+
+/**
+ * Wait for all the processes of `comm` (if enabled) and return the
+ * time of the call; the waiting time is charged to function `f`.
+ */
+static double enter_collective(int f, MPI_Comm comm)
+{
+    double t = PMPI_Wtime();
+    if (sync_collectives)
+    {
+        PMPI_Barrier(comm);
+        const double now = PMPI_Wtime();
+        stats[f].wait += now - t;
+        t = now;
+    }
+    return t;
+}
+
+static void leave(int f, double start, double bytes)
+{
+    stats[f].calls++;
+    stats[f].bytes += bytes;
+    stats[f].time += PMPI_Wtime() - start;
+}
+
+int MPI_Init(int *argc, char ***argv)
+{
+    const int rc = PMPI_Init(argc, argv);
+    profiler_init();
+    return rc;
+}
+
+int MPI_Init_thread(int *argc, char ***argv, int required, int *provided)
+{
+    const int rc = PMPI_Init_thread(argc, argv, required, provided);
+    profiler_init();
+    return rc;
+}
+
+int MPI_Bcast(void *buf, int count, MPI_Datatype type, int root, MPI_Comm comm)
+{
+    const double t = enter_collective(F_BCAST, comm);
+    const int rc = PMPI_Bcast(buf, count, type, root, comm);
+    int rank, size;
+    PMPI_Comm_rank(comm, &rank);
+    PMPI_Comm_size(comm, &size);
+    double bytes = 0;
+    if (rank == root)
+    {
+        send_to_all(comm, type_bytes(count, type));
+        bytes = type_bytes(count, type) * (size - 1);
+    }
+    leave(F_BCAST, t, bytes);
+    return rc;
+}
+
+int MPI_Reduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+               MPI_Op op, int root, MPI_Comm comm)
+{
+    const double t = enter_collective(F_REDUCE, comm);
+    const int rc = PMPI_Reduce(sendbuf, recvbuf, count, type, op, root, comm);
+    int rank;
+    PMPI_Comm_rank(comm, &rank);
+    const double bytes = (rank != root) ? type_bytes(count, type) : 0;
+    if (rank != root)
+        send_to(comm, root, bytes);
+    leave(F_REDUCE, t, bytes);
+    return rc;
+}
+
+int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+                  MPI_Op op, MPI_Comm comm)
+{
+    const double t = enter_collective(F_ALLREDUCE, comm);
+    const int rc = PMPI_Allreduce(sendbuf, recvbuf, count, type, op, comm);
+    int size;
+    PMPI_Comm_size(comm, &size);
+    send_to_all(comm, type_bytes(count, type));
+    leave(F_ALLREDUCE, t, type_bytes(count, type) * (size - 1));
+    return rc;
+}
+
+int MPI_Gather(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+               void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+    const double t = enter_collective(F_GATHER, comm);
+    const int rc = PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount,
+                               recvtype, root, comm);
+    int rank;
+    PMPI_Comm_rank(comm, &rank);
+    double bytes = 0;
+    if (rank != root)
+    {
+        bytes = type_bytes(sendcount, sendtype);
+        send_to(comm, root, bytes);
+    }
+    leave(F_GATHER, t, bytes);
+    return rc;
+}
+
+int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                  void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm)
+{
+    const double t = enter_collective(F_ALLGATHER, comm);
+    const int rc = PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf, recvcount,
+                                  recvtype, comm);
+    /* with MPI_IN_PLACE the block sent is described by the receive
+       arguments */
+    const double block = (sendbuf == MPI_IN_PLACE) ? type_bytes(recvcount, recvtype)
+                                                   : type_bytes(sendcount, sendtype);
+    int size;
+    PMPI_Comm_size(comm, &size);
+    send_to_all(comm, block);
+    leave(F_ALLGATHER, t, block * (size - 1));
+    return rc;
+}
+
+int MPI_Allgatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                   void *recvbuf, const int recvcounts[], const int displs[],
+                   MPI_Datatype recvtype, MPI_Comm comm)
+{
+    const double t = enter_collective(F_ALLGATHERV, comm);
+    const int rc = PMPI_Allgatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts,
+                                   displs, recvtype, comm);
+    int rank, size;
+    PMPI_Comm_rank(comm, &rank);
+    PMPI_Comm_size(comm, &size);
+    const double block = (sendbuf == MPI_IN_PLACE) ? type_bytes(recvcounts[rank], recvtype)
+                                                   : type_bytes(sendcount, sendtype);
+    send_to_all(comm, block);
+    leave(F_ALLGATHERV, t, block * (size - 1));
+    return rc;
+}
+
+int MPI_Scatter(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                void *recvbuf, int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+    const double t = enter_collective(F_SCATTER, comm);
+    const int rc = PMPI_Scatter(sendbuf, sendcount, sendtype, recvbuf, recvcount,
+                                recvtype, root, comm);
+    int rank, size;
+    PMPI_Comm_rank(comm, &rank);
+    PMPI_Comm_size(comm, &size);
+    double bytes = 0;
+    if (rank == root)
+    {
+        send_to_all(comm, type_bytes(sendcount, sendtype));
+        bytes = type_bytes(sendcount, sendtype) * (size - 1);
+    }
+    leave(F_SCATTER, t, bytes);
+    return rc;
+}
+
+int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype, MPI_Comm comm)
+{
+    const double t = enter_collective(F_ALLTOALL, comm);
+    const int rc = PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount,
+                                 recvtype, comm);
+    const double block = (sendbuf == MPI_IN_PLACE) ? type_bytes(recvcount, recvtype)
+                                                   : type_bytes(sendcount, sendtype);
+    int size;
+    PMPI_Comm_size(comm, &size);
+    send_to_all(comm, block);
+    leave(F_ALLTOALL, t, block * (size - 1));
+    return rc;
+}
+
+int MPI_Exscan(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+               MPI_Op op, MPI_Comm comm)
+{
+    const double t = enter_collective(F_EXSCAN, comm);
+    const int rc = PMPI_Exscan(sendbuf, recvbuf, count, type, op, comm);
+    int rank, size;
+    PMPI_Comm_rank(comm, &rank);
+    PMPI_Comm_size(comm, &size);
+    /* logically, each process sends its value to the following ones */
+    const double bytes = type_bytes(count, type);
+    for (int p = rank + 1; p < size; p++)
+    {
+        send_to(comm, p, bytes);
+    }
+    leave(F_EXSCAN, t, bytes * (size - 1 - rank));
+    return rc;
+}
+
+int MPI_Scan(const void *sendbuf, void *recvbuf, int count, MPI_Datatype type,
+             MPI_Op op, MPI_Comm comm)
+{
+    const double t = enter_collective(F_SCAN, comm);
+    const int rc = PMPI_Scan(sendbuf, recvbuf, count, type, op, comm);
+    int rank, size;
+    PMPI_Comm_rank(comm, &rank);
+    PMPI_Comm_size(comm, &size);
+    const double bytes = type_bytes(count, type);
+    for (int p = rank + 1; p < size; p++)
+    {
+        send_to(comm, p, bytes);
+    }
+    leave(F_SCAN, t, bytes * (size - 1 - rank));
+    return rc;
+}
+
+int MPI_Barrier(MPI_Comm comm)
+{
+    /* a barrier is all waiting */
+    const double t = PMPI_Wtime();
+    const int rc = PMPI_Barrier(comm);
+    stats[F_BARRIER].wait += PMPI_Wtime() - t;
+    leave(F_BARRIER, t, 0);
+    return rc;
+}
+
+int MPI_Send(const void *buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm)
+{
+    const double t = PMPI_Wtime();
+    const int rc = PMPI_Send(buf, count, type, dest, tag, comm);
+    const double bytes = type_bytes(count, type);
+    send_to(comm, dest, bytes);
+    leave(F_SEND, t, bytes);
+    return rc;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype type, int source, int tag,
+             MPI_Comm comm, MPI_Status *status)
+{
+    const double t = PMPI_Wtime();
+    const int rc = PMPI_Recv(buf, count, type, source, tag, comm, status);
+    leave(F_RECV, t, 0);
+    return rc;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype type, int dest, int tag,
+              MPI_Comm comm, MPI_Request *request)
+{
+    const double t = PMPI_Wtime();
+    const int rc = PMPI_Isend(buf, count, type, dest, tag, comm, request);
+    const double bytes = type_bytes(count, type);
+    send_to(comm, dest, bytes);
+    leave(F_ISEND, t, bytes);
+    return rc;
+}
+
+int MPI_Irecv(void *buf, int count, MPI_Datatype type, int source, int tag,
+              MPI_Comm comm, MPI_Request *request)
+{
+    const double t = PMPI_Wtime();
+    const int rc = PMPI_Irecv(buf, count, type, source, tag, comm, request);
+    leave(F_IRECV, t, 0);
+    return rc;
+}
+
+int MPI_Sendrecv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, int dest,
+                 int sendtag, void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                 int source, int recvtag, MPI_Comm comm, MPI_Status *status)
+{
+    const double t = PMPI_Wtime();
+    const int rc = PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf,
+                                 recvcount, recvtype, source, recvtag, comm, status);
+    const double bytes = (dest != MPI_PROC_NULL) ? type_bytes(sendcount, sendtype) : 0;
+    if (dest != MPI_PROC_NULL)
+        send_to(comm, dest, bytes);
+    leave(F_SENDRECV, t, bytes);
+    return rc;
+}
+
+int MPI_Wait(MPI_Request *request, MPI_Status *status)
+{
+    const double t = PMPI_Wtime();
+    const int rc = PMPI_Wait(request, status);
+    leave(F_WAIT, t, 0);
+    return rc;
+}
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[])
+{
+    const double t = PMPI_Wtime();
+    const int rc = PMPI_Waitall(count, requests, statuses);
+    leave(F_WAITALL, t, 0);
+    return rc;
+}
+
+int MPI_File_write_at(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                      MPI_Datatype type, MPI_Status *status)
+{
+    const double t = PMPI_Wtime();
+    const int rc = PMPI_File_write_at(fh, offset, buf, count, type, status);
+    leave(F_FILE_WRITE_AT, t, type_bytes(count, type));
+    return rc;
+}
+
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void *buf, int count,
+                          MPI_Datatype type, MPI_Status *status)
+{
+    /* the barrier would need the communicator of the file; the
+       waiting time is included in the time of the call */
+    const double t = PMPI_Wtime();
+    const int rc = PMPI_File_write_at_all(fh, offset, buf, count, type, status);
+    leave(F_FILE_WRITE_AT_ALL, t, type_bytes(count, type));
+    return rc;
+}
+
+/**
+ * Print the counters gathered from all the processes.
+ */
+static void report(FILE *out, const func_stats_t *all, const double *matrix,
+                   const double *elapsed)
+{
+    fprintf(out, "MPI profile: %d processes, collectives %ssynchronized\n",
+            world_size, sync_collectives ? "" : "not ");
+    for (int p = 0; p < world_size; p++)
+    {
+        const func_stats_t *s = all + (size_t)p * NFUNCS;
+        double mpi_time = 0;
+        for (int f = 0; f < NFUNCS; f++)
+        {
+            mpi_time += s[f].time + s[f].wait;
+        }
+        fprintf(out, "Rank %d: %.6f s in MPI out of %.6f s (%.1f%%)\n", p, mpi_time,
+                elapsed[p], elapsed[p] > 0 ? 100.0 * mpi_time / elapsed[p] : 0.0);
+        fprintf(out, "  %-22s %10s %14s %12s %12s\n", "Function", "Calls", "Bytes",
+                "Time (s)", "Wait (s)");
+        for (int f = 0; f < NFUNCS; f++)
+        {
+            if (s[f].calls > 0)
+                fprintf(out, "  %-22s %10.0f %14.0f %12.6f %12.6f\n", func_names[f],
+                        s[f].calls, s[f].bytes, s[f].time, s[f].wait);
+        }
+    }
+    fprintf(out, "All ranks:\n  %-22s %10s %14s %12s %12s %12s %12s\n", "Function", "Calls",
+            "Bytes", "Time (s)", "Max time", "Wait (s)", "Max wait");
+    for (int f = 0; f < NFUNCS; f++)
+    {
+        func_stats_t sum = {0, 0, 0, 0};
+        double max_time = 0, max_wait = 0;
+        for (int p = 0; p < world_size; p++)
+        {
+            const func_stats_t *s = all + (size_t)p * NFUNCS + f;
+            sum.calls += s->calls;
+            sum.bytes += s->bytes;
+            sum.time += s->time;
+            sum.wait += s->wait;
+            if (s->time > max_time)
+                max_time = s->time;
+            if (s->wait > max_wait)
+                max_wait = s->wait;
+        }
+        if (sum.calls > 0)
+            fprintf(out, "  %-22s %10.0f %14.0f %12.6f %12.6f %12.6f %12.6f\n", func_names[f],
+                    sum.calls, sum.bytes, sum.time, max_time, sum.wait, max_wait);
+    }
+    fprintf(out, "Communication matrix (bytes, row = sender, column = receiver):\n%6s", "");
+    for (int q = 0; q < world_size; q++)
+    {
+        fprintf(out, " %12d", q);
+    }
+    fprintf(out, "\n");
+    for (int p = 0; p < world_size; p++)
+    {
+        fprintf(out, "%6d", p);
+        for (int q = 0; q < world_size; q++)
+        {
+            fprintf(out, " %12.0f", matrix[(size_t)p * world_size + q]);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+int MPI_Finalize(void)
+{
+    const double elapsed = PMPI_Wtime() - t_init;
+    func_stats_t *all = NULL;
+    double *matrix = NULL, *times = NULL;
+    if (world_rank == 0)
+    {
+        all = (func_stats_t *)malloc((size_t)world_size * NFUNCS * sizeof(*all));
+        matrix = (double *)malloc((size_t)world_size * world_size * sizeof(*matrix));
+        times = (double *)malloc(world_size * sizeof(*times));
+    }
+    PMPI_Gather(stats, NFUNCS * STATS_FIELDS, MPI_DOUBLE, all, NFUNCS * STATS_FIELDS,
+                MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    PMPI_Gather(sent, world_size, MPI_DOUBLE, matrix, world_size, MPI_DOUBLE, 0,
+                MPI_COMM_WORLD);
+    PMPI_Gather(&elapsed, 1, MPI_DOUBLE, times, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (world_rank == 0)
+    {
+        if (all == NULL || matrix == NULL || times == NULL)
+        {
+            fprintf(stderr, "mpiprof: out of memory\n");
+        }
+        else
+        {
+            const char *path = getenv("MPIPROF_OUT");
+            FILE *out = path ? fopen(path, "w") : stderr;
+            if (out == NULL)
+            {
+                perror(path);
+                out = stderr;
+            }
+            report(out, all, matrix, times);
+            if (out != stderr)
+                fclose(out);
+        }
+    }
+    free(all);
+    free(matrix);
+    free(times);
+    free(sent);
+    sent = NULL;
+    return PMPI_Finalize();
+}
@@ -0,0 +1,204 @@
+/****************************************************************************
+ *
+ * options.c - Command line options shared by the circles programs
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "options.h"
+#include "argutil.h"
+#include "trajectory.h"
+#include "render.h"
+#include "telemetry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void options_init(options_t *opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->ncircles = 10000;
+    opt->iterations = 20;
+    /* rand() behaves as if srand(1) was called when it is not seeded */
+    opt->seed = 1;
+    opt->traj_every = 1;
+    opt->traj_quantum = TRAJ_DEFAULT_QUANTUM;
+    opt->traj_buffers = 2;
+    opt->render_size = RENDER_DEFAULT_SIZE;
+    opt->verbosity = TELEMETRY_ALL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [ncircles [iterations]]\n"
+            "\n"
+            "Options:\n"
+            "  --input FILE    read the initial circles from FILE (a binary\n"
+            "                  snapshot or a text file of \"x y r\" lines);\n"
+            "                  ncircles is then ignored\n"
+            "  --output FILE   write the final circles to FILE as a binary snapshot\n"
+            "  --seed N        seed of the random initial configuration (default 1)\n"
+            "  --trajectory FILE\n"
+            "                  write the positions at each iteration to the\n"
+            "                  trajectory FILE (see traj2gp)\n"
+            "  --traj-every N  write one frame every N iterations (default 1)\n"
+            "  --traj-quantum Q\n"
+            "                  store positions as multiples of Q (default %g);\n"
+            "                  0 stores them without loss\n"
+            "  --traj-roi X0,Y0,X1,Y1\n"
+            "                  only store the circles whose center is inside\n"
+            "                  the given rectangle\n"
+            "  --traj-buffers N\n"
+            "                  frames are written by a separate thread through\n"
+            "                  N buffers (default 2); 0 writes them in the\n"
+            "                  simulation thread\n"
+            "  --render PATTERN\n"
+            "                  draw the circles at each iteration into the image\n"
+            "                  files named by the printf() pattern applied to the\n"
+            "                  iteration number (e.g. frame-%%05d.png); PNG if the\n"
+            "                  name ends with .png, PPM otherwise\n"
+            "  --movie FILE    draw the circles at each iteration into a movie\n"
+            "                  encoded by ffmpeg\n"
+            "  --render-size N width and height of the images (default %d)\n"
+            "  --publish NAME  publish the circles at each iteration to the\n"
+            "                  shared memory object NAME (e.g. /circles) for\n"
+            "                  live viewers (see ringview)\n"
+            "  --io-hints KEY=VALUE,...\n"
+            "                  MPI-IO hints for the output files of the MPI\n"
+            "                  program (e.g. cb_buffer_size=16777216)\n"
+            "  --trace FILE    write a timeline of the phases, OpenMP chunks and\n"
+            "                  MPI calls to FILE (JSON, see https://ui.perfetto.dev);\n"
+            "                  each MPI process writes FILE with -RANK before the\n"
+            "                  extension\n"
+            "  --summary FILE  write the elapsed time and the pair counters to\n"
+            "                  FILE, one \"key value\" per line (see bench)\n"
+            "  --telemetry FILE\n"
+            "                  log the figures of each iteration to FILE, in\n"
+            "                  binary (see telem2txt)\n"
+            "  --verbosity N   print the line of each iteration (2, default),\n"
+            "                  of one iteration in ten (1) or none (0)\n"
+            "  --engine NAME   run the iterations with the kernels NAME: serial,\n"
+            "                  omp, gather or omp-gather (default: the kernels\n"
+            "                  the program is named after; mpi-circles accepts\n"
+            "                  gather and omp-gather)\n"
+            "  --dry-run P     print the memory that the run would need with P\n"
+            "                  threads (omp-circles) or processes (mpi-circles),\n"
+            "                  and exit without running it\n"
+            "  --batch K       advance K iterations at a time with circles_step(),\n"
+            "                  without the timers and the trace of each iteration;\n"
+            "                  the frames are those of the last iteration of each\n"
+            "                  batch, the figures are summed over it (circles and\n"
+            "                  omp-circles only)\n",
+            prog, TRAJ_DEFAULT_QUANTUM, RENDER_DEFAULT_SIZE);
+}
+
+int options_parse(options_t *opt, int argc, char *argv[])
+{
+    int npos = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *val = NULL;
+        int m;
+        if (strncmp(argv[i], "--", 2) != 0)
+        {
+            if (npos == 0)
+                opt->ncircles = atoi(argv[i]);
+            else if (npos == 1)
+                opt->iterations = atoi(argv[i]);
+            else
+                goto fail;
+            npos++;
+            continue;
+        }
+        if ((m = arg_match("--input", argc, argv, &i, &val)) != 0)
+            opt->input = val;
+        else if ((m = arg_match("--output", argc, argv, &i, &val)) != 0)
+            opt->output = val;
+        else if ((m = arg_match("--seed", argc, argv, &i, &val)) != 0)
+            opt->seed = strtoul(val, NULL, 10);
+        else if ((m = arg_match("--trajectory", argc, argv, &i, &val)) != 0)
+            opt->trajectory = val;
+        else if ((m = arg_match("--traj-every", argc, argv, &i, &val)) != 0)
+            opt->traj_every = atoi(val);
+        else if ((m = arg_match("--traj-quantum", argc, argv, &i, &val)) != 0)
+            opt->traj_quantum = atof(val);
+        else if ((m = arg_match("--traj-roi", argc, argv, &i, &val)) != 0)
+            opt->traj_roi = val;
+        else if ((m = arg_match("--traj-buffers", argc, argv, &i, &val)) != 0)
+            opt->traj_buffers = atoi(val);
+        else if ((m = arg_match("--render-size", argc, argv, &i, &val)) != 0)
+            opt->render_size = atoi(val);
+        else if ((m = arg_match("--render", argc, argv, &i, &val)) != 0)
+            opt->render = val;
+        else if ((m = arg_match("--movie", argc, argv, &i, &val)) != 0)
+            opt->movie = val;
+        else if ((m = arg_match("--publish", argc, argv, &i, &val)) != 0)
+            opt->publish = val;
+        else if ((m = arg_match("--io-hints", argc, argv, &i, &val)) != 0)
+            opt->io_hints = val;
+        else if ((m = arg_match("--trace", argc, argv, &i, &val)) != 0)
+            opt->trace = val;
+        else if ((m = arg_match("--summary", argc, argv, &i, &val)) != 0)
+            opt->summary = val;
+        else if ((m = arg_match("--telemetry", argc, argv, &i, &val)) != 0)
+            opt->telemetry = val;
+        else if ((m = arg_match("--verbosity", argc, argv, &i, &val)) != 0)
+            opt->verbosity = atoi(val);
+        else if ((m = arg_match("--engine", argc, argv, &i, &val)) != 0)
+            opt->engine = val;
+        else if ((m = arg_match("--dry-run", argc, argv, &i, &val)) != 0)
+            opt->dry_run = atoi(val);
+        else if ((m = arg_match("--batch", argc, argv, &i, &val)) != 0)
+            opt->batch = atoi(val);
+        else
+        {
+            fprintf(stderr, "%s: unknown option %s\n", argv[0], argv[i]);
+            goto fail;
+        }
+        if (m < 0)
+            goto fail;
+    }
+    if (opt->traj_every < 1 || opt->traj_quantum < 0 || opt->traj_buffers < 0)
+    {
+        fprintf(stderr, "%s: invalid trajectory options\n", argv[0]);
+        goto fail;
+    }
+    if (opt->render_size < 1)
+    {
+        fprintf(stderr, "%s: invalid image size\n", argv[0]);
+        goto fail;
+    }
+    if (opt->verbosity < TELEMETRY_QUIET || opt->verbosity > TELEMETRY_ALL)
+    {
+        fprintf(stderr, "%s: invalid verbosity\n", argv[0]);
+        goto fail;
+    }
+    if (opt->dry_run < 0)
+    {
+        fprintf(stderr, "%s: invalid number of threads or processes\n", argv[0]);
+        goto fail;
+    }
+    if (opt->batch < 0)
+    {
+        fprintf(stderr, "%s: invalid batch\n", argv[0]);
+        goto fail;
+    }
+    return 0;
+fail:
+    usage(argv[0]);
+    return -1;
+}
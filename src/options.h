@@ -0,0 +1,73 @@
+/****************************************************************************
+ *
+ * options.h - Command line options shared by the circles programs
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * All programs accept the same command line:
+ *
+ *        prog [options] [ncircles [iterations]]
+ *
+ * Options can be given anywhere, either as `--name value` or as
+ * `--name=value`.
+ *
+ ****************************************************************************/
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+typedef struct
+{
+    int ncircles;           /* number of circles (ignored with --input) */
+    int iterations;         /* number of iterations */
+    unsigned seed;          /* seed for init_circles() */
+    const char *input;      /* --input: initial state */
+    const char *output;     /* --output: snapshot of the final state */
+    const char *trajectory; /* --trajectory: trajectory file */
+    int traj_every;         /* --traj-every: iterations between two frames */
+    float traj_quantum;     /* --traj-quantum: quantization step, 0 = lossless */
+    const char *traj_roi;   /* --traj-roi: region of interest "x0,y0,x1,y1" */
+    int traj_buffers;       /* --traj-buffers: frame buffers of the writer thread */
+    const char *render;     /* --render: file names of the images, e.g. "f-%05d.png" */
+    const char *movie;      /* --movie: movie encoded by ffmpeg */
+    int render_size;        /* --render-size: width and height of the images */
+    const char *publish;    /* --publish: shared memory object for live viewers */
+    const char *io_hints;   /* --io-hints: MPI-IO hints "key=value,..." */
+    const char *trace;      /* --trace: timeline in Chrome Trace Event format */
+    const char *summary;    /* --summary: figures of the run for bench */
+    const char *telemetry;  /* --telemetry: binary log of the iterations */
+    int verbosity;          /* --verbosity: lines printed per run, see telemetry.h */
+    const char *engine;     /* --engine: kernels of the simulation, NULL = the
+                               default of the program (see libcircles.h) */
+    int dry_run;            /* --dry-run: threads or processes of the memory
+                               estimate, 0 = run the simulation */
+    int batch;              /* --batch: iterations of each circles_step(),
+                               0 = one circles_iterate() per iteration */
+} options_t;
+
+/**
+ * Initialize `opt` with the default values.
+ */
+void options_init(options_t *opt);
+
+/**
+ * Parse the command line into `opt`; returns 0 on success, -1 (after
+ * printing a usage message) on failure.
+ */
+int options_parse(options_t *opt, int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,52 @@
+/****************************************************************************
+ *
+ * pairstats.c - Counters of the pairs of circles examined by a kernel
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "pairstats.h"
+
+void pair_stats_add(pair_stats_t *dst, const pair_stats_t *src)
+{
+    dst->candidates += src->candidates;
+    dst->tests += src->tests;
+    dst->sqrts += src->sqrts;
+    dst->overlaps += src->overlaps;
+}
+
+double pair_stats_pruned(const pair_stats_t *s)
+{
+    if (s->candidates == 0)
+        return 0.0;
+    return 100.0 * (double)(s->candidates - s->tests) / s->candidates;
+}
+
+double pair_stats_hits(const pair_stats_t *s)
+{
+    if (s->tests == 0)
+        return 0.0;
+    return 100.0 * (double)s->overlaps / s->tests;
+}
+
+void pair_stats_print(FILE *out, const pair_stats_t *s, int iterations)
+{
+    const double it = iterations > 0 ? iterations : 1;
+    fprintf(out, "Pairs per iteration: %.0f candidates, %.0f tests, %.0f square roots, "
+                 "%.0f overlaps (%.4f%% of the tests overlap, %.1f%% of the candidates not tested)\n",
+            s->candidates / it, s->tests / it, s->sqrts / it, s->overlaps / it,
+            pair_stats_hits(s), pair_stats_pruned(s));
+}
@@ -0,0 +1,71 @@
+/****************************************************************************
+ *
+ * pairstats.h - Counters of the pairs of circles examined by a kernel
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * A force kernel first generates candidate pairs of circles (the
+ * broad phase: the loops, or a spatial index), then tests some of
+ * them for overlap (the narrow phase), which needs the distance and
+ * thus a square root. The counters tell how much of that work was
+ * wasted: candidates discarded without a test are pruned, tests that
+ * find no overlap are misses. Each thread counts into its own copy,
+ * and the copies are added at the end of the iteration.
+ *
+ ****************************************************************************/
+
+#ifndef PAIRSTATS_H
+#define PAIRSTATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* The fields are all uint64_t, so that MPI can reduce them as an
+   array of PAIR_STATS_FIELDS MPI_UINT64_T */
+typedef struct
+{
+    uint64_t candidates; /* pairs generated by the broad phase */
+    uint64_t tests;      /* pairs tested for overlap */
+    uint64_t sqrts;      /* distances computed */
+    uint64_t overlaps;   /* tests that found an overlap */
+} pair_stats_t;
+
+#define PAIR_STATS_FIELDS 4
+
+/**
+ * Add the counters of `src` to those of `dst`.
+ */
+void pair_stats_add(pair_stats_t *dst, const pair_stats_t *src);
+
+/**
+ * Percentage of the candidate pairs that were not tested. With the
+ * all-pairs loops this is not pruning by a broad phase: the `omp`
+ * engine, for instance, discards the half j <= i of its n^2 loop.
+ */
+double pair_stats_pruned(const pair_stats_t *s);
+
+/**
+ * Percentage of the tests that found an overlap.
+ */
+double pair_stats_hits(const pair_stats_t *s);
+
+/**
+ * Print the counters `s` accumulated over `iterations` iterations.
+ */
+void pair_stats_print(FILE *out, const pair_stats_t *s, int iterations);
+
+#endif
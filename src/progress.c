@@ -0,0 +1,72 @@
+/****************************************************************************
+ *
+ * progress.c - Dump of the state of a run on request (SIGUSR1)
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "progress.h"
+#include <signal.h>
+#include <string.h>
+#include "memtrack.h"
+
+static volatile sig_atomic_t requested = 0;
+
+static void on_sigusr1(int sig)
+{
+    (void)sig;
+    requested = 1;
+}
+
+int progress_install(void)
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigusr1;
+    sigemptyset(&sa.sa_mask);
+    /* the writes and the MPI calls interrupted by the signal go on */
+    sa.sa_flags = SA_RESTART;
+    return sigaction(SIGUSR1, &sa, NULL);
+}
+
+int progress_pending(void)
+{
+    if (!requested)
+        return 0;
+    requested = 0;
+    return 1;
+}
+
+void progress_dump(FILE *out, const progress_t *p)
+{
+    const double per_iter = p->done > 0 ? p->elapsed / p->done : 0.0;
+    const int left = p->iterations - p->done;
+    fprintf(out, "Progress: %d of %d iterations (%.1f%%), %f s elapsed, "
+                 "%f s per iteration, ETA %f s\n",
+            p->done, p->iterations,
+            p->iterations > 0 ? 100.0 * p->done / p->iterations : 100.0,
+            p->elapsed, per_iter, left * per_iter);
+    fprintf(out, "Last iteration: %d overlaps, %d of %d circles moved (%.1f%%)\n",
+            p->overlaps, p->active, p->ncircles,
+            p->ncircles > 0 ? 100.0 * p->active / p->ncircles : 0.0);
+    pair_stats_print(out, p->pairs, p->done);
+    latency_print(out, p->latency);
+    mem_usage_t mem;
+    mem_usage(&mem);
+    mem_print(out, "Memory", &mem);
+    fflush(out);
+}
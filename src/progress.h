@@ -0,0 +1,63 @@
+/****************************************************************************
+ *
+ * progress.h - Dump of the state of a run on request (SIGUSR1)
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * `kill -USR1 PID` asks a running program where it is. The signal
+ * handler only sets a flag; the program polls it with
+ * progress_pending() at the end of each iteration, when the counters
+ * are consistent, and prints the progress, an estimate of the time
+ * left, the counters and the latency so far with progress_dump(),
+ * followed by its phase timers.
+ *
+ ****************************************************************************/
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdio.h>
+#include "pairstats.h"
+#include "latency.h"
+
+typedef struct
+{
+    int done, iterations;        /* iterations completed, and requested */
+    double elapsed;              /* seconds since the first iteration */
+    int overlaps;                /* overlaps of the last iteration */
+    int active, ncircles;        /* circles moved by the last iteration */
+    const pair_stats_t *pairs;   /* pairs examined so far */
+    const latency_t *latency;    /* durations of the iterations so far */
+} progress_t;
+
+/**
+ * Install the handler of SIGUSR1. Returns 0 on success, -1 on failure.
+ */
+int progress_install(void);
+
+/**
+ * Return nonzero, and forget the request, if SIGUSR1 has been
+ * received since the last call.
+ */
+int progress_pending(void);
+
+/**
+ * Print the state `p` of the run on `out`.
+ */
+void progress_dump(FILE *out, const progress_t *p);
+
+#endif
@@ -0,0 +1,430 @@
+/****************************************************************************
+ *
+ * render.c - Parallel rasterizer of a set of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "render.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include "memtrack.h"
+
+/* Half width of the outlines, in pixels */
+#define LINE_HALF_WIDTH 0.75f
+
+/* Colors: gnuplot's first line type on a white background */
+static const uint8_t BACKGROUND[3] = {255, 255, 255};
+static const uint8_t LINE[3] = {148, 0, 211};
+
+int render_init(renderer_t *rd, int size, float xmin, float xmax, float ymin, float ymax)
+{
+    memset(rd, 0, sizeof(*rd));
+    const float width = xmax - xmin;
+    const float height = ymax - ymin;
+    /* same window as the gnuplot files: 20% margin on each side */
+    const float wx0 = xmin - width * .2f, wx1 = xmax + width * .2f;
+    const float wy0 = ymin - height * .2f, wy1 = ymax + height * .2f;
+    const float extent = fmaxf(wx1 - wx0, wy1 - wy0);
+    rd->size = size;
+    rd->scale = size / extent;
+    rd->x0 = (wx0 + wx1 - extent) / 2;
+    rd->y1 = (wy0 + wy1 + extent) / 2;
+    rd->ntiles = (size + RENDER_TILE - 1) / RENDER_TILE;
+    const size_t nbins = (size_t)rd->ntiles * rd->ntiles;
+    rd->pixels = (uint8_t *)mem_alloc(MEM_OUTPUT, (size_t)3 * size * size);
+    rd->bin_start = (size_t *)mem_alloc(MEM_OUTPUT, (nbins + 1) * sizeof(*rd->bin_start));
+    rd->bin_fill = (size_t *)mem_alloc(MEM_OUTPUT, nbins * sizeof(*rd->bin_fill));
+    if (size <= 0 || rd->pixels == NULL || rd->bin_start == NULL || rd->bin_fill == NULL)
+    {
+        render_free(rd);
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t render_footprint(int size, uint64_t n)
+{
+    const uint64_t ntiles = (size + RENDER_TILE - 1) / RENDER_TILE;
+    const uint64_t nbins = ntiles * ntiles;
+    return (uint64_t)3 * size * size + (2 * nbins + 1) * sizeof(size_t) + n * sizeof(uint32_t);
+}
+
+/**
+ * Pixel bounding box of the outline of circle (x, y, r), clipped to
+ * the image, as tile indices. Returns 0 if the outline is not visible.
+ */
+static int tile_range(const renderer_t *rd, float x, float y, float r,
+                      int *tx0, int *ty0, int *tx1, int *ty1)
+{
+    const float cx = (x - rd->x0) * rd->scale;
+    const float cy = (rd->y1 - y) * rd->scale;
+    const float ro = r * rd->scale + LINE_HALF_WIDTH + 1;
+    const float last = rd->size - 1;
+    if (cx + ro < 0 || cy + ro < 0 || cx - ro > last || cy - ro > last)
+        return 0;
+    *tx0 = (int)fmaxf(cx - ro, 0) / RENDER_TILE;
+    *ty0 = (int)fmaxf(cy - ro, 0) / RENDER_TILE;
+    *tx1 = (int)fminf(cx + ro, last) / RENDER_TILE;
+    *ty1 = (int)fminf(cy + ro, last) / RENDER_TILE;
+    return 1;
+}
+
+/**
+ * Build the lists of the circles touching each tile.
+ */
+static int bin_circles(renderer_t *rd, const circle_view_t *v, size_t n)
+{
+    const int nt = rd->ntiles;
+    const size_t nbins = (size_t)nt * nt;
+    int tx0, ty0, tx1, ty1;
+
+    memset(rd->bin_fill, 0, nbins * sizeof(*rd->bin_fill));
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!tile_range(rd, VIEW_X(v, i), VIEW_Y(v, i), VIEW_R(v, i), &tx0, &ty0, &tx1, &ty1))
+            continue;
+        for (int ty = ty0; ty <= ty1; ty++)
+        {
+            for (int tx = tx0; tx <= tx1; tx++)
+                rd->bin_fill[(size_t)ty * nt + tx]++;
+        }
+    }
+    rd->bin_start[0] = 0;
+    for (size_t b = 0; b < nbins; b++)
+    {
+        rd->bin_start[b + 1] = rd->bin_start[b] + rd->bin_fill[b];
+        rd->bin_fill[b] = rd->bin_start[b];
+    }
+    if (rd->bin_start[nbins] > rd->bin_cap)
+    {
+        uint32_t *p = (uint32_t *)mem_realloc(MEM_OUTPUT, rd->bin,
+                                              rd->bin_start[nbins] * sizeof(*p));
+        if (p == NULL)
+            return -1;
+        rd->bin = p;
+        rd->bin_cap = rd->bin_start[nbins];
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!tile_range(rd, VIEW_X(v, i), VIEW_Y(v, i), VIEW_R(v, i), &tx0, &ty0, &tx1, &ty1))
+            continue;
+        for (int ty = ty0; ty <= ty1; ty++)
+        {
+            for (int tx = tx0; tx <= tx1; tx++)
+                rd->bin[rd->bin_fill[(size_t)ty * nt + tx]++] = (uint32_t)i;
+        }
+    }
+    return 0;
+}
+
+static inline void blend(uint8_t *p, float a)
+{
+    for (int c = 0; c < 3; c++)
+        p[c] = (uint8_t)(p[c] + (LINE[c] - p[c]) * a + .5f);
+}
+
+/**
+ * Draw the pixels [x0, x1] of row `py` (clipped to the tile) that are
+ * close to the circumference of radius `rp` centered in (cx, cy).
+ */
+static void draw_span(renderer_t *rd, int py, float x0, float x1,
+                      float cx, float cy, float rp, int tx0, int tx1)
+{
+    const int a = (int)fmaxf(floorf(x0), (float)tx0);
+    const int b = (int)fminf(ceilf(x1), (float)tx1);
+    const float dy = py + .5f - cy;
+    uint8_t *row = rd->pixels + (size_t)3 * py * rd->size;
+    for (int px = a; px <= b; px++)
+    {
+        const float dx = px + .5f - cx;
+        const float d = fabsf(sqrtf(dx * dx + dy * dy) - rp);
+        const float cov = LINE_HALF_WIDTH + .5f - d;
+        if (cov > 0)
+            blend(row + 3 * px, fminf(cov, 1));
+    }
+}
+
+static void draw_tile(renderer_t *rd, const circle_view_t *v, int tx, int ty)
+{
+    const int nt = rd->ntiles;
+    const size_t b = (size_t)ty * nt + tx;
+    const int px0 = tx * RENDER_TILE, py0 = ty * RENDER_TILE;
+    const int px1 = (px0 + RENDER_TILE < rd->size ? px0 + RENDER_TILE : rd->size) - 1;
+    const int py1 = (py0 + RENDER_TILE < rd->size ? py0 + RENDER_TILE : rd->size) - 1;
+
+    for (int py = py0; py <= py1; py++)
+    {
+        uint8_t *row = rd->pixels + (size_t)3 * py * rd->size;
+        for (int px = px0; px <= px1; px++)
+            memcpy(row + 3 * px, BACKGROUND, 3);
+    }
+    for (size_t k = rd->bin_start[b]; k < rd->bin_start[b + 1]; k++)
+    {
+        const uint32_t i = rd->bin[k];
+        const float cx = (VIEW_X(v, i) - rd->x0) * rd->scale;
+        const float cy = (rd->y1 - VIEW_Y(v, i)) * rd->scale;
+        const float rp = VIEW_R(v, i) * rd->scale;
+        /* only the pixels of the annulus ri <= d <= ro can be covered */
+        const float ro = rp + LINE_HALF_WIDTH + .5f;
+        const float ri = rp - LINE_HALF_WIDTH - .5f;
+        const int ya = (int)fmaxf(floorf(cy - ro), (float)py0);
+        const int yb = (int)fminf(ceilf(cy + ro), (float)py1);
+        for (int py = ya; py <= yb; py++)
+        {
+            const float dy = py + .5f - cy;
+            if (fabsf(dy) > ro)
+                continue;
+            const float xo = sqrtf(ro * ro - dy * dy);
+            if (ri > 0 && fabsf(dy) < ri)
+            {
+                /* the row crosses the annulus twice */
+                const float xi = sqrtf(ri * ri - dy * dy);
+                draw_span(rd, py, cx - xo, cx - xi, cx, cy, rp, px0, px1);
+                draw_span(rd, py, cx + xi, cx + xo, cx, cy, rp, px0, px1);
+            }
+            else
+            {
+                draw_span(rd, py, cx - xo, cx + xo, cx, cy, rp, px0, px1);
+            }
+        }
+    }
+}
+
+int render_frame(renderer_t *rd, const circle_view_t *v, size_t n)
+{
+    if (bin_circles(rd, v, n) != 0)
+        return -1;
+    const int nt = rd->ntiles;
+#pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < nt * nt; t++)
+    {
+        draw_tile(rd, v, t % nt, t / nt);
+    }
+    return 0;
+}
+
+/**
+ * CRC-32 as used by PNG.
+ */
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t len)
+{
+    static uint32_t table[256];
+    if (table[1] == 0)
+    {
+        for (uint32_t k = 0; k < 256; k++)
+        {
+            uint32_t c = k;
+            for (int j = 0; j < 8; j++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[k] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+        crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/**
+ * Write a PNG chunk of type `type` made of `len` bytes of `data`.
+ */
+static void png_chunk(FILE *f, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t hdr[8];
+    put_be32(hdr, len);
+    memcpy(hdr + 4, type, 4);
+    uint32_t crc = crc32_update(0, hdr + 4, 4);
+    crc = crc32_update(crc, data, len);
+    fwrite(hdr, 1, sizeof(hdr), f);
+    fwrite(data, 1, len, f);
+    put_be32(hdr, crc);
+    fwrite(hdr, 1, 4, f);
+}
+
+/* Largest stored deflate block (its length is a 16-bit field) */
+#define PNG_BLOCK 65535
+/* Largest IDAT chunk written; longer streams are split among chunks */
+#define PNG_IDAT_MAX (1u << 30)
+
+/**
+ * Write the image as a PNG whose zlib stream is made of stored
+ * (uncompressed) deflate blocks of at most PNG_BLOCK bytes of
+ * scanlines: no compression library is needed, and the files are
+ * about as large as a PPM. Returns 0 on success, -1 if the stream
+ * cannot be allocated.
+ */
+static int write_png(const renderer_t *rd, FILE *f)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    const uint32_t size = rd->size;
+    const size_t rowlen = 1 + (size_t)3 * size; /* filter byte + pixels */
+    const size_t raw = size * rowlen;
+    const size_t nblocks = (raw + PNG_BLOCK - 1) / PNG_BLOCK;
+    const size_t zlen = 2 + 5 * nblocks + raw + 4;
+    uint8_t *zdata = (uint8_t *)malloc(zlen);
+    if (zdata == NULL)
+        return -1;
+    uint8_t *p = zdata;
+    uint32_t a = 1, b = 0; /* Adler-32 */
+    *p++ = 0x78;
+    *p++ = 0x01;
+    for (size_t o = 0; o < raw;)
+    {
+        const size_t len = raw - o < PNG_BLOCK ? raw - o : PNG_BLOCK;
+        *p++ = (o + len == raw); /* BFINAL on the last block, BTYPE = stored */
+        *p++ = (uint8_t)len;
+        *p++ = (uint8_t)(len >> 8);
+        *p++ = (uint8_t)~len;
+        *p++ = (uint8_t)(~len >> 8);
+        /* the blocks need not start at the beginning of a row */
+        const uint8_t *block = p;
+        for (size_t done = 0; done < len;)
+        {
+            const size_t y = (o + done) / rowlen, col = (o + done) % rowlen;
+            size_t k = 1;
+            if (col == 0)
+            {
+                *p = 0; /* no filter */
+            }
+            else
+            {
+                k = rowlen - col < len - done ? rowlen - col : len - done;
+                memcpy(p, rd->pixels + 3 * y * size + (col - 1), k);
+            }
+            p += k;
+            done += k;
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            a = (a + block[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        o += len;
+    }
+    put_be32(p, (b << 16) | a);
+
+    uint8_t ihdr[13];
+    put_be32(ihdr, size);
+    put_be32(ihdr + 4, size);
+    ihdr[8] = 8;  /* bit depth */
+    ihdr[9] = 2;  /* truecolor */
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    fwrite(signature, 1, sizeof(signature), f);
+    png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    for (size_t o = 0; o < zlen; o += PNG_IDAT_MAX)
+    {
+        const size_t len = zlen - o < PNG_IDAT_MAX ? zlen - o : PNG_IDAT_MAX;
+        png_chunk(f, "IDAT", zdata + o, (uint32_t)len);
+    }
+    png_chunk(f, "IEND", NULL, 0);
+    free(zdata);
+    return 0;
+}
+
+int render_write(const renderer_t *rd, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    const size_t len = strlen(path);
+    if (len >= 4 && strcmp(path + len - 4, ".png") == 0)
+    {
+        if (write_png(rd, f) != 0)
+        {
+            fprintf(stderr, "%s: cannot allocate the image data\n", path);
+            fclose(f);
+            remove(path);
+            return -1;
+        }
+    }
+    else
+    {
+        fprintf(f, "P6\n%d %d\n255\n", rd->size, rd->size);
+        fwrite(rd->pixels, 3, (size_t)rd->size * rd->size, f);
+    }
+    if (ferror(f) | fclose(f))
+    {
+        fprintf(stderr, "%s: write failed\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+int render_movie_open(renderer_t *rd, const char *movie)
+{
+    char cmd[1024];
+    if (strchr(movie, '\'') != NULL)
+    {
+        fprintf(stderr, "%s: invalid movie file name\n", movie);
+        return -1;
+    }
+    snprintf(cmd, sizeof(cmd),
+             "ffmpeg -loglevel error -y -f rawvideo -pix_fmt rgb24 -s %dx%d -r %d -i - "
+             "-vcodec mpeg4 -q:v 2 '%s'",
+             rd->size, rd->size, RENDER_FPS, movie);
+    /* if ffmpeg exits early, report a write error instead of dying */
+    signal(SIGPIPE, SIG_IGN);
+    rd->pipe = popen(cmd, "w");
+    if (rd->pipe == NULL)
+    {
+        fprintf(stderr, "cannot run ffmpeg: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int render_movie_frame(renderer_t *rd)
+{
+    const size_t npix = (size_t)rd->size * rd->size;
+    if (fwrite(rd->pixels, 3, npix, rd->pipe) != npix)
+    {
+        fprintf(stderr, "ffmpeg: write failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+int render_free(renderer_t *rd)
+{
+    int status = 0;
+    if (rd->pipe != NULL && pclose(rd->pipe) != 0)
+    {
+        fprintf(stderr, "ffmpeg failed\n");
+        status = -1;
+    }
+    mem_free(rd->pixels);
+    mem_free(rd->bin_start);
+    mem_free(rd->bin_fill);
+    mem_free(rd->bin);
+    memset(rd, 0, sizeof(*rd));
+    return status;
+}
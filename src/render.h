@@ -0,0 +1,107 @@
+/****************************************************************************
+ *
+ * render.h - Parallel rasterizer of a set of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Draws the outlines of the circles into an RGB image, as the gnuplot
+ * files written by dump_circles() do: the visible window is the
+ * domain enlarged by 20% on each side, and the image is square.
+ *
+ * The image is split into RENDER_TILE x RENDER_TILE tiles. Each frame
+ * the circles are binned to the tiles their outline touches, and the
+ * tiles are drawn in parallel by the OpenMP threads; a tile is only
+ * written by one thread, and the circles of a tile are drawn in the
+ * order of the input, so the result does not depend on the number of
+ * threads. Outlines are anti-aliased by weighting each pixel with its
+ * distance from the circumference.
+ *
+ * Frames can be saved as PPM or PNG images, or piped as raw RGB video
+ * into ffmpeg.
+ *
+ ****************************************************************************/
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "view.h"
+
+#define RENDER_TILE 64
+#define RENDER_DEFAULT_SIZE 640
+#define RENDER_FPS 25
+
+typedef struct
+{
+    int size;                   /* width and height of the image */
+    float x0, y1;               /* domain coordinates of the top left corner */
+    float scale;                /* pixels per domain unit */
+    uint8_t *pixels;            /* [3*size*size] RGB, row by row from the top */
+    int ntiles;                 /* tiles per side */
+    size_t *bin_start;          /* [ntiles*ntiles+1] start of each bin in bin[] */
+    size_t *bin_fill;           /* [ntiles*ntiles] scratch for binning */
+    uint32_t *bin;              /* circle indices, grouped by tile */
+    size_t bin_cap;
+    FILE *pipe;                 /* ffmpeg, if frames are encoded to a movie */
+} renderer_t;
+
+/**
+ * Prepare `rd` to draw images of `size` x `size` pixels of the domain
+ * [xmin, xmax] x [ymin, ymax]. Returns 0 on success, -1 on failure.
+ */
+int render_init(renderer_t *rd, int size, float xmin, float xmax, float ymin, float ymax);
+
+/**
+ * Bytes allocated by a renderer of `size` x `size` pixels for `n`
+ * circles, each of which covers a single tile.
+ */
+uint64_t render_footprint(int size, uint64_t n);
+
+/**
+ * Draw the `n` circles described by `v` into `rd->pixels`. Returns 0
+ * on success, -1 if out of memory.
+ */
+int render_frame(renderer_t *rd, const circle_view_t *v, size_t n);
+
+/**
+ * Save the current image to `path`, as PNG if the name ends with
+ * ".png", as binary PPM otherwise. Returns 0 on success, -1 on
+ * failure (a message is printed on stderr).
+ */
+int render_write(const renderer_t *rd, const char *path);
+
+/**
+ * Start ffmpeg to encode the following frames into `movie`. Returns
+ * 0 on success, -1 on failure.
+ */
+int render_movie_open(renderer_t *rd, const char *movie);
+
+/**
+ * Append the current image to the movie. Returns 0 on success, -1 on
+ * failure.
+ */
+int render_movie_frame(renderer_t *rd);
+
+/**
+ * Release the resources of `rd`, waiting for ffmpeg to finish if a
+ * movie is being encoded. Returns 0 on success, -1 if ffmpeg failed.
+ */
+int render_free(renderer_t *rd);
+
+#endif
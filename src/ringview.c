@@ -0,0 +1,140 @@
+/****************************************************************************
+ *
+ * ringview.c - Watch a running simulation through its shared memory ring
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***
+% Live viewer of the circles
+% Alessandro Monticelli
+
+Attaches to the shared memory ring of a program started with
+`--publish NAME` and, a few times per second, takes the newest frame
+and prints a summary of it (iteration, overlaps, centroid and
+bounding box of the circles). If IMAGE is given, the frame is also
+drawn into IMAGE (PNG or PPM, see render.h), which is overwritten
+each time and can be kept open in an image viewer that reloads it.
+The viewer never slows the simulation down: frames published while
+it is busy are simply skipped. It exits when the simulation ends.
+
+To compile:
+
+        gcc -std=c99 -fopenmp -Wall -Wpedantic ringview.c shmring.c render.c memtrack.c -o ringview -lm -lrt -pthread
+
+To execute:
+
+        ./ringview NAME [IMAGE]
+
+for example:
+
+        ./omp-circles 10000 1000 --publish /circles &
+        ./ringview /circles live.png
+
+***/
+
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "shmring.h"
+#include "render.h"
+
+/* Time between two looks at the ring, in nanoseconds */
+#define POLL_NS 100000000L
+
+/**
+ * Print a one-line summary of frame `v` of `n` circles.
+ */
+void summarize(const shm_slot_header_t *info, const circle_view_t *v, uint64_t n)
+{
+    double sx = 0, sy = 0;
+    float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        const float x = VIEW_X(v, i), y = VIEW_Y(v, i);
+        sx += x;
+        sy += y;
+        if (i == 0 || x < x0) x0 = x;
+        if (i == 0 || x > x1) x1 = x;
+        if (i == 0 || y < y0) y0 = y;
+        if (i == 0 || y > y1) y1 = y;
+    }
+    if (n > 0)
+    {
+        sx /= n;
+        sy /= n;
+    }
+    printf("Iteration %lld, frame %llu, %lld overlaps, centroid (%f, %f), "
+           "bounding box [%f, %f] x [%f, %f]\n",
+           (long long)info->iteration, (unsigned long long)info->frame,
+           (long long)info->overlaps, sx, sy, x0, x1, y0, y1);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    shm_ring_t ring;
+    renderer_t render;
+    const struct timespec poll = {0, POLL_NS};
+
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s NAME [IMAGE]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *image = (argc > 2) ? argv[2] : NULL;
+
+    if (shm_ring_attach(&ring, argv[1]) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    const shm_ring_header_t *hdr = ring.hdr;
+    if (image && render_init(&render, RENDER_DEFAULT_SIZE, hdr->xmin, hdr->xmax,
+                             hdr->ymin, hdr->ymax) != 0)
+    {
+        fprintf(stderr, "Cannot create the renderer\n");
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_SUCCESS;
+    int64_t last = -1;
+    for (;;)
+    {
+        /* read `finished` first, so that the last frame is not missed */
+        const int finished = shm_ring_finished(&ring);
+        shm_slot_header_t info;
+        if (shm_ring_read(&ring, &info) && (int64_t)info.frame != last)
+        {
+            last = info.frame;
+            summarize(&info, &ring.view, hdr->ncircles);
+            if (image && (render_frame(&render, &ring.view, hdr->ncircles) != 0 ||
+                          render_write(&render, image) != 0))
+            {
+                status = EXIT_FAILURE;
+                break;
+            }
+        }
+        if (finished)
+            break;
+        nanosleep(&poll, NULL);
+    }
+    if (image)
+    {
+        render_free(&render);
+    }
+    shm_ring_close(&ring);
+    return status;
+}
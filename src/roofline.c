@@ -0,0 +1,468 @@
+/****************************************************************************
+ *
+ * roofline.c - Roofline of the force kernels of the circles programs
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***
+% Roofline microbenchmarks
+% Alessandro Monticelli
+
+Measures the limits of the machine for the force kernel, and how
+close to them the kernel of each engine gets.
+
+The compute ceilings are measured on data that stays in the
+registers or in the L1 cache, with many independent operations so
+that the latency is hidden: floating point additions and
+multiplications, divisions, sqrtf(), hypotf(), and the instruction
+mix of the test of a pair of circles (two differences, hypotf(), the
+sum of the radii and the comparison). The memory ceilings are the
+sustained bandwidths of reading arrays of circle_t of the sizes used
+by the programs, from the caches up to the main memory.
+
+The kernels are the force functions of the engines of libcircles
+(see libcircles.h), the same that the programs run, on the same
+random circles as `circles`: each engine is run with one thread, or
+with all the threads if it is threaded (`omp`, `omp-gather`).
+
+The work of each kernel is counted in floating point operations (a
+sqrt, a hypot or a division count as one) from the pair counters of
+the engine: 8 for each test of a pair, 12 more for an overlap pushing
+both circles, 8 more for an overlap pushing one (the partitioned
+engines, which test each pair twice and push one circle at a time).
+The traffic assumes that the inner loop streams one circle_t for each
+test and, on an overlap, reads and writes the displacements it
+updates; the operational intensity is the ratio of
+the two. Each kernel is placed on the roofline of the threads it
+uses, taking the bandwidth of the size of its array: the attainable
+rate is min(peak of the mix, intensity * bandwidth), and the table
+shows which of the two limits it and the fraction reached. A kernel
+faster than its roof can only mean that a ceiling was measured too
+low (e.g. on a busy machine): its fraction is shown as `(?)`, and is
+left empty in the CSV. The results are printed as a table and can be
+saved as CSV.
+
+To compile:
+
+        gcc -std=c99 -fopenmp -O2 -Wall -Wpedantic roofline.c libcircles.c engines.c pairstats.c snapshot.c textimport.c trace.c memtrack.c -o roofline -lm -pthread
+
+To execute:
+
+        ./roofline [--n N] [--csv FILE]
+
+where N is the number of circles of the kernels (default 2000). Use
+`OMP_NUM_THREADS` to choose the number of threads.
+
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "libcircles.h"
+
+/* operations of a test, and of an overlap pushing two or one circles */
+#define FLOPS_TEST 8
+#define FLOPS_PUSH2 12
+#define FLOPS_PUSH1 8
+
+#define LANES 16         /* independent chains of the compute loops */
+#define MIN_SECONDS 0.2  /* duration of each measure */
+#define MAX_SIZES 16
+
+/* results are stored here so that the compiler cannot drop the loops */
+volatile float sink;
+
+typedef struct
+{
+    const char *name;
+    double rate[2]; /* operations per second with 1 and all threads */
+} ceiling_t;
+
+typedef struct
+{
+    long n;         /* circles */
+    double bw[2];   /* bytes per second with 1 and all threads */
+} bandwidth_t;
+
+typedef struct
+{
+    const circles_engine_t *engine;
+    int all_threads;     /* 0 = one thread */
+    double seconds;      /* time of one call */
+    double flops, bytes; /* work and traffic of one call */
+    int overlaps;
+} variant_t;
+
+/**
+ * Run `body` (which does `ops` operations per call on each thread)
+ * with 1 or all the threads until MIN_SECONDS have passed; returns
+ * the operations per second, the best of three measures.
+ */
+static double measure(void (*body)(long reps, float seed), double ops, int all_threads)
+{
+    const int nthreads = all_threads ? omp_get_max_threads() : 1;
+    long reps = 1;
+    double best = 0;
+    for (int m = 0; m < 3;)
+    {
+        const double t0 = omp_get_wtime();
+#pragma omp parallel num_threads(nthreads)
+        body(reps, 1.0f + omp_get_thread_num());
+        const double t = omp_get_wtime() - t0;
+        if (t < MIN_SECONDS / 3)
+        {
+            reps *= 2;
+            continue;
+        }
+        const double rate = ops * reps * nthreads / t;
+        if (rate > best)
+            best = rate;
+        m++;
+    }
+    return best;
+}
+
+#define CHAINS_BEGIN                     \
+    float v[LANES];                      \
+    for (int l = 0; l < LANES; l++)      \
+        v[l] = seed + l * 0.001f;
+#define CHAINS_END                       \
+    float s = 0;                         \
+    for (int l = 0; l < LANES; l++)      \
+        s += v[l];                       \
+    sink = s;
+
+#define INNER 1024
+
+/* one addition and one multiplication per lane */
+static void body_addmul(long reps, float seed)
+{
+    CHAINS_BEGIN
+    for (long k = 0; k < reps * INNER; k++)
+        for (int l = 0; l < LANES; l++)
+            v[l] = v[l] * 0.999999f + 0.000001f;
+    CHAINS_END
+}
+
+static void body_div(long reps, float seed)
+{
+    CHAINS_BEGIN
+    for (long k = 0; k < reps * INNER; k++)
+        for (int l = 0; l < LANES; l++)
+            v[l] = 1.0f / (v[l] + 1.0f);
+    CHAINS_END
+}
+
+static void body_sqrt(long reps, float seed)
+{
+    CHAINS_BEGIN
+    for (long k = 0; k < reps * INNER; k++)
+        for (int l = 0; l < LANES; l++)
+            v[l] = sqrtf(v[l] + 1.0f);
+    CHAINS_END
+}
+
+static void body_hypot(long reps, float seed)
+{
+    CHAINS_BEGIN
+    for (long k = 0; k < reps * INNER; k++)
+        for (int l = 0; l < LANES; l++)
+            v[l] = hypotf(v[l], 0.5f) * 0.5f;
+    CHAINS_END
+}
+
+/* the test of all the pairs of circles that fit in the L1 cache and
+   never overlap, as in the loop of circles.c */
+#define MIX_CIRCLES 128
+#define MIX_PAIRS (MIX_CIRCLES * (MIX_CIRCLES - 1) / 2)
+static void body_mix(long reps, float seed)
+{
+    circle_t c[MIX_CIRCLES];
+    int count = 0;
+    for (int i = 0; i < MIX_CIRCLES; i++)
+    {
+        c[i].x = seed * 100 * (i % 16);
+        c[i].y = seed * 100 * (i / 16);
+        c[i].r = 1.0f + i % 7;
+    }
+    for (long k = 0; k < reps; k++)
+    {
+        for (int i = 0; i < MIX_CIRCLES; i++)
+        {
+            for (int j = i + 1; j < MIX_CIRCLES; j++)
+            {
+                const float dist = hypotf(c[j].x - c[i].x, c[j].y - c[i].y);
+                if (dist < c[i].r + c[j].r - CIRCLES_EPSILON)
+                    count++;
+            }
+        }
+        /* keeps the compiler from running the loops only once */
+        c[k % MIX_CIRCLES].r += 0.0f * count;
+    }
+    sink = (float)count;
+}
+
+/* sum of the circles of an array of `n` circle_t, split among the
+   threads; the threads are started once for all the sweeps, which
+   would otherwise cost more than reading the small arrays */
+static double read_bandwidth(long n, int all_threads)
+{
+    const int nthreads = all_threads ? omp_get_max_threads() : 1;
+    circle_t *c = (circle_t *)malloc(n * sizeof(*c));
+    if (c == NULL)
+        return 0;
+#pragma omp parallel for num_threads(nthreads) schedule(static)
+    for (long i = 0; i < n; i++)
+    {
+        c[i].x = c[i].y = c[i].r = 1.0f;
+        c[i].dx = c[i].dy = 0.0f;
+    }
+    long reps = 1;
+    double best = 0;
+    for (int m = 0; m < 3;)
+    {
+        float s = 0;
+        const double t0 = omp_get_wtime();
+#pragma omp parallel num_threads(nthreads) reduction(+ : s)
+        for (long k = 0; k < reps; k++)
+        {
+            /* each thread reads the same part of the array at each sweep */
+#pragma omp for schedule(static) nowait
+            for (long i = 0; i < n; i++)
+                s += c[i].x + c[i].y + c[i].r + c[i].dx + c[i].dy;
+#pragma omp barrier
+        }
+        const double t = omp_get_wtime() - t0;
+        sink = s;
+        if (t < MIN_SECONDS / 3)
+        {
+            reps *= 2;
+            continue;
+        }
+        const double bw = (double)n * sizeof(circle_t) * reps / t;
+        if (bw > best)
+            best = bw;
+        m++;
+    }
+    free(c);
+    return best;
+}
+
+/**
+ * Time one call of the forces of the engine of `v` on `n` circles
+ * (best of a few calls), and count its work and traffic.
+ */
+static void measure_variant(variant_t *v, int n)
+{
+    const circles_engine_t *e = v->engine;
+    circles_t c;
+    circles_init(&c);
+    c.engine = e;
+    if (circles_random(&c, n, 1) != 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+    pair_stats_t pairs;
+    v->seconds = INFINITY;
+    double total = 0;
+    for (int k = 0; k < 3 || total < MIN_SECONDS; k++)
+    {
+        e->reset(&c);
+        const double t0 = omp_get_wtime();
+        v->overlaps = e->forces(&c, &pairs);
+        const double t = omp_get_wtime() - t0;
+        total += t;
+        if (t < v->seconds)
+            v->seconds = t;
+    }
+    circles_free(&c);
+    const double tests = (double)pairs.tests;
+    const double ov = (double)pairs.overlaps;
+    if (e->partitioned)
+    {
+        /* every pair is tested twice, and each overlap pushes one circle twice */
+        v->flops = tests * FLOPS_TEST + 2 * ov * FLOPS_PUSH1;
+        v->bytes = tests * sizeof(circle_t) + 2 * ov * 2 * sizeof(float);
+    }
+    else
+    {
+        v->flops = tests * FLOPS_TEST + ov * FLOPS_PUSH2;
+        v->bytes = tests * sizeof(circle_t) + ov * 2 * 2 * 2 * sizeof(float);
+    }
+}
+
+/**
+ * Bandwidth with 1 or all the threads for an array of `n` circles,
+ * interpolated (in log-log scale) between the measured sizes.
+ */
+static double bandwidth_at(const bandwidth_t *bw, int nsizes, long n, int all_threads)
+{
+    if (n <= bw[0].n)
+        return bw[0].bw[all_threads];
+    for (int s = 1; s < nsizes; s++)
+    {
+        if (n <= bw[s].n)
+        {
+            const double f = log((double)n / bw[s - 1].n) / log((double)bw[s].n / bw[s - 1].n);
+            return exp((1 - f) * log(bw[s - 1].bw[all_threads]) + f * log(bw[s].bw[all_threads]));
+        }
+    }
+    return bw[nsizes - 1].bw[all_threads];
+}
+
+int main(int argc, char *argv[])
+{
+    int n = 2000;
+    const char *csv = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--n") == 0 && i + 1 < argc)
+            n = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+            csv = argv[++i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [--n N] [--csv FILE]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (n < 2)
+    {
+        fprintf(stderr, "%s: at least 2 circles are needed\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const int nthreads = omp_get_max_threads();
+
+    ceiling_t ceilings[] = {
+        {"add+mul", {0, 0}},
+        {"div", {0, 0}},
+        {"sqrtf", {0, 0}},
+        {"hypotf", {0, 0}},
+        {"pair test", {0, 0}},
+    };
+    void (*bodies[])(long, float) = {body_addmul, body_div, body_sqrt, body_hypot, body_mix};
+    /* operations per call of each body, on each thread */
+    const double ops[] = {2.0 * INNER * LANES, 1.0 * INNER * LANES, 1.0 * INNER * LANES,
+                          1.0 * INNER * LANES, (double)FLOPS_TEST * MIX_PAIRS};
+    const int nceilings = sizeof(ceilings) / sizeof(ceilings[0]);
+    const int MIX = nceilings - 1;
+
+    printf("Compute ceilings (Gop/s; the pair test in Gflop/s, %d per test)\n", FLOPS_TEST);
+    printf("%-12s %12s %12s\n", "", "1 thread", "threads");
+    for (int c = 0; c < nceilings; c++)
+    {
+        ceilings[c].rate[0] = measure(bodies[c], ops[c], 0);
+        ceilings[c].rate[1] = measure(bodies[c], ops[c], 1);
+        printf("%-12s %12.3f %12.3f\n", ceilings[c].name, ceilings[c].rate[0] / 1e9, ceilings[c].rate[1] / 1e9);
+    }
+
+    /* from a few KB to well past the last level cache; n is always included */
+    bandwidth_t bw[MAX_SIZES];
+    int nsizes = 0;
+    for (long size = 256; size <= 4 * 1024 * 1024 && nsizes < MAX_SIZES - 1; size *= 4)
+    {
+        if (n < size && (nsizes == 0 || n > bw[nsizes - 1].n))
+            bw[nsizes++].n = n;
+        bw[nsizes++].n = size;
+    }
+    if (n > bw[nsizes - 1].n)
+        bw[nsizes++].n = n;
+    printf("\nRead bandwidth of circle_t arrays (GB/s)\n");
+    printf("%-12s %12s %12s %12s\n", "circles", "KiB", "1 thread", "threads");
+    for (int s = 0; s < nsizes; s++)
+    {
+        bw[s].bw[0] = read_bandwidth(bw[s].n, 0);
+        bw[s].bw[1] = read_bandwidth(bw[s].n, 1);
+        printf("%-12ld %12.0f %12.3f %12.3f\n", bw[s].n, bw[s].n * sizeof(circle_t) / 1024.0,
+               bw[s].bw[0] / 1e9, bw[s].bw[1] / 1e9);
+    }
+
+    int nvariants = 0;
+    while (circles_engine_at(nvariants) != NULL)
+        nvariants++;
+    variant_t *variants = (variant_t *)calloc(nvariants, sizeof(*variants));
+    if (variants == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (int k = 0; k < nvariants; k++)
+    {
+        variants[k].engine = circles_engine_at(k);
+        variants[k].all_threads = variants[k].engine->threaded;
+    }
+
+    FILE *out = NULL;
+    if (csv != NULL)
+    {
+        out = fopen(csv, "w");
+        if (out == NULL)
+        {
+            fprintf(stderr, "%s: cannot create %s\n", argv[0], csv);
+            return EXIT_FAILURE;
+        }
+        fprintf(out, "engine,threads,n,seconds,gflops,intensity,peak_gflops,bandwidth_gbs,attainable_gflops,bound,fraction\n");
+    }
+    int unreliable = 0;
+    printf("\nKernels on %d circles (%d threads)\n", n, nthreads);
+    printf("%-12s %7s %10s %9s %9s %9s %9s %9s %7s\n",
+           "engine", "threads", "time (s)", "Gflop/s", "flop/B", "peak", "GB/s", "attain.", "bound");
+    for (int k = 0; k < nvariants; k++)
+    {
+        variant_t *v = &variants[k];
+        const int all = v->all_threads;
+        measure_variant(v, n);
+        const double gflops = v->flops / v->seconds / 1e9;
+        const double intensity = v->flops / v->bytes;
+        const double peak = ceilings[MIX].rate[all] / 1e9;
+        const double bandwidth = bandwidth_at(bw, nsizes, n, all) / 1e9;
+        const double attainable = fmin(peak, intensity * bandwidth);
+        const char *bound = (peak <= intensity * bandwidth) ? "compute" : "memory";
+        /* no kernel can beat its roof: a ceiling was underestimated */
+        const int above = gflops > attainable;
+        char fraction[16] = "(?)";
+        if (!above)
+            snprintf(fraction, sizeof(fraction), "(%.0f%%)", 100 * gflops / attainable);
+        unreliable |= above;
+        printf("%-12s %7d %10.6f %9.3f %9.3f %9.3f %9.3f %9.3f %7s %s\n",
+               v->engine->name, all ? nthreads : 1, v->seconds, gflops, intensity, peak,
+               bandwidth, attainable, bound, fraction);
+        if (out != NULL)
+        {
+            fprintf(out, "%s,%d,%d,%.9f,%.6f,%.6f,%.6f,%.6f,%.6f,%s,",
+                    v->engine->name, all ? nthreads : 1, n, v->seconds, gflops, intensity, peak,
+                    bandwidth, attainable, bound);
+            if (!above)
+                fprintf(out, "%.4f", gflops / attainable);
+            fprintf(out, "\n");
+        }
+    }
+    if (unreliable)
+    {
+        printf("(?) above the roof: the ceiling was underestimated (is the machine idle?)\n");
+    }
+    free(variants);
+    if (out != NULL && fclose(out) != 0)
+    {
+        fprintf(stderr, "%s: error writing %s\n", argv[0], csv);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
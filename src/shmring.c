@@ -0,0 +1,223 @@
+/****************************************************************************
+ *
+ * shmring.c - Publish the circles to other processes through shared memory
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "shmring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "memtrack.h"
+
+/*
+ * The GCC atomic builtins are used instead of <stdatomic.h>, which is
+ * not part of C99.
+ */
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static shm_slot_header_t *slot(const shm_ring_t *ring, uint64_t k)
+{
+    uint8_t *base = (uint8_t *)ring->hdr + ring->hdr->slots_offset;
+    return (shm_slot_header_t *)(base + (k % ring->hdr->nslots) * ring->hdr->slot_size);
+}
+
+uint64_t shm_ring_footprint(uint64_t n, size_t stride)
+{
+    const uint64_t records = (n * stride + 63) / 64 * 64;
+    const uint64_t slot_size = sizeof(shm_slot_header_t) + records;
+    const uint64_t slots_offset = (sizeof(shm_ring_header_t) + 63) / 64 * 64;
+    return slots_offset + SHM_RING_SLOTS * slot_size;
+}
+
+int shm_ring_create(shm_ring_t *ring, const char *name, const circle_view_t *v, size_t n,
+                    float xmin, float xmax, float ymin, float ymax)
+{
+    memset(ring, 0, sizeof(*ring));
+    const ptrdiff_t off_y = (const char *)v->y - (const char *)v->x;
+    const ptrdiff_t off_r = (const char *)v->r - (const char *)v->x;
+    if (off_y < 0 || off_r < 0 || (size_t)off_y + sizeof(float) > v->stride ||
+        (size_t)off_r + sizeof(float) > v->stride)
+    {
+        fprintf(stderr, "%s: the circles are not stored as contiguous records\n", name);
+        return -1;
+    }
+    const uint64_t records = (n * v->stride + 63) / 64 * 64;
+    const uint64_t slot_size = sizeof(shm_slot_header_t) + records;
+    const uint64_t slots_offset = (sizeof(shm_ring_header_t) + 63) / 64 * 64;
+    const size_t size = shm_ring_footprint(n, v->stride);
+
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)size) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        shm_unlink(name);
+        return -1;
+    }
+    ring->name = name;
+    ring->owner = 1;
+    ring->hdr = (shm_ring_header_t *)map;
+    ring->size = size;
+    /* the pages are resident once written */
+    mem_account(MEM_OUTPUT, (int64_t)size);
+
+    /* the new object is zero-filled: all slots are empty and stable */
+    shm_ring_header_t *hdr = ring->hdr;
+    hdr->version = SHM_RING_VERSION;
+    hdr->nslots = SHM_RING_SLOTS;
+    hdr->ncircles = n;
+    hdr->stride = (uint32_t)v->stride;
+    hdr->off_y = (uint32_t)off_y;
+    hdr->off_r = (uint32_t)off_r;
+    hdr->xmin = xmin;
+    hdr->xmax = xmax;
+    hdr->ymin = ymin;
+    hdr->ymax = ymax;
+    hdr->slot_size = slot_size;
+    hdr->slots_offset = slots_offset;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(hdr->magic, SHM_RING_MAGIC, sizeof(hdr->magic));
+    return 0;
+}
+
+void shm_ring_publish(shm_ring_t *ring, int64_t iteration, int64_t overlaps,
+                      const circle_view_t *v)
+{
+    shm_ring_header_t *hdr = ring->hdr;
+    const uint64_t k = hdr->published;
+    shm_slot_header_t *s = slot(ring, k);
+    const uint64_t seq = s->seq;
+
+    STORE_RELEASE(&s->seq, seq + 1);
+    /* the records must not be written before `seq` becomes odd */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    s->iteration = iteration;
+    s->overlaps = overlaps;
+    s->frame = k;
+    memcpy(s + 1, v->x, hdr->ncircles * hdr->stride);
+    STORE_RELEASE(&s->seq, seq + 2);
+    STORE_RELEASE(&hdr->published, k + 1);
+}
+
+int shm_ring_attach(shm_ring_t *ring, const char *name)
+{
+    memset(ring, 0, sizeof(*ring));
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(shm_ring_header_t))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: cannot map the shared memory object\n", name);
+        return -1;
+    }
+    ring->name = name;
+    ring->hdr = (shm_ring_header_t *)map;
+    ring->size = st.st_size;
+    const shm_ring_header_t *hdr = ring->hdr;
+    if (memcmp(hdr->magic, SHM_RING_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != SHM_RING_VERSION ||
+        hdr->slots_offset + (uint64_t)hdr->nslots * hdr->slot_size > ring->size)
+    {
+        fprintf(stderr, "%s: not a circles ring (or not ready yet)\n", name);
+        shm_ring_close(ring);
+        return -1;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    ring->frame = (uint8_t *)malloc(hdr->ncircles * hdr->stride + 1);
+    if (ring->frame == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", name);
+        shm_ring_close(ring);
+        return -1;
+    }
+    ring->view.x = (float *)ring->frame;
+    ring->view.y = (float *)(ring->frame + hdr->off_y);
+    ring->view.r = (float *)(ring->frame + hdr->off_r);
+    ring->view.stride = hdr->stride;
+    return 0;
+}
+
+int shm_ring_read(shm_ring_t *ring, shm_slot_header_t *info)
+{
+    const shm_ring_header_t *hdr = ring->hdr;
+    for (;;)
+    {
+        const uint64_t published = LOAD_ACQUIRE(&hdr->published);
+        if (published == 0)
+            return 0;
+        const shm_slot_header_t *s = slot(ring, published - 1);
+        const uint64_t seq = LOAD_ACQUIRE(&s->seq);
+        if (seq & 1)
+            continue;
+        *info = *s;
+        memcpy(ring->frame, s + 1, hdr->ncircles * hdr->stride);
+        /* the copy must be complete before `seq` is checked again */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq)
+        {
+            info->seq = seq;
+            return 1;
+        }
+    }
+}
+
+int shm_ring_finished(const shm_ring_t *ring)
+{
+    return LOAD_ACQUIRE(&ring->hdr->finished) != 0;
+}
+
+void shm_ring_close(shm_ring_t *ring)
+{
+    if (ring->owner)
+    {
+        STORE_RELEASE(&ring->hdr->finished, 1);
+        shm_unlink(ring->name);
+        mem_account(MEM_OUTPUT, -(int64_t)ring->size);
+    }
+    munmap(ring->hdr, ring->size);
+    free(ring->frame);
+    memset(ring, 0, sizeof(*ring));
+}
@@ -0,0 +1,135 @@
+/****************************************************************************
+ *
+ * shmring.h - Publish the circles to other processes through shared memory
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * The simulation (publisher) owns a POSIX shared memory object laid
+ * out as:
+ *
+ *        shm_ring_header_t
+ *        slot 0, slot 1, ..., slot nslots-1
+ *
+ * Each slot is a shm_slot_header_t followed by a copy of the circle
+ * records exactly as the simulation stores them (`stride` bytes per
+ * circle, x at offset 0, y at `off_y`, r at `off_r`), so publishing a
+ * frame costs a single memcpy(). Frame k goes into slot k % nslots.
+ *
+ * The slot header is a sequence lock: the publisher makes `seq` odd
+ * before copying the records and even again afterwards. A reader
+ * copies the newest slot out and retries if `seq` was odd or changed
+ * meanwhile; the publisher never waits for readers, and any number of
+ * readers can attach and detach during the run.
+ *
+ ****************************************************************************/
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "view.h"
+
+#define SHM_RING_MAGIC "CIRCRING"
+#define SHM_RING_VERSION 1
+#define SHM_RING_SLOTS 4
+
+typedef struct
+{
+    char magic[8];              /* SHM_RING_MAGIC, set last by the publisher */
+    uint32_t version;           /* SHM_RING_VERSION */
+    uint32_t nslots;
+    uint64_t ncircles;
+    uint32_t stride;            /* bytes per circle record */
+    uint32_t off_y, off_r;      /* offsets of y and r in a record (x is at 0) */
+    uint32_t reserved;
+    float xmin, xmax;           /* domain of the simulation */
+    float ymin, ymax;
+    uint64_t slot_size;         /* bytes per slot, header included */
+    uint64_t slots_offset;      /* offset of slot 0 */
+    uint64_t published;         /* frames published so far */
+    uint32_t finished;          /* nonzero once the publisher is done */
+    uint32_t reserved2;
+} shm_ring_header_t;
+
+typedef struct
+{
+    uint64_t seq;               /* odd while the slot is being written */
+    int64_t iteration;          /* iteration number (0 = initial state) */
+    int64_t overlaps;           /* overlaps found in the iteration, -1 if unknown */
+    uint64_t frame;             /* frame number */
+    uint64_t reserved[4];       /* pad to a cache line */
+} shm_slot_header_t;
+
+typedef struct
+{
+    const char *name;
+    int owner;                  /* nonzero for the publisher */
+    shm_ring_header_t *hdr;     /* the whole mapping */
+    size_t size;
+    uint8_t *frame;             /* reader: copy of the newest frame */
+    circle_view_t view;         /* reader: view over `frame` */
+} shm_ring_t;
+
+/**
+ * Create the shared memory object `name` (e.g. "/circles") for the
+ * `n` circles described by `v`, in the domain [xmin, xmax] x [ymin,
+ * ymax]. The records of `v` must be contiguous (as the circle_t array
+ * of the programs). Returns 0 on success, -1 on failure (a message is
+ * printed on stderr).
+ */
+int shm_ring_create(shm_ring_t *ring, const char *name, const circle_view_t *v, size_t n,
+                    float xmin, float xmax, float ymin, float ymax);
+
+/**
+ * Size of the shared memory object for `n` records of `stride` bytes.
+ */
+uint64_t shm_ring_footprint(uint64_t n, size_t stride);
+
+/**
+ * Publish the circles `v` (same layout given to shm_ring_create()) as
+ * the state at iteration `iteration`.
+ */
+void shm_ring_publish(shm_ring_t *ring, int64_t iteration, int64_t overlaps,
+                      const circle_view_t *v);
+
+/**
+ * Attach to the shared memory object `name` created by a publisher.
+ * Returns 0 on success, -1 on failure (a message is printed on
+ * stderr).
+ */
+int shm_ring_attach(shm_ring_t *ring, const char *name);
+
+/**
+ * Copy the newest frame into `ring->frame` (see `ring->view`) and its
+ * header into `*info`. Returns 1 on success, 0 if nothing has been
+ * published yet.
+ */
+int shm_ring_read(shm_ring_t *ring, shm_slot_header_t *info);
+
+/**
+ * Return nonzero if the publisher has closed the ring.
+ */
+int shm_ring_finished(const shm_ring_t *ring);
+
+/**
+ * Unmap the ring. The publisher also marks it finished and removes
+ * the name, so that it disappears when the last reader detaches.
+ */
+void shm_ring_close(shm_ring_t *ring);
+
+#endif
@@ -0,0 +1,311 @@
+/****************************************************************************
+ *
+ * snapshot.c - Binary snapshots of a set of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t align_up(uint64_t v, uint64_t a)
+{
+    return (v + a - 1) / a * a;
+}
+
+void snapshot_header_init(snapshot_header_t *hdr, uint64_t n,
+                          float xmin, float xmax, float ymin, float ymax)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic));
+    hdr->version = SNAPSHOT_VERSION;
+    hdr->byte_order = SNAPSHOT_BYTE_ORDER;
+    hdr->ncircles = n;
+    hdr->xmin = xmin;
+    hdr->xmax = xmax;
+    hdr->ymin = ymin;
+    hdr->ymax = ymax;
+    snapshot_header_layout(hdr, SNAPSHOT_SOA, 0, 0, 0);
+}
+
+void snapshot_header_layout(snapshot_header_t *hdr, snapshot_layout_t layout,
+                            size_t record_size, size_t off_y, size_t off_r)
+{
+    const uint64_t n = hdr->ncircles;
+    hdr->layout = layout;
+    if (layout == SNAPSHOT_AOS)
+    {
+        assert(off_y + sizeof(float) <= record_size);
+        assert(off_r + sizeof(float) <= record_size);
+        hdr->stride = record_size;
+        hdr->offset[0] = SNAPSHOT_DATA_OFFSET;
+        hdr->offset[1] = SNAPSHOT_DATA_OFFSET + off_y;
+        hdr->offset[2] = SNAPSHOT_DATA_OFFSET + off_r;
+        hdr->file_size = SNAPSHOT_DATA_OFFSET + n * record_size;
+    }
+    else
+    {
+        const uint64_t column = align_up(n * sizeof(float), SNAPSHOT_ALIGN);
+        hdr->stride = sizeof(float);
+        for (int k = 0; k < 3; k++)
+        {
+            hdr->offset[k] = SNAPSHOT_DATA_OFFSET + k * column;
+        }
+        hdr->file_size = SNAPSHOT_DATA_OFFSET + 3 * column;
+    }
+}
+
+int snapshot_probe(const char *path)
+{
+    char magic[sizeof(SNAPSHOT_MAGIC) - 1];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return 0;
+    const size_t nread = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    return nread == sizeof(magic) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+/**
+ * Check that the header describes a file we can read, and that all
+ * the data lies inside the `size` bytes of the file.
+ */
+static int check_header(const snapshot_header_t *hdr, uint64_t size, const char *path)
+{
+    if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0)
+    {
+        fprintf(stderr, "%s: not a snapshot file\n", path);
+        return -1;
+    }
+    if (hdr->byte_order != SNAPSHOT_BYTE_ORDER)
+    {
+        fprintf(stderr, "%s: snapshot was written with a different byte order\n", path);
+        return -1;
+    }
+    if (hdr->version != SNAPSHOT_VERSION)
+    {
+        fprintf(stderr, "%s: unsupported snapshot version %u\n", path, (unsigned)hdr->version);
+        return -1;
+    }
+    if (hdr->stride < sizeof(float) || hdr->file_size > size)
+    {
+        fprintf(stderr, "%s: truncated or corrupted snapshot\n", path);
+        return -1;
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        if (hdr->offset[k] % sizeof(float) != 0 ||
+            (hdr->ncircles > 0 &&
+             hdr->offset[k] + (hdr->ncircles - 1) * hdr->stride + sizeof(float) > size))
+        {
+            fprintf(stderr, "%s: truncated or corrupted snapshot\n", path);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int snapshot_open(snapshot_t *snap, const char *path)
+{
+    struct stat st;
+    memset(snap, 0, sizeof(*snap));
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if ((uint64_t)st.st_size < sizeof(snapshot_header_t))
+    {
+        fprintf(stderr, "%s: not a snapshot file\n", path);
+        close(fd);
+        return -1;
+    }
+    /* A private mapping lets the caller modify the data in place
+       without touching the file. */
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: mmap failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+    memcpy(&snap->header, map, sizeof(snap->header));
+    if (check_header(&snap->header, st.st_size, path) != 0)
+    {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    snap->map = map;
+    snap->map_size = st.st_size;
+    snap->view.x = (float *)((char *)map + snap->header.offset[0]);
+    snap->view.y = (float *)((char *)map + snap->header.offset[1]);
+    snap->view.r = (float *)((char *)map + snap->header.offset[2]);
+    snap->view.stride = snap->header.stride;
+    posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+    return 0;
+}
+
+void snapshot_read(const snapshot_t *snap, const circle_view_t *dst)
+{
+    const circle_view_t *src = &snap->view;
+    const uint64_t n = snap->header.ncircles;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        VIEW_X(dst, i) = VIEW_X(src, i);
+        VIEW_Y(dst, i) = VIEW_Y(src, i);
+        VIEW_R(dst, i) = VIEW_R(src, i);
+    }
+}
+
+void *snapshot_adopt(snapshot_t *snap, size_t record_size,
+                     size_t off_x, size_t off_y, size_t off_r)
+{
+    const snapshot_header_t *hdr = &snap->header;
+    if (hdr->layout != SNAPSHOT_AOS || hdr->stride != record_size ||
+        hdr->offset[0] < off_x ||
+        hdr->offset[1] - hdr->offset[0] != off_y - off_x ||
+        hdr->offset[2] - hdr->offset[0] != off_r - off_x)
+    {
+        return NULL;
+    }
+    const uint64_t base = hdr->offset[0] - off_x;
+    /* records must be suitably aligned to be accessed in place */
+    if (base % SNAPSHOT_ALIGN != 0 || base + hdr->ncircles * record_size > snap->map_size)
+        return NULL;
+    return (char *)snap->map + base;
+}
+
+void snapshot_close(snapshot_t *snap)
+{
+    if (snap->map != NULL)
+    {
+        munmap(snap->map, snap->map_size);
+    }
+    memset(snap, 0, sizeof(*snap));
+}
+
+/**
+ * Write `len` zero bytes to `f`.
+ */
+static int write_padding(FILE *f, uint64_t len)
+{
+    static const char zeros[SNAPSHOT_DATA_OFFSET] = {0};
+    while (len > 0)
+    {
+        const size_t chunk = len < sizeof(zeros) ? len : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, f) != chunk)
+            return -1;
+        len -= chunk;
+    }
+    return 0;
+}
+
+int snapshot_save(const char *path, const snapshot_header_t *hdr,
+                  const circle_view_t *src, snapshot_layout_t layout)
+{
+    snapshot_header_t h = *hdr;
+    const uint64_t n = h.ncircles;
+    int ok = 0;
+
+    if (layout == SNAPSHOT_AOS)
+    {
+        const char *base = (const char *)src->x;
+        snapshot_header_layout(&h, layout, src->stride,
+                               (const char *)src->y - base,
+                               (const char *)src->r - base);
+    }
+    else
+    {
+        snapshot_header_layout(&h, layout, 0, 0, 0);
+    }
+
+    /* never truncate `path`, which may be mapped by `src` */
+    const size_t tmplen = strlen(path) + sizeof(".XXXXXX");
+    char *tmp = (char *)malloc(tmplen);
+    if (tmp == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return -1;
+    }
+    snprintf(tmp, tmplen, "%s.XXXXXX", path);
+    const int fd = mkstemp(tmp);
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(tmp);
+        }
+        free(tmp);
+        return -1;
+    }
+    /* mkstemp() creates the file readable by its owner only */
+    const mode_t mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+    ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+         write_padding(f, SNAPSHOT_DATA_OFFSET - sizeof(h)) == 0;
+    if (ok && layout == SNAPSHOT_AOS)
+    {
+        ok = fwrite(src->x, src->stride, n, f) == n;
+    }
+    else if (ok)
+    {
+        /* gather each column through a small buffer */
+        enum { CHUNK = 4096 };
+        float buf[CHUNK];
+        const uint64_t column = h.offset[1] - h.offset[0];
+        float *const cols[3] = {src->x, src->y, src->r};
+        for (int k = 0; ok && k < 3; k++)
+        {
+            for (uint64_t i = 0; ok && i < n; i += CHUNK)
+            {
+                const size_t len = (n - i < CHUNK) ? n - i : CHUNK;
+                for (size_t j = 0; j < len; j++)
+                {
+                    buf[j] = VIEW_AT(cols[k], src, i + j);
+                }
+                ok = fwrite(buf, sizeof(float), len, f) == len;
+            }
+            ok = ok && write_padding(f, column - n * sizeof(float)) == 0;
+        }
+    }
+    ok = ok && fflush(f) == 0 && fsync(fd) == 0;
+    if (fclose(f) != 0)
+        ok = 0;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok)
+    {
+        fprintf(stderr, "%s: write failed (%s)\n", path, strerror(errno));
+        unlink(tmp);
+    }
+    free(tmp);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,149 @@
+/****************************************************************************
+ *
+ * snapshot.h - Binary snapshots of a set of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * A snapshot file is made of a fixed-size header, padded to
+ * SNAPSHOT_DATA_OFFSET bytes, followed by the circle data. The data
+ * can be stored in two layouts:
+ *
+ * - SNAPSHOT_SOA: three columns x[], y[], r[] of floats, each one
+ *   starting at a multiple of SNAPSHOT_ALIGN bytes;
+ *
+ * - SNAPSHOT_AOS: an array of fixed-size records (e.g., the circle_t
+ *   of the programs), whose x, y and r fields are at known offsets.
+ *
+ * In both cases the i-th value of column k is found at file offset
+ * `offset[k] + i * stride`, so that a reader does not need to care
+ * about the layout. Values are stored in the native byte order; the
+ * `byte_order` field is used to reject foreign files.
+ *
+ * Snapshots are loaded with mmap(), so that no parsing takes place.
+ *
+ ****************************************************************************/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "view.h"
+
+#define SNAPSHOT_MAGIC "CIRCSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define SNAPSHOT_ALIGN 64
+#define SNAPSHOT_DATA_OFFSET 4096
+
+typedef enum
+{
+    SNAPSHOT_SOA = 0,
+    SNAPSHOT_AOS = 1
+} snapshot_layout_t;
+
+typedef struct
+{
+    char magic[8];          /* SNAPSHOT_MAGIC, not NUL-terminated */
+    uint32_t version;       /* SNAPSHOT_VERSION */
+    uint32_t byte_order;    /* SNAPSHOT_BYTE_ORDER as written by the producer */
+    uint32_t layout;        /* one of snapshot_layout_t */
+    uint32_t stride;        /* distance in bytes between consecutive values */
+    uint64_t ncircles;      /* number of circles */
+    uint64_t seed;          /* seed of the generator that produced the data */
+    uint64_t iteration;     /* iteration at which the snapshot was taken */
+    float xmin, xmax;       /* domain */
+    float ymin, ymax;
+    uint64_t offset[3];     /* file offset of the first x, y, r */
+    uint64_t file_size;     /* expected size of the whole file */
+} snapshot_header_t;
+
+typedef struct
+{
+    snapshot_header_t header;
+    void *map;              /* private, writable mapping of the whole file */
+    size_t map_size;
+    circle_view_t view;     /* coordinates inside the mapping */
+} snapshot_t;
+
+/**
+ * Fill `hdr` with the default values for a set of `n` circles in the
+ * domain [xmin, xmax] x [ymin, ymax]. Layout and offsets are set by
+ * snapshot_save().
+ */
+void snapshot_header_init(snapshot_header_t *hdr, uint64_t n,
+                          float xmin, float xmax, float ymin, float ymax);
+
+/**
+ * Compute stride, offsets and file size of `hdr` for the given
+ * layout. For SNAPSHOT_AOS, `record_size` is the size of a record and
+ * `off_y`, `off_r` are the offsets of the y and r fields relative to
+ * the x field; these arguments are ignored for SNAPSHOT_SOA.
+ */
+void snapshot_header_layout(snapshot_header_t *hdr, snapshot_layout_t layout,
+                            size_t record_size, size_t off_y, size_t off_r);
+
+/**
+ * Return nonzero iff `path` can be opened and starts with the
+ * snapshot magic number.
+ */
+int snapshot_probe(const char *path);
+
+/**
+ * Map the snapshot `path` into memory and validate its header.
+ * Returns 0 on success, -1 on failure (a message is printed on
+ * stderr).
+ */
+int snapshot_open(snapshot_t *snap, const char *path);
+
+/**
+ * Copy the circles of an open snapshot into the storage described by
+ * `dst`, which must have room for snap->header.ncircles elements.
+ */
+void snapshot_read(const snapshot_t *snap, const circle_view_t *dst);
+
+/**
+ * If the snapshot stores AoS records of exactly `record_size` bytes
+ * with x, y, r at the given offsets, return a pointer to the first
+ * record inside the mapping, which can then be used in place of a
+ * malloc()ed array (writes go to private copy-on-write pages).
+ * Returns NULL otherwise.
+ */
+void *snapshot_adopt(snapshot_t *snap, size_t record_size,
+                     size_t off_x, size_t off_y, size_t off_r);
+
+/**
+ * Unmap an open snapshot; any pointer returned by snapshot_adopt()
+ * becomes invalid.
+ */
+void snapshot_close(snapshot_t *snap);
+
+/**
+ * Write the circles described by `src` to `path`. With SNAPSHOT_AOS
+ * the records are written as they are in memory: each record is the
+ * `src->stride` bytes starting at the x field, and the y and r
+ * fields must be inside the record. With SNAPSHOT_SOA the
+ * coordinates are gathered into aligned columns. The snapshot is
+ * written to a temporary file in the same directory, which then
+ * replaces `path`: `src` may be the mapping of `path` itself (a run
+ * restarted in place), and a failed write leaves `path` untouched.
+ * Returns 0 on success, -1 on failure.
+ */
+int snapshot_save(const char *path, const snapshot_header_t *hdr,
+                  const circle_view_t *src, snapshot_layout_t layout);
+
+#endif
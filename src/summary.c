@@ -0,0 +1,97 @@
+/****************************************************************************
+ *
+ * summary.c - Machine-readable summary of a run
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "summary.h"
+
+void summary_init(run_summary_t *s, const char *program)
+{
+    memset(s, 0, sizeof(*s));
+    snprintf(s->program, sizeof(s->program), "%s", program);
+    s->procs = 1;
+    s->threads = 1;
+}
+
+int summary_write(const char *path, const run_summary_t *s)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "Cannot create summary %s\n", path);
+        return -1;
+    }
+    fprintf(out, "program %s\n", s->program);
+    fprintf(out, "procs %d\n", s->procs);
+    fprintf(out, "threads %d\n", s->threads);
+    fprintf(out, "ncircles %d\n", s->ncircles);
+    fprintf(out, "iterations %d\n", s->iterations);
+    /* %.9g keeps the nanoseconds of runs shorter than a second */
+    fprintf(out, "elapsed %.9g\n", s->elapsed);
+    fprintf(out, "candidates %" PRIu64 "\n", s->pairs.candidates);
+    fprintf(out, "tests %" PRIu64 "\n", s->pairs.tests);
+    fprintf(out, "sqrts %" PRIu64 "\n", s->pairs.sqrts);
+    fprintf(out, "overlaps %" PRIu64 "\n", s->pairs.overlaps);
+    if (fclose(out) != 0)
+    {
+        fprintf(stderr, "Error writing summary %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+int summary_read(const char *path, run_summary_t *s)
+{
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+        return -1;
+    summary_init(s, "");
+    s->elapsed = -1.0;
+    char line[256], key[32], value[32];
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        if (sscanf(line, "%31s %31s", key, value) != 2)
+            continue;
+        if (strcmp(key, "program") == 0)
+            snprintf(s->program, sizeof(s->program), "%s", value);
+        else if (strcmp(key, "procs") == 0)
+            s->procs = atoi(value);
+        else if (strcmp(key, "threads") == 0)
+            s->threads = atoi(value);
+        else if (strcmp(key, "ncircles") == 0)
+            s->ncircles = atoi(value);
+        else if (strcmp(key, "iterations") == 0)
+            s->iterations = atoi(value);
+        else if (strcmp(key, "elapsed") == 0)
+            s->elapsed = atof(value);
+        else if (strcmp(key, "candidates") == 0)
+            s->pairs.candidates = strtoull(value, NULL, 10);
+        else if (strcmp(key, "tests") == 0)
+            s->pairs.tests = strtoull(value, NULL, 10);
+        else if (strcmp(key, "sqrts") == 0)
+            s->pairs.sqrts = strtoull(value, NULL, 10);
+        else if (strcmp(key, "overlaps") == 0)
+            s->pairs.overlaps = strtoull(value, NULL, 10);
+    }
+    fclose(in);
+    return s->elapsed < 0 ? -1 : 0;
+}
@@ -0,0 +1,63 @@
+/****************************************************************************
+ *
+ * summary.h - Machine-readable summary of a run
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * With `--summary FILE` a program writes, at the end of the run, the
+ * figures that the benchmark driver needs as one `key value` line
+ * each, so that they do not have to be scraped from the messages
+ * printed on stdout. Unknown keys are skipped when reading, so that
+ * keys can be added without breaking older readers.
+ *
+ ****************************************************************************/
+
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+#include "pairstats.h"
+
+typedef struct
+{
+    char program[32];   /* name of the program */
+    int procs;          /* MPI processes (1 for the other programs) */
+    int threads;        /* OpenMP threads per process */
+    int ncircles;       /* number of circles */
+    int iterations;     /* number of iterations */
+    double elapsed;     /* seconds spent in the iterations */
+    pair_stats_t pairs; /* pair counters summed over all iterations */
+} run_summary_t;
+
+/**
+ * Initialize `s` for the program `program`, with one process and one
+ * thread and all the other fields zero.
+ */
+void summary_init(run_summary_t *s, const char *program);
+
+/**
+ * Write `s` to the file `path`; returns 0 on success, -1 (after
+ * printing a message) on failure.
+ */
+int summary_write(const char *path, const run_summary_t *s);
+
+/**
+ * Read the file `path` written by summary_write() into `s`; returns 0
+ * on success, -1 if the file cannot be read or has no elapsed time.
+ */
+int summary_read(const char *path, run_summary_t *s);
+
+#endif
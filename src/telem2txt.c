@@ -0,0 +1,96 @@
+/****************************************************************************
+ *
+ * telem2txt.c - Print a telemetry log as text
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***
+% Telemetry to text converter
+% Alessandro Monticelli
+
+Prints, from a log written with `--telemetry`, the lines "Iteration I
+of N, ..." that the program printed (or would have printed) at each
+iteration, in the same format. With `--verbosity` only the lines of
+that level are printed (see `--verbosity` of the programs); with
+`--latency` each line is followed by the duration of the iteration,
+output included.
+
+To compile:
+
+        gcc -std=c99 -Wall -Wpedantic telem2txt.c telemetry.c pairstats.c memtrack.c -o telem2txt -pthread
+
+To execute:
+
+        ./telem2txt [--verbosity N] [--latency] FILE
+
+for example
+
+        ./omp-circles --verbosity 0 --telemetry run.tlm 100000 1000
+        ./telem2txt run.tlm | tail -3
+
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "telemetry.h"
+
+int main(int argc, char *argv[])
+{
+    int level = TELEMETRY_ALL, latency = 0, i;
+    for (i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], "--verbosity") == 0 && i + 1 < argc - 1)
+            level = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--latency") == 0)
+            latency = 1;
+        else
+            break;
+    }
+    if (i != argc - 1)
+    {
+        fprintf(stderr, "Usage: %s [--verbosity N] [--latency] FILE\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *path = argv[i];
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+    {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    telemetry_header_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+        memcmp(hdr.magic, TELEMETRY_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != TELEMETRY_VERSION || hdr.record_size != sizeof(telemetry_record_t))
+    {
+        fprintf(stderr, "%s: not a telemetry log of this version\n", path);
+        fclose(in);
+        return EXIT_FAILURE;
+    }
+    telemetry_record_t rec;
+    while (fread(&rec, sizeof(rec), 1, in) == 1)
+    {
+        if (!telemetry_shown(level, rec.iteration, rec.iterations))
+            continue;
+        telemetry_print(stdout, &rec);
+        if (latency)
+            printf("  latency %f s\n", rec.latency);
+    }
+    fclose(in);
+    return EXIT_SUCCESS;
+}
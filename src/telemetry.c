@@ -0,0 +1,108 @@
+/****************************************************************************
+ *
+ * telemetry.c - Binary log of the iterations
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "telemetry.h"
+#include <string.h>
+#include "memtrack.h"
+
+int telemetry_open(telemetry_t *t, const char *path, const char *program)
+{
+    memset(t, 0, sizeof(*t));
+    if (path == NULL)
+        return 0;
+    t->path = path;
+    t->ring = (telemetry_record_t *)mem_alloc(MEM_OUTPUT, TELEMETRY_RING * sizeof(*t->ring));
+    if (t->ring == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return -1;
+    }
+    if ((t->out = fopen(path, "wb")) == NULL)
+    {
+        perror(path);
+        mem_free(t->ring);
+        t->ring = NULL;
+        return -1;
+    }
+    telemetry_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TELEMETRY_MAGIC, sizeof(hdr.magic));
+    hdr.version = TELEMETRY_VERSION;
+    hdr.record_size = sizeof(telemetry_record_t);
+    strncpy(hdr.program, program, sizeof(hdr.program) - 1);
+    if (fwrite(&hdr, sizeof(hdr), 1, t->out) != 1)
+        t->failed = 1;
+    return 0;
+}
+
+void telemetry_flush(telemetry_t *t)
+{
+    if (t->out == NULL || t->count == 0)
+        return;
+    if (fwrite(t->ring, sizeof(*t->ring), t->count, t->out) != (size_t)t->count ||
+        fflush(t->out) != 0)
+    {
+        t->failed = 1;
+    }
+    t->count = 0;
+}
+
+void telemetry_append(telemetry_t *t, const telemetry_record_t *rec)
+{
+    if (t->out == NULL)
+        return;
+    t->ring[t->count++] = *rec;
+    if (t->count == TELEMETRY_RING)
+        telemetry_flush(t);
+}
+
+int telemetry_close(telemetry_t *t)
+{
+    if (t->out == NULL)
+        return 0;
+    telemetry_flush(t);
+    if (fclose(t->out) != 0)
+        t->failed = 1;
+    if (t->failed)
+        fprintf(stderr, "%s: write error\n", t->path);
+    const int status = t->failed ? -1 : 0;
+    mem_free(t->ring);
+    memset(t, 0, sizeof(*t));
+    return status;
+}
+
+int telemetry_shown(int level, uint32_t it, uint32_t iterations)
+{
+    if (level >= TELEMETRY_ALL)
+        return 1;
+    if (level == TELEMETRY_TENTHS)
+    {
+        const uint32_t step = iterations >= 10 ? iterations / 10 : 1;
+        return it % step == 0 || it == iterations;
+    }
+    return 0;
+}
+
+void telemetry_print(FILE *out, const telemetry_record_t *rec)
+{
+    fprintf(out, "Iteration %d of %d, %d overlaps (%f s), %.4f%% of the tests overlap\n",
+            (int)rec->iteration, (int)rec->iterations, (int)rec->pairs.overlaps,
+            rec->elapsed, pair_stats_hits(&rec->pairs));
+}
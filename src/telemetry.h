@@ -0,0 +1,111 @@
+/****************************************************************************
+ *
+ * telemetry.h - Binary log of the iterations
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Each iteration is described by a fixed-size record, stored into a
+ * ring of TELEMETRY_RING records allocated in advance; the ring is
+ * written to the telemetry file with a single fwrite() when it is
+ * full, when a dump is requested and at the end of the run. The file
+ * is a telemetry_header_t followed by the records, in the byte order
+ * of the machine that wrote it.
+ *
+ * The line "Iteration I of N, ..." that the programs printed at each
+ * iteration is now printed by telemetry_print() from the record, for
+ * the iterations selected by the verbosity level, and telem2txt
+ * prints the same lines from a file.
+ *
+ ****************************************************************************/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "pairstats.h"
+
+#define TELEMETRY_MAGIC "CIRCTEL1"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_RING 4096 /* records kept in memory */
+
+/* Verbosity levels: lines "Iteration I of N, ..." printed */
+#define TELEMETRY_QUIET 0 /* none */
+#define TELEMETRY_TENTHS 1 /* about ten per run, and the last one */
+#define TELEMETRY_ALL 2 /* one per iteration */
+
+typedef struct
+{
+    char magic[8];        /* TELEMETRY_MAGIC */
+    uint32_t version;     /* TELEMETRY_VERSION */
+    uint32_t record_size; /* sizeof(telemetry_record_t) */
+    char program[32];     /* program that wrote the file */
+} telemetry_header_t;
+
+typedef struct
+{
+    uint32_t iteration;  /* 1-based */
+    uint32_t iterations; /* iterations of the run */
+    double elapsed;      /* seconds of the computation of the iteration */
+    double latency;      /* seconds of the iteration, output included */
+    pair_stats_t pairs;  /* pairs examined, and overlaps */
+} telemetry_record_t;
+
+typedef struct
+{
+    FILE *out;                /* NULL: the records are dropped */
+    const char *path;
+    telemetry_record_t *ring; /* [TELEMETRY_RING] */
+    int count;                /* records not yet written */
+    int failed;
+} telemetry_t;
+
+/**
+ * Create the telemetry file `path` written by `program`; a NULL `path`
+ * gives a log that drops the records. Returns 0 on success, -1 on
+ * failure (a message is printed on stderr).
+ */
+int telemetry_open(telemetry_t *t, const char *path, const char *program);
+
+/**
+ * Append `rec` to the log; the ring is written out when full.
+ */
+void telemetry_append(telemetry_t *t, const telemetry_record_t *rec);
+
+/**
+ * Write out the records in the ring.
+ */
+void telemetry_flush(telemetry_t *t);
+
+/**
+ * Write out the records left and close the file. Returns 0 on
+ * success, -1 if some write failed.
+ */
+int telemetry_close(telemetry_t *t);
+
+/**
+ * Return nonzero iff the line of iteration `it` (1-based) of
+ * `iterations` is printed at verbosity `level`.
+ */
+int telemetry_shown(int level, uint32_t it, uint32_t iterations);
+
+/**
+ * Print the line "Iteration I of N, ..." of `rec`.
+ */
+void telemetry_print(FILE *out, const telemetry_record_t *rec);
+
+#endif
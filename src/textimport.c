@@ -0,0 +1,366 @@
+/****************************************************************************
+ *
+ * textimport.c - Parallel importer for text files of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "textimport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* Chunks smaller than this are not worth a task of their own */
+#define MIN_CHUNK_SIZE (1 << 16)
+/* Number of chunks per thread, to balance lines of different length */
+#define CHUNKS_PER_THREAD 4
+/* Number of significant digits that fit into a uint64_t */
+#define MAX_DIGITS 19
+
+static const double pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static inline int is_digit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+static inline int is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline int is_separator(char c)
+{
+    return is_blank(c) || c == ',' || c == ';';
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/**
+ * Return nonzero iff the 8 bytes packed into `v` are all ASCII
+ * digits. Each byte is checked without branches (SWAR): the high
+ * nibble must be 3, and adding 6 must not carry into it.
+ */
+static inline int is_eight_digits(uint64_t v)
+{
+    return ((v & 0xF0F0F0F0F0F0F0F0ull) |
+            (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ==
+           0x3333333333333333ull;
+}
+
+/**
+ * Convert 8 ASCII digits packed into `v` (first digit in the lowest
+ * byte) into their value, with three multiplications instead of
+ * eight.
+ */
+static inline uint32_t eight_digits_value(uint64_t v)
+{
+    const uint64_t mask = 0x000000FF000000FFull;
+    const uint64_t mul1 = 0x000F424000000064ull; /* 100 + (1000000 << 32) */
+    const uint64_t mul2 = 0x0000271000000001ull; /* 1 + (10000 << 32) */
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8);
+    v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+    return (uint32_t)v;
+}
+#endif
+
+/**
+ * Accumulate the run of digits starting at `p` into `*mant`. At most
+ * MAX_DIGITS significant digits are kept in `*ndigits`; the number of
+ * digits that did not fit is added to `*dropped`. Returns the address
+ * of the first non-digit.
+ */
+static inline const char *parse_digits(const char *p, const char *end, uint64_t *mant,
+                                       int *ndigits, int *dropped)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (end - p >= 8 && *ndigits + 8 <= MAX_DIGITS)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        if (!is_eight_digits(v))
+            break;
+        *mant = *mant * 100000000u + eight_digits_value(v);
+        *ndigits += (*mant != 0) ? 8 : 0;
+        p += 8;
+    }
+#endif
+    for (; p < end && is_digit(*p); p++)
+    {
+        if (*ndigits < MAX_DIGITS)
+        {
+            *mant = *mant * 10 + (uint64_t)(*p - '0');
+            *ndigits += (*mant != 0);
+        }
+        else
+        {
+            (*dropped)++;
+        }
+    }
+    return p;
+}
+
+/**
+ * Parse a decimal floating-point number at `*pp`, in the format
+ * accepted by strtof() but without hexadecimal, infinities and NaNs.
+ * On success stores the value into `*out`, advances `*pp` and
+ * returns 0; returns -1 otherwise.
+ */
+static int parse_float(const char **pp, const char *end, float *out)
+{
+    const char *p = *pp;
+    uint64_t mant = 0;
+    int ndigits = 0, dropped = 0, exp10 = 0, neg = 0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        neg = (*p == '-');
+        p++;
+    }
+    const char *digits = p;
+    p = parse_digits(p, end, &mant, &ndigits, &dropped);
+    exp10 = dropped;
+    if (p < end && *p == '.')
+    {
+        const char *frac = ++p;
+        dropped = 0;
+        p = parse_digits(p, end, &mant, &ndigits, &dropped);
+        /* leading zeros of the fraction are not counted in ndigits */
+        exp10 -= (int)(p - frac) - dropped;
+    }
+    if (p == digits || (p == digits + 1 && *digits == '.'))
+        return -1;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        int eneg = 0, e = 0;
+        if (q < end && (*q == '-' || *q == '+'))
+        {
+            eneg = (*q == '-');
+            q++;
+        }
+        if (q < end && is_digit(*q))
+        {
+            for (; q < end && is_digit(*q); q++)
+            {
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+            }
+            exp10 += eneg ? -e : e;
+            p = q;
+        }
+    }
+    double d = (double)mant;
+    if (mant != 0)
+    {
+        for (; exp10 > 22; exp10 -= 22)
+            d *= 1e22;
+        for (; exp10 < -22; exp10 += 22)
+            d /= 1e22;
+        d = (exp10 < 0) ? d / pow10_table[-exp10] : d * pow10_table[exp10];
+    }
+    *out = (float)(neg ? -d : d);
+    *pp = p;
+    return 0;
+}
+
+/**
+ * Return nonzero iff the line starting at `p` holds a record, i.e.,
+ * its first non-blank character can start a number.
+ */
+static inline int is_record(const char *p, const char *eol)
+{
+    while (p < eol && is_blank(*p))
+        p++;
+    return p < eol && (is_digit(*p) || *p == '-' || *p == '+' || *p == '.');
+}
+
+/**
+ * Parse the record in [p, eol) into `v[]`; returns 0 on success.
+ */
+static int parse_record(const char *p, const char *eol, float v[3])
+{
+    for (int k = 0; k < 3; k++)
+    {
+        while (p < eol && is_separator(*p))
+            p++;
+        if (p == eol || parse_float(&p, eol, &v[k]) != 0)
+            return -1;
+        if (p < eol && !is_separator(*p))
+            return -1;
+    }
+    return 0;
+}
+
+static inline const char *end_of_line(const char *p, const char *end)
+{
+    const char *eol = memchr(p, '\n', end - p);
+    return eol ? eol : end;
+}
+
+int text_import_open(text_import_t *ti, const char *path)
+{
+    struct stat st;
+    memset(ti, 0, sizeof(*ti));
+    ti->path = path;
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    ti->size = st.st_size;
+    if (ti->size > 0)
+    {
+        void *map = mmap(NULL, ti->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            fprintf(stderr, "%s: mmap failed: %s\n", path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        posix_madvise(map, ti->size, POSIX_MADV_WILLNEED);
+        ti->map = map;
+    }
+    close(fd);
+
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    size_t nchunks = (size_t)nthreads * CHUNKS_PER_THREAD;
+    if (nchunks > ti->size / MIN_CHUNK_SIZE + 1)
+        nchunks = ti->size / MIN_CHUNK_SIZE + 1;
+    ti->nchunks = nchunks;
+    ti->chunk_begin = (size_t *)malloc((nchunks + 1) * sizeof(*ti->chunk_begin));
+    ti->chunk_first = (uint64_t *)calloc(nchunks + 1, sizeof(*ti->chunk_first));
+    ti->chunk_line = (uint64_t *)calloc(nchunks + 1, sizeof(*ti->chunk_line));
+    if (ti->chunk_begin == NULL || ti->chunk_first == NULL || ti->chunk_line == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", path);
+        text_import_close(ti);
+        return -1;
+    }
+
+    /* Move each nominal boundary to the start of the next line */
+    ti->chunk_begin[0] = 0;
+    for (size_t k = 1; k < nchunks; k++)
+    {
+        size_t b = ti->size / nchunks * k;
+        if (b < ti->chunk_begin[k - 1])
+            b = ti->chunk_begin[k - 1];
+        if (b > 0 && b < ti->size && ti->map[b - 1] != '\n')
+        {
+            const char *eol = end_of_line(ti->map + b, ti->map + ti->size);
+            b = (eol - ti->map) + 1;
+        }
+        ti->chunk_begin[k] = (b < ti->size) ? b : ti->size;
+    }
+    ti->chunk_begin[nchunks] = ti->size;
+
+    /* First pass: count records and lines of each chunk */
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int k = 0; k < ti->nchunks; k++)
+    {
+        const char *p = ti->map + ti->chunk_begin[k];
+        const char *end = ti->map + ti->chunk_begin[k + 1];
+        uint64_t records = 0, lines = 0;
+        while (p < end)
+        {
+            const char *eol = end_of_line(p, end);
+            records += is_record(p, eol);
+            lines++;
+            p = eol + 1;
+        }
+        ti->chunk_first[k + 1] = records;
+        ti->chunk_line[k + 1] = lines;
+    }
+    ti->chunk_line[0] = 1;
+    for (int k = 0; k < ti->nchunks; k++)
+    {
+        ti->chunk_first[k + 1] += ti->chunk_first[k];
+        ti->chunk_line[k + 1] += ti->chunk_line[k];
+    }
+    ti->ncircles = ti->chunk_first[ti->nchunks];
+    return 0;
+}
+
+int text_import_read(const text_import_t *ti, const circle_view_t *dst)
+{
+    uint64_t bad_line = 0;
+
+    /* Second pass: each chunk knows where its first record goes */
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int k = 0; k < ti->nchunks; k++)
+    {
+        const char *p = ti->map + ti->chunk_begin[k];
+        const char *end = ti->map + ti->chunk_begin[k + 1];
+        uint64_t i = ti->chunk_first[k];
+        uint64_t line = ti->chunk_line[k];
+        while (p < end)
+        {
+            const char *eol = end_of_line(p, end);
+            if (is_record(p, eol))
+            {
+                float v[3];
+                if (parse_record(p, eol, v) != 0)
+                {
+#pragma omp critical
+                    if (bad_line == 0 || line < bad_line)
+                        bad_line = line;
+                    break;
+                }
+                VIEW_X(dst, i) = v[0];
+                VIEW_Y(dst, i) = v[1];
+                VIEW_R(dst, i) = v[2];
+                i++;
+            }
+            line++;
+            p = eol + 1;
+        }
+    }
+    if (bad_line != 0)
+    {
+        fprintf(stderr, "%s:%llu: expected \"x y r\"\n", ti->path, (unsigned long long)bad_line);
+        return -1;
+    }
+    return 0;
+}
+
+void text_import_close(text_import_t *ti)
+{
+    if (ti->map != NULL)
+    {
+        munmap((void *)ti->map, ti->size);
+    }
+    free(ti->chunk_begin);
+    free(ti->chunk_first);
+    free(ti->chunk_line);
+    memset(ti, 0, sizeof(*ti));
+}
@@ -0,0 +1,77 @@
+/****************************************************************************
+ *
+ * textimport.h - Parallel importer for text files of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Reads text files with one circle per line:
+ *
+ *        x y r
+ *
+ * where the three numbers are separated by blanks and/or commas (so
+ * that both CSV files and the data block of the gnuplot files written
+ * by dump_circles() are accepted). Lines that do not start with a
+ * number, such as comments, CSV headers and gnuplot commands, are
+ * skipped; any field after the third one is ignored.
+ *
+ * The file is mapped with mmap() and split into chunks at newline
+ * boundaries. A first parallel pass counts the records of each chunk,
+ * so that each chunk knows where its first record goes; a second
+ * parallel pass parses every chunk directly into its slice of the
+ * destination, which therefore receives the circles in file order.
+ *
+ ****************************************************************************/
+
+#ifndef TEXTIMPORT_H
+#define TEXTIMPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "view.h"
+
+typedef struct
+{
+    const char *path;
+    const char *map;        /* read-only mapping of the file */
+    size_t size;
+    int nchunks;
+    size_t *chunk_begin;    /* [nchunks+1] offsets of the chunks */
+    uint64_t *chunk_first;  /* [nchunks+1] index of the first record of each chunk */
+    uint64_t *chunk_line;   /* [nchunks+1] line number of the first line of each chunk */
+    uint64_t ncircles;      /* number of records in the file */
+} text_import_t;
+
+/**
+ * Map the file `path` and count the circles it contains, which are
+ * then available in `ti->ncircles`. Returns 0 on success, -1 on
+ * failure (a message is printed on stderr).
+ */
+int text_import_open(text_import_t *ti, const char *path);
+
+/**
+ * Parse the circles into `dst`, which must have room for
+ * `ti->ncircles` elements. Returns 0 on success, -1 if a malformed
+ * line is found (its number is printed on stderr).
+ */
+int text_import_read(const text_import_t *ti, const circle_view_t *dst);
+
+/**
+ * Release the resources held by `ti`.
+ */
+void text_import_close(text_import_t *ti);
+
+#endif
@@ -0,0 +1,200 @@
+/****************************************************************************
+ *
+ * trace.c - Timeline of the phases, chunks and MPI calls of a run
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "memtrack.h"
+
+typedef struct
+{
+    const char *name, *cat;
+    uint64_t start, end;
+    int64_t arg;
+} trace_event_t;
+
+/* Ring of one thread; only the owner writes it */
+typedef struct
+{
+    trace_event_t *events; /* allocated on the first event */
+    uint64_t count;        /* events recorded, including the overwritten ones */
+    int owned;             /* claimed by a thread */
+    char pad[44];          /* keep the rings of different threads apart */
+} trace_ring_t;
+
+int trace_enabled = 0;
+static trace_ring_t rings[TRACE_MAX_THREADS];
+static int64_t clock_offset = 0;
+static int generation = 0;     /* trace_open() calls, which free the rings */
+static __thread int my_ring = -1, my_generation = 0;
+
+int trace_open(void)
+{
+    memset(rings, 0, sizeof(rings));
+    generation++;
+    /* the timeline starts now, unless trace_set_offset() says otherwise */
+    clock_offset = -(int64_t)trace_clock();
+    trace_enabled = 1;
+    return 0;
+}
+
+uint64_t trace_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void trace_set_offset(int64_t offset)
+{
+    clock_offset = offset;
+}
+
+uint64_t trace_begin(void)
+{
+    return trace_enabled ? trace_clock() : 0;
+}
+
+/**
+ * Ring of the calling thread, claimed on its first event: the ring of
+ * its OpenMP thread number, so that the timeline shows the threads of
+ * a team by number, or the next free one if another thread has it.
+ * The claim lasts as long as the OS thread, so application threads
+ * that trace different contexts at the same time, all of them OpenMP
+ * thread 0, never share a ring. Returns -1 if all the rings are taken.
+ */
+static int thread_ring(void)
+{
+    if (my_ring >= 0 && my_generation == generation)
+        return my_ring;
+#ifdef _OPENMP
+    const int first = omp_get_thread_num();
+#else
+    const int first = 0;
+#endif
+    my_ring = -1;
+    my_generation = generation;
+    for (int k = 0; k < TRACE_MAX_THREADS; k++)
+    {
+        const int t = (first + k) % TRACE_MAX_THREADS;
+        int unowned = 0;
+        if (__atomic_compare_exchange_n(&rings[t].owned, &unowned, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            my_ring = t;
+            break;
+        }
+    }
+    return my_ring;
+}
+
+uint64_t trace_footprint(void)
+{
+    return TRACE_RING_EVENTS * sizeof(trace_event_t);
+}
+
+void trace_end(const char *name, const char *cat, uint64_t start, int64_t arg)
+{
+    if (!trace_enabled)
+        return;
+    const uint64_t end = trace_clock();
+    const int t = thread_ring();
+    if (t < 0)
+        return;
+    trace_ring_t *ring = &rings[t];
+    if (ring->events == NULL)
+    {
+        ring->events = (trace_event_t *)mem_alloc(MEM_THREADS,
+                                                   TRACE_RING_EVENTS * sizeof(*ring->events));
+        if (ring->events == NULL)
+            return;
+    }
+    trace_event_t *ev = &ring->events[ring->count % TRACE_RING_EVENTS];
+    ev->name = name;
+    ev->cat = cat;
+    ev->start = start;
+    ev->end = end;
+    ev->arg = arg;
+    ring->count++;
+}
+
+void trace_rank_path(char *buf, size_t size, const char *path, int rank)
+{
+    const char *dot = strrchr(path, '.');
+    const char *slash = strrchr(path, '/');
+    if (dot == NULL || (slash != NULL && dot < slash))
+        dot = path + strlen(path);
+    snprintf(buf, size, "%.*s-%d%s", (int)(dot - path), path, rank, dot);
+}
+
+int trace_write(const char *path, int pid, const char *process)
+{
+    trace_enabled = 0;
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+                 "\"args\":{\"name\":\"%s\"}}",
+            pid, process);
+    for (int t = 0; t < TRACE_MAX_THREADS; t++)
+    {
+        trace_ring_t *ring = &rings[t];
+        if (ring->events == NULL)
+            continue;
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                     "\"args\":{\"name\":\"thread %d\"}}",
+                pid, t, t);
+        uint64_t first = 0;
+        if (ring->count > TRACE_RING_EVENTS)
+        {
+            first = ring->count - TRACE_RING_EVENTS;
+            fprintf(stderr, "%s: the oldest %llu events of thread %d were overwritten\n",
+                    path, (unsigned long long)first, t);
+        }
+        for (uint64_t k = first; k < ring->count; k++)
+        {
+            const trace_event_t *ev = &ring->events[k % TRACE_RING_EVENTS];
+            /* timestamps and durations are in microseconds */
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                         "\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%lld}}",
+                    ev->name, ev->cat, ((int64_t)ev->start + clock_offset) / 1e3,
+                    (ev->end - ev->start) / 1e3, pid, t, (long long)ev->arg);
+        }
+        mem_free(ring->events);
+        ring->events = NULL;
+    }
+    fprintf(out, "\n]}\n");
+    if (fclose(out) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+/****************************************************************************
+ *
+ * trace.h - Timeline of the phases, chunks and MPI calls of a run
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Each span of time (a phase of an iteration, an OpenMP chunk, an MPI
+ * call) is recorded as one event, with its begin and end times, into
+ * a ring buffer owned by the calling thread: no locks and no shared
+ * counters are involved, and when a ring is full the oldest events
+ * are overwritten. At the end of the run trace_write() saves all the
+ * events in the Chrome Trace Event format (JSON), which can be opened
+ * with Perfetto (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * When tracing is not enabled, trace_begin() returns 0 and
+ * trace_end() returns immediately.
+ *
+ ****************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Events kept for each thread */
+#define TRACE_RING_EVENTS (1 << 16)
+
+/* Threads that can record events; each thread records into its own
+   ring, that of its OpenMP thread number when it is free */
+#define TRACE_MAX_THREADS 256
+
+extern int trace_enabled;
+
+/**
+ * Start recording. Returns 0 on success, -1 on failure.
+ */
+int trace_open(void);
+
+/**
+ * Bytes of the events of each thread that records some.
+ */
+uint64_t trace_footprint(void);
+
+/**
+ * Current time of the trace clock, in nanoseconds.
+ */
+uint64_t trace_clock(void);
+
+/**
+ * Add `offset` nanoseconds to the times of the trace clock when
+ * writing them (by default, minus the time of trace_open(), so that
+ * the timeline starts at 0). MPI processes align their timelines by
+ * passing their estimated skew from the clock of rank 0 minus the time
+ * of rank 0 at which the timeline starts.
+ */
+void trace_set_offset(int64_t offset);
+
+/**
+ * Begin a span: returns the current time, or 0 if tracing is off.
+ */
+uint64_t trace_begin(void);
+
+/**
+ * Record the span `name` of category `cat` (both static strings) that
+ * began at `start` and ends now; `arg` is shown with the event (e.g.
+ * the iteration or the number of bytes).
+ */
+void trace_end(const char *name, const char *cat, uint64_t start, int64_t arg);
+
+/**
+ * Name of the trace file of process `rank`: `path` with "-RANK"
+ * inserted before the extension (trace.json -> trace-3.json).
+ */
+void trace_rank_path(char *buf, size_t size, const char *path, int rank);
+
+/**
+ * Write the events to `path` as process `pid` named `process`, and
+ * stop recording. Returns 0 on success, -1 on failure.
+ */
+int trace_write(const char *path, int pid, const char *process);
+
+#endif
@@ -0,0 +1,132 @@
+/****************************************************************************
+ *
+ * traj2gp.c - Convert a trajectory file into gnuplot files
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***
+% Trajectory to gnuplot converter
+% Alessandro Monticelli
+
+Regenerates, from a trajectory written with `--trajectory`, the
+`PREFIX-xxxxx.gp` files that the programs compiled with -DMOVIE write
+at each iteration (xxxxx is the iteration number). Only the circles
+stored in each frame are written, i.e., those inside the region of
+interest, if one was set.
+
+To compile:
+
+        gcc -std=c99 -Wall -Wpedantic traj2gp.c trajectory.c filewriter.c asyncwriter.c memtrack.c -o traj2gp -lm -pthread
+
+To execute:
+
+        ./traj2gp FILE [PREFIX]
+
+where PREFIX defaults to `circles`. The files can then be processed
+as usual:
+
+        for f in PREFIX-*.gp; do gnuplot "$f"; done
+
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "trajectory.h"
+
+/**
+ * Write frame `x[]`, `y[]`, `r[]` as a gnuplot file, in the same
+ * format used by dump_circles().
+ */
+int write_gp(const char *prefix, long iterno, const traj_header_t *h,
+             const float *x, const float *y, const float *r, const uint8_t *present)
+{
+    char fname[1024];
+    snprintf(fname, sizeof(fname), "%s-%05ld.gp", prefix, iterno);
+    FILE *out = fopen(fname, "w");
+    if (out == NULL)
+    {
+        perror(fname);
+        return -1;
+    }
+    const float WIDTH = h->xmax - h->xmin;
+    const float HEIGHT = h->ymax - h->ymin;
+    fprintf(out, "set term png notransparent large\n");
+    fprintf(out, "set output \"%s-%05ld.png\"\n", prefix, iterno);
+    fprintf(out, "set xrange [%f:%f]\n", h->xmin - WIDTH * .2, h->xmax + WIDTH * .2);
+    fprintf(out, "set yrange [%f:%f]\n", h->ymin - HEIGHT * .2, h->ymax + HEIGHT * .2);
+    fprintf(out, "set size square\n");
+    fprintf(out, "plot '-' with circles notitle\n");
+    for (uint64_t i = 0; i < h->ncircles; i++)
+    {
+        if (present[i])
+            fprintf(out, "%f %f %f\n", x[i], y[i], r[i]);
+    }
+    fprintf(out, "e\n");
+    return fclose(out);
+}
+
+int main(int argc, char *argv[])
+{
+    traj_reader_t rd;
+
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s FILE [PREFIX]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *prefix = (argc > 2) ? argv[2] : "circles";
+
+    if (traj_reader_open(&rd, argv[1]) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    const uint64_t n = rd.hdr.ncircles;
+    float *x = (float *)malloc((n + 1) * sizeof(*x));
+    float *y = (float *)malloc((n + 1) * sizeof(*y));
+    uint8_t *present = (uint8_t *)malloc(n + 1);
+    if (x == NULL || y == NULL || present == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_SUCCESS;
+    for (uint64_t k = 0; k < rd.hdr.nframes; k++)
+    {
+        traj_frame_header_t fh;
+        if (traj_reader_frame(&rd, k, x, y, present, &fh) != 0)
+        {
+            fprintf(stderr, "%s: frame %llu is corrupted\n", argv[1], (unsigned long long)k);
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (write_gp(prefix, (long)fh.iteration, &rd.hdr, x, y, rd.r, present) != 0)
+        {
+            status = EXIT_FAILURE;
+            break;
+        }
+    }
+    if (status == EXIT_SUCCESS)
+    {
+        printf("%llu frames written\n", (unsigned long long)rd.hdr.nframes);
+    }
+
+    free(x);
+    free(y);
+    free(present);
+    traj_reader_close(&rd);
+    return status;
+}
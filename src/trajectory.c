@@ -0,0 +1,624 @@
+/****************************************************************************
+ *
+ * trajectory.c - Compact single-file trajectories of a set of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 700
+#include "trajectory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "memtrack.h"
+
+/* Maximum size of a LEB128-encoded uint32_t */
+#define VARINT_MAX 5
+
+/* The waits for the writer are reported when they add up to more than
+   this many seconds; a few short ones are normal */
+#define TRAJ_STALL_REPORT 0.05
+
+void traj_header_init(traj_header_t *hdr, uint64_t n,
+                      float xmin, float xmax, float ymin, float ymax)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, TRAJ_MAGIC, sizeof(hdr->magic));
+    hdr->version = TRAJ_VERSION;
+    hdr->byte_order = TRAJ_BYTE_ORDER;
+    hdr->ncircles = n;
+    hdr->every = 1;
+    hdr->keyframe_interval = TRAJ_KEYFRAME_INTERVAL;
+    hdr->quantum = TRAJ_DEFAULT_QUANTUM;
+    hdr->xmin = xmin;
+    hdr->xmax = xmax;
+    hdr->ymin = ymin;
+    hdr->ymax = ymax;
+    hdr->radii_offset = sizeof(*hdr);
+    hdr->frames_offset = hdr->radii_offset + n * sizeof(float);
+}
+
+int traj_header_set_roi(traj_header_t *hdr, const char *roi)
+{
+    float v[4];
+    if (sscanf(roi, "%f,%f,%f,%f", &v[0], &v[1], &v[2], &v[3]) != 4 ||
+        v[0] >= v[2] || v[1] >= v[3])
+    {
+        return -1;
+    }
+    memcpy(hdr->roi, v, sizeof(v));
+    hdr->flags |= TRAJ_ROI;
+    return 0;
+}
+
+int traj_is_keyframe(const traj_header_t *hdr, uint64_t frame)
+{
+    return hdr->keyframe_interval <= 1 || frame % hdr->keyframe_interval == 0;
+}
+
+/**
+ * Quantized representation of coordinate `v` with origin `o`.
+ */
+static inline uint32_t quantize(float v, float o, float quantum)
+{
+    if (quantum == 0)
+    {
+        uint32_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        return bits;
+    }
+    double q = nearbyint(((double)v - o) / quantum);
+    if (q > INT32_MAX)
+        q = INT32_MAX;
+    if (q < INT32_MIN)
+        q = INT32_MIN;
+    return (uint32_t)(int32_t)q;
+}
+
+static inline float dequantize(uint32_t q, float o, float quantum)
+{
+    if (quantum == 0)
+    {
+        float v;
+        memcpy(&v, &q, sizeof(v));
+        return v;
+    }
+    return (float)(o + (double)(int32_t)q * quantum);
+}
+
+/**
+ * Difference between `q` and the previous value `p`, mapped to a
+ * small unsigned integer: zigzag encoding of q - p for quantized
+ * values, XOR of the bit patterns for lossless ones.
+ */
+static inline uint32_t delta_encode(uint32_t q, uint32_t p, int lossless)
+{
+    if (lossless)
+        return q ^ p;
+    const int32_t d = (int32_t)(q - p);
+    return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+}
+
+static inline uint32_t delta_decode(uint32_t z, uint32_t p, int lossless)
+{
+    if (lossless)
+        return z ^ p;
+    return p + ((z >> 1) ^ (0u - (z & 1)));
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static inline const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+    uint32_t val = 0;
+    for (int shift = 0; p < end && shift < 7 * VARINT_MAX; shift += 7)
+    {
+        const uint8_t b = *p++;
+        val |= (uint32_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+        {
+            *v = val;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static inline int inside_roi(const float roi[4], float x, float y)
+{
+    return x >= roi[0] && x <= roi[2] && y >= roi[1] && y <= roi[3];
+}
+
+int traj_encoder_init(traj_encoder_t *enc, const traj_header_t *hdr,
+                      uint64_t first, uint64_t count)
+{
+    memset(enc, 0, sizeof(*enc));
+    enc->quantum = hdr->quantum;
+    enc->ox = hdr->xmin;
+    enc->oy = hdr->ymin;
+    enc->flags = hdr->flags;
+    memcpy(enc->roi, hdr->roi, sizeof(enc->roi));
+    enc->first = first;
+    enc->count = count;
+    enc->prev = (uint32_t *)mem_calloc(MEM_OUTPUT, 2 * count + 1, sizeof(*enc->prev));
+    enc->buf = (uint8_t *)mem_alloc(MEM_OUTPUT, sizeof(traj_block_header_t) + (count + 7) / 8 +
+                                    2 * count * VARINT_MAX);
+    if (enc->prev == NULL || enc->buf == NULL)
+    {
+        traj_encoder_free(enc);
+        return -1;
+    }
+    return 0;
+}
+
+size_t traj_encode_block(traj_encoder_t *enc, const circle_view_t *v, int keyframe)
+{
+    const int lossless = (enc->quantum == 0);
+    const int roi = (enc->flags & TRAJ_ROI) != 0;
+    const uint64_t n = enc->count;
+    uint8_t *bitmap = enc->buf + sizeof(traj_block_header_t);
+    uint8_t *p = bitmap;
+    uint32_t *prev = enc->prev;
+
+    if (keyframe)
+        memset(prev, 0, 2 * n * sizeof(*prev));
+    if (roi)
+    {
+        memset(bitmap, 0, (n + 7) / 8);
+        p += (n + 7) / 8;
+    }
+    for (uint64_t i = 0; i < n; i++)
+    {
+        const float x = VIEW_X(v, i), y = VIEW_Y(v, i);
+        if (roi)
+        {
+            if (!inside_roi(enc->roi, x, y))
+                continue;
+            bitmap[i / 8] |= (uint8_t)(1u << (i % 8));
+        }
+        const uint32_t qx = quantize(x, enc->ox, enc->quantum);
+        const uint32_t qy = quantize(y, enc->oy, enc->quantum);
+        p = put_varint(p, delta_encode(qx, prev[2 * i], lossless));
+        p = put_varint(p, delta_encode(qy, prev[2 * i + 1], lossless));
+        prev[2 * i] = qx;
+        prev[2 * i + 1] = qy;
+    }
+    traj_block_header_t bh;
+    bh.first = enc->first;
+    bh.count = n;
+    bh.size = p - bitmap;
+    memcpy(enc->buf, &bh, sizeof(bh));
+    enc->size = p - enc->buf;
+    return enc->size;
+}
+
+uint64_t traj_encoder_footprint(uint64_t count)
+{
+    return (2 * count + 1) * sizeof(uint32_t) + sizeof(traj_block_header_t) +
+           (count + 7) / 8 + 2 * count * VARINT_MAX;
+}
+
+void traj_encoder_free(traj_encoder_t *enc)
+{
+    mem_free(enc->prev);
+    mem_free(enc->buf);
+    memset(enc, 0, sizeof(*enc));
+}
+
+int traj_index_append(traj_index_entry_t **index, size_t *cap, uint64_t n,
+                      int64_t iteration, uint64_t offset, uint64_t size,
+                      uint32_t flags)
+{
+    if (n >= *cap)
+    {
+        const size_t newcap = *cap ? 2 * *cap : 256;
+        traj_index_entry_t *p =
+            (traj_index_entry_t *)mem_realloc(MEM_OUTPUT, *index, newcap * sizeof(*p));
+        if (p == NULL)
+            return -1;
+        *index = p;
+        *cap = newcap;
+    }
+    traj_index_entry_t *e = &(*index)[n];
+    memset(e, 0, sizeof(*e));
+    e->iteration = iteration;
+    e->offset = offset;
+    e->size = size;
+    e->flags = flags;
+    return 0;
+}
+
+uint64_t traj_index_footprint(uint64_t nframes)
+{
+    uint64_t cap = 0;
+    while (cap < nframes)
+        cap = cap ? 2 * cap : 256;
+    return cap * sizeof(traj_index_entry_t);
+}
+
+/**
+ * Encode the positions `v` as the next frame and write it.
+ */
+static void emit_frame(traj_writer_t *w, int64_t iteration, int64_t overlaps,
+                       const circle_view_t *v)
+{
+    const int key = traj_is_keyframe(&w->hdr, w->hdr.nframes);
+    const size_t size = traj_encode_block(&w->enc, v, key);
+    traj_frame_header_t *fh = &w->fh;
+    memset(fh, 0, sizeof(*fh));
+    fh->magic = TRAJ_FRAME_MAGIC;
+    fh->flags = key ? TRAJ_KEYFRAME : 0;
+    fh->iteration = iteration;
+    fh->overlaps = overlaps;
+    fh->nblocks = 1;
+    fh->size = size;
+    if (file_writer_write(&w->fw, fh, sizeof(*fh), w->offset) != 0 ||
+        file_writer_write(&w->fw, w->enc.buf, size, w->offset + sizeof(*fh)) != 0 ||
+        file_writer_flush(&w->fw) != 0 ||
+        traj_index_append(&w->index, &w->index_cap, w->hdr.nframes, iteration,
+                          w->offset, sizeof(*fh) + size, fh->flags) != 0)
+    {
+        w->failed = 1;
+        return;
+    }
+    w->offset += sizeof(*fh) + size;
+    w->hdr.nframes++;
+}
+
+/**
+ * Runs on the writer thread: the buffer holds the (x, y) pairs of
+ * all the circles.
+ */
+static void consume_frame(void *ctx, async_buffer_t *buf)
+{
+    traj_writer_t *w = (traj_writer_t *)ctx;
+    float *xy = (float *)buf->data;
+    const circle_view_t v = {xy, xy + 1, NULL, 2 * sizeof(float)};
+    if (!w->failed)
+        emit_frame(w, buf->tag[0], buf->tag[1], &v);
+}
+
+int traj_writer_open(traj_writer_t *w, const char *path,
+                     const traj_header_t *hdr, const circle_view_t *v,
+                     int nbuffers)
+{
+    const uint64_t n = hdr->ncircles;
+    memset(w, 0, sizeof(*w));
+    w->hdr = *hdr;
+    w->hdr.radii_offset = sizeof(w->hdr);
+    w->hdr.frames_offset = w->hdr.radii_offset + n * sizeof(float);
+    w->hdr.index_offset = 0;
+    w->hdr.nframes = 0;
+    if (w->hdr.every < 1)
+        w->hdr.every = 1;
+    float *r = (float *)mem_alloc(MEM_OUTPUT, (n + 1) * sizeof(*r));
+    if (r == NULL || traj_encoder_init(&w->enc, &w->hdr, 0, n) != 0)
+    {
+        fprintf(stderr, "%s: out of memory\n", path);
+        mem_free(r);
+        return -1;
+    }
+    if (file_writer_open(&w->fw, path) != 0)
+    {
+        traj_encoder_free(&w->enc);
+        mem_free(r);
+        return -1;
+    }
+    for (uint64_t i = 0; i < n; i++)
+    {
+        r[i] = VIEW_R(v, i);
+    }
+    const int ok = file_writer_write(&w->fw, &w->hdr, sizeof(w->hdr), 0) == 0 &&
+                   file_writer_write(&w->fw, r, n * sizeof(*r), w->hdr.radii_offset) == 0 &&
+                   file_writer_flush(&w->fw) == 0;
+    mem_free(r);
+    w->offset = w->hdr.frames_offset;
+    w->open = 1;
+    if (!ok)
+    {
+        traj_writer_close(w);
+        return -1;
+    }
+    if (nbuffers > 0)
+    {
+        if (async_writer_start(&w->aw, nbuffers, (2 * n + 1) * sizeof(float),
+                               consume_frame, w) != 0)
+        {
+            fprintf(stderr, "%s: cannot start the writer thread\n", path);
+            traj_writer_close(w);
+            return -1;
+        }
+        w->async = 1;
+    }
+    return 0;
+}
+
+uint64_t traj_writer_footprint(uint64_t ncircles, uint64_t nframes, int nbuffers)
+{
+    /* the radii are freed before the frame buffers are allocated */
+    const uint64_t radii = (ncircles + 1) * sizeof(float);
+    const uint64_t buffers = (uint64_t)nbuffers * (2 * ncircles + 1) * sizeof(float);
+    return traj_encoder_footprint(ncircles) + traj_index_footprint(nframes) +
+           (buffers > radii ? buffers : radii);
+}
+
+int traj_writer_frame(traj_writer_t *w, int64_t iteration, int64_t overlaps,
+                      const circle_view_t *v)
+{
+    if (iteration % w->hdr.every != 0)
+        return 0;
+    if (!w->async)
+    {
+        emit_frame(w, iteration, overlaps, v);
+        return w->failed ? -1 : 0;
+    }
+    /* The only work left on the caller is one pass over the positions */
+    async_buffer_t *buf = async_writer_acquire(&w->aw);
+    float *xy = (float *)buf->data;
+    for (uint64_t i = 0; i < w->hdr.ncircles; i++)
+    {
+        xy[2 * i] = VIEW_X(v, i);
+        xy[2 * i + 1] = VIEW_Y(v, i);
+    }
+    buf->len = 2 * w->hdr.ncircles * sizeof(float);
+    buf->tag[0] = iteration;
+    buf->tag[1] = overlaps;
+    async_writer_submit(&w->aw, buf);
+    return 0;
+}
+
+int traj_writer_close(traj_writer_t *w)
+{
+    if (w->async)
+    {
+        async_writer_stop(&w->aw);
+        if (w->aw.stall_time >= TRAJ_STALL_REPORT)
+        {
+            fprintf(stderr, "%s: the simulation waited %llu times for the trajectory "
+                            "writer (%.3f s in total, %llu frames)\n",
+                    w->fw.path, (unsigned long long)w->aw.stalls, w->aw.stall_time,
+                    (unsigned long long)w->aw.frames);
+        }
+    }
+    int ok = !w->failed;
+    if (ok)
+    {
+        w->hdr.index_offset = w->offset;
+        /* the header is rewritten with the position of the index */
+        ok = file_writer_write(&w->fw, w->index, w->hdr.nframes * sizeof(*w->index),
+                               w->offset) == 0 &&
+             file_writer_write(&w->fw, &w->hdr, sizeof(w->hdr), 0) == 0;
+    }
+    if (file_writer_close(&w->fw) != 0)
+        ok = 0;
+    traj_encoder_free(&w->enc);
+    mem_free(w->index);
+    memset(w, 0, sizeof(*w));
+    return ok ? 0 : -1;
+}
+
+/**
+ * Rebuild the index of a trajectory that was not closed properly, by
+ * following the chain of frame headers up to the first truncated one.
+ */
+static int rebuild_index(traj_reader_t *rd)
+{
+    size_t cap = 0;
+    uint64_t off = rd->hdr.frames_offset;
+    rd->hdr.nframes = 0;
+    while (off + sizeof(traj_frame_header_t) <= rd->size)
+    {
+        traj_frame_header_t fh;
+        memcpy(&fh, rd->map + off, sizeof(fh));
+        const uint64_t size = sizeof(fh) + fh.size;
+        if (fh.magic != TRAJ_FRAME_MAGIC || fh.size > rd->size - off - sizeof(fh))
+            break;
+        if (traj_index_append(&rd->index, &cap, rd->hdr.nframes, fh.iteration,
+                              off, size, fh.flags) != 0)
+            return -1;
+        rd->hdr.nframes++;
+        off += size;
+    }
+    return 0;
+}
+
+int traj_reader_open(traj_reader_t *rd, const char *path)
+{
+    struct stat st;
+    memset(rd, 0, sizeof(*rd));
+    rd->current = -1;
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(traj_header_t))
+    {
+        fprintf(stderr, "%s: not a trajectory file\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: mmap failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+    rd->map = (const uint8_t *)map;
+    rd->size = st.st_size;
+    memcpy(&rd->hdr, rd->map, sizeof(rd->hdr));
+    const traj_header_t *h = &rd->hdr;
+    if (memcmp(h->magic, TRAJ_MAGIC, sizeof(h->magic)) != 0 ||
+        h->byte_order != TRAJ_BYTE_ORDER || h->version != TRAJ_VERSION ||
+        h->radii_offset + h->ncircles * sizeof(float) > rd->size ||
+        h->frames_offset > rd->size)
+    {
+        fprintf(stderr, "%s: not a valid trajectory file\n", path);
+        traj_reader_close(rd);
+        return -1;
+    }
+    rd->r = (const float *)(rd->map + h->radii_offset);
+    rd->prev = (uint32_t *)mem_calloc(MEM_OUTPUT, 2 * h->ncircles + 1, sizeof(*rd->prev));
+    if (rd->prev == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", path);
+        traj_reader_close(rd);
+        return -1;
+    }
+    if (h->index_offset != 0 &&
+        h->index_offset + h->nframes * sizeof(traj_index_entry_t) <= rd->size)
+    {
+        rd->index = (traj_index_entry_t *)mem_alloc(MEM_OUTPUT,
+                                                     h->nframes * sizeof(*rd->index) + 1);
+        if (rd->index != NULL)
+            memcpy(rd->index, rd->map + h->index_offset, h->nframes * sizeof(*rd->index));
+    }
+    else if (rebuild_index(rd) != 0)
+    {
+        fprintf(stderr, "%s: out of memory\n", path);
+        traj_reader_close(rd);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Decode the block starting at `p` into the decoder state.
+ */
+static const uint8_t *decode_block(traj_reader_t *rd, const uint8_t *p, const uint8_t *end,
+                                   uint8_t *present)
+{
+    const traj_header_t *h = &rd->hdr;
+    const int lossless = (h->quantum == 0);
+    traj_block_header_t bh;
+    if ((size_t)(end - p) < sizeof(bh))
+        return NULL;
+    memcpy(&bh, p, sizeof(bh));
+    p += sizeof(bh);
+    if (bh.first > h->ncircles || bh.count > h->ncircles - bh.first ||
+        bh.size > (uint64_t)(end - p))
+        return NULL;
+    const uint8_t *bitmap = NULL;
+    const uint8_t *bend = p + bh.size;
+    if (h->flags & TRAJ_ROI)
+    {
+        bitmap = p;
+        p += (bh.count + 7) / 8;
+    }
+    for (uint64_t i = 0; i < bh.count; i++)
+    {
+        const uint64_t c = bh.first + i;
+        const int in = (bitmap == NULL) || (bitmap[i / 8] >> (i % 8) & 1);
+        if (present != NULL)
+            present[c] = (uint8_t)in;
+        if (!in)
+            continue;
+        uint32_t zx, zy;
+        if ((p = get_varint(p, bend, &zx)) == NULL || (p = get_varint(p, bend, &zy)) == NULL)
+            return NULL;
+        rd->prev[2 * c] = delta_decode(zx, rd->prev[2 * c], lossless);
+        rd->prev[2 * c + 1] = delta_decode(zy, rd->prev[2 * c + 1], lossless);
+    }
+    return bend;
+}
+
+/**
+ * Apply frame `k` to the decoder state.
+ */
+static int decode_frame(traj_reader_t *rd, uint64_t k, uint8_t *present,
+                        traj_frame_header_t *fh)
+{
+    const traj_index_entry_t *e = &rd->index[k];
+    if (e->offset > rd->size || e->size > rd->size - e->offset || e->size < sizeof(*fh))
+        return -1;
+    const uint8_t *p = rd->map + e->offset;
+    const uint8_t *end = p + e->size;
+    memcpy(fh, p, sizeof(*fh));
+    if (fh->magic != TRAJ_FRAME_MAGIC)
+        return -1;
+    p += sizeof(*fh);
+    if (fh->flags & TRAJ_KEYFRAME)
+        memset(rd->prev, 0, 2 * rd->hdr.ncircles * sizeof(*rd->prev));
+    for (uint32_t b = 0; b < fh->nblocks; b++)
+    {
+        if ((p = decode_block(rd, p, end, present)) == NULL)
+            return -1;
+    }
+    rd->current = k;
+    return 0;
+}
+
+int traj_reader_frame(traj_reader_t *rd, uint64_t k, float *x, float *y,
+                      uint8_t *present, traj_frame_header_t *fh)
+{
+    const traj_header_t *h = &rd->hdr;
+    traj_frame_header_t tmp;
+    if (k >= h->nframes)
+        return -1;
+    /* Frames after a keyframe depend on all the previous ones: start
+       from the nearest keyframe unless we are moving forward from it */
+    uint64_t start = k;
+    while (start > 0 && !(rd->index[start].flags & TRAJ_KEYFRAME))
+        start--;
+    if (rd->current >= (int64_t)start && rd->current < (int64_t)k)
+        start = rd->current + 1;
+    if (present != NULL && (h->flags & TRAJ_ROI))
+        memset(present, 0, h->ncircles);
+    for (uint64_t j = start; j <= k; j++)
+    {
+        if (decode_frame(rd, j, (j == k) ? present : NULL, fh ? fh : &tmp) != 0)
+        {
+            rd->current = -1;
+            return -1;
+        }
+    }
+    if (present != NULL && !(h->flags & TRAJ_ROI))
+        memset(present, 1, h->ncircles);
+    for (uint64_t i = 0; i < h->ncircles; i++)
+    {
+        x[i] = dequantize(rd->prev[2 * i], h->xmin, h->quantum);
+        y[i] = dequantize(rd->prev[2 * i + 1], h->ymin, h->quantum);
+    }
+    return 0;
+}
+
+void traj_reader_close(traj_reader_t *rd)
+{
+    if (rd->map != NULL)
+        munmap((void *)rd->map, rd->size);
+    mem_free(rd->index);
+    mem_free(rd->prev);
+    memset(rd, 0, sizeof(*rd));
+}
@@ -0,0 +1,271 @@
+/****************************************************************************
+ *
+ * trajectory.h - Compact single-file trajectories of a set of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * A trajectory file stores the positions of the circles at many
+ * iterations. Its layout is:
+ *
+ *        traj_header_t
+ *        float r[ncircles]               radii, stored once
+ *        frame 0, frame 1, ...
+ *        traj_index_entry_t[nframes]     frame index
+ *
+ * Each frame is a traj_frame_header_t followed by `nblocks` blocks;
+ * a block covers the contiguous range of circles [first, first+count)
+ * and is made of a traj_block_header_t and `size` bytes of encoded
+ * positions. The serial programs write a single block per frame; the
+ * MPI program may write one block per rank.
+ *
+ * Positions are quantized to multiples of `quantum` relative to
+ * (xmin, ymin) and each coordinate is stored as the zigzag-encoded
+ * difference from the value the same circle had in the previous
+ * frame it was stored in, as a variable-length integer (LEB128), so
+ * that slow circles take one or two bytes per coordinate. With
+ * quantum == 0 the raw bit patterns of the floats are XORed with the
+ * previous ones instead, and the trajectory is lossless. Every
+ * `keyframe_interval` frames the differences restart from zero, so
+ * that a frame can be decoded without reading the whole file.
+ *
+ * If a region of interest is set (TRAJ_ROI), each block starts with
+ * a bitmap of the circles whose center lies inside the region, and
+ * only those are stored.
+ *
+ * The index is written when the file is closed; if it is missing
+ * (e.g., the program was killed), the reader rebuilds it by scanning
+ * the frames.
+ *
+ ****************************************************************************/
+
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "view.h"
+#include "filewriter.h"
+#include "asyncwriter.h"
+
+#define TRAJ_MAGIC "CIRCTRAJ"
+#define TRAJ_VERSION 1
+#define TRAJ_BYTE_ORDER 0x01020304u
+#define TRAJ_FRAME_MAGIC 0x4d415246u /* "FRAM" */
+#define TRAJ_KEYFRAME_INTERVAL 32
+#define TRAJ_DEFAULT_QUANTUM 1e-3f
+
+/* header flags */
+#define TRAJ_ROI 0x1
+
+/* frame flags */
+#define TRAJ_KEYFRAME 0x1
+
+typedef struct
+{
+    char magic[8];              /* TRAJ_MAGIC, not NUL-terminated */
+    uint32_t version;           /* TRAJ_VERSION */
+    uint32_t byte_order;        /* TRAJ_BYTE_ORDER as written by the producer */
+    uint64_t ncircles;
+    uint32_t every;             /* one frame every `every` iterations */
+    uint32_t keyframe_interval; /* frames between two keyframes */
+    uint32_t flags;             /* TRAJ_ROI */
+    float quantum;              /* quantization step; 0 means lossless */
+    float xmin, xmax;           /* domain of the simulation */
+    float ymin, ymax;
+    float roi[4];               /* region of interest x0, y0, x1, y1 */
+    uint64_t radii_offset;      /* file offset of r[] */
+    uint64_t frames_offset;     /* file offset of the first frame */
+    uint64_t index_offset;      /* file offset of the index, 0 if missing */
+    uint64_t nframes;           /* number of entries of the index */
+} traj_header_t;
+
+typedef struct
+{
+    uint32_t magic;             /* TRAJ_FRAME_MAGIC */
+    uint32_t flags;             /* TRAJ_KEYFRAME */
+    int64_t iteration;          /* iteration number (0 = initial state) */
+    int64_t overlaps;           /* overlaps found in the iteration, -1 if unknown */
+    uint32_t nblocks;
+    uint32_t reserved;
+    uint64_t size;              /* bytes of the blocks following the header */
+} traj_frame_header_t;
+
+typedef struct
+{
+    uint64_t first, count;      /* range of circles */
+    uint64_t size;              /* bytes of encoded data following the header */
+} traj_block_header_t;
+
+typedef struct
+{
+    int64_t iteration;
+    uint64_t offset;            /* file offset of the frame header */
+    uint64_t size;              /* size of the frame, header included */
+    uint32_t flags;             /* frame flags */
+    uint32_t reserved;
+} traj_index_entry_t;
+
+/* Encoder of the blocks of a range of circles */
+typedef struct
+{
+    float quantum, ox, oy;      /* quantization step and origin */
+    uint32_t flags;
+    float roi[4];
+    uint64_t first, count;      /* range of circles */
+    uint32_t *prev;             /* [2*count] last stored values */
+    uint8_t *buf;               /* encoded block, header included */
+    size_t size;                /* bytes used in buf */
+} traj_encoder_t;
+
+/* Sequential writer of a whole trajectory file */
+typedef struct
+{
+    file_writer_t fw;
+    int open;                   /* nonzero between open and close */
+    traj_header_t hdr;
+    traj_encoder_t enc;
+    traj_frame_header_t fh;     /* header of the frame being written */
+    uint64_t offset;            /* current end of file */
+    traj_index_entry_t *index;
+    size_t index_cap;
+    int async;                  /* nonzero if a writer thread is used */
+    async_writer_t aw;
+    int failed;                 /* nonzero after a write error */
+} traj_writer_t;
+
+/* Random-access reader */
+typedef struct
+{
+    traj_header_t hdr;
+    const uint8_t *map;
+    size_t size;
+    const float *r;             /* radii inside the mapping */
+    traj_index_entry_t *index;  /* [hdr.nframes] */
+    uint32_t *prev;             /* [2*ncircles] decoder state */
+    int64_t current;            /* last decoded frame, -1 if none */
+} traj_reader_t;
+
+/**
+ * Fill `hdr` with the default values for `n` circles in the domain
+ * [xmin, xmax] x [ymin, ymax]: one frame per iteration, quantum
+ * TRAJ_DEFAULT_QUANTUM, no region of interest.
+ */
+void traj_header_init(traj_header_t *hdr, uint64_t n,
+                      float xmin, float xmax, float ymin, float ymax);
+
+/**
+ * Set the region of interest of `hdr`, parsed from the string
+ * "x0,y0,x1,y1". Returns 0 on success, -1 if the string is malformed.
+ */
+int traj_header_set_roi(traj_header_t *hdr, const char *roi);
+
+/**
+ * Return nonzero iff frame number `frame` must be a keyframe.
+ */
+int traj_is_keyframe(const traj_header_t *hdr, uint64_t frame);
+
+/**
+ * Prepare `enc` to encode the circles [first, first+count) of a
+ * trajectory with header `hdr`. Returns 0 on success, -1 on failure.
+ */
+int traj_encoder_init(traj_encoder_t *enc, const traj_header_t *hdr,
+                      uint64_t first, uint64_t count);
+
+/**
+ * Encode the block of circles described by `v` (whose element 0 is
+ * circle `enc->first`) into `enc->buf`; returns the size of the
+ * block, header included.
+ */
+size_t traj_encode_block(traj_encoder_t *enc, const circle_view_t *v, int keyframe);
+
+void traj_encoder_free(traj_encoder_t *enc);
+
+/**
+ * Bytes allocated by traj_encoder_init() for `count` circles.
+ */
+uint64_t traj_encoder_footprint(uint64_t count);
+
+/**
+ * Create the trajectory file `path` with header `hdr` (whose offsets
+ * are filled in), and store the radii of the circles described by
+ * `v`. If `nbuffers` > 0, frames are encoded and written by a writer
+ * thread through a pool of `nbuffers` frame buffers (see
+ * asyncwriter.h); otherwise they are written by the caller. Returns
+ * 0 on success, -1 on failure.
+ */
+int traj_writer_open(traj_writer_t *w, const char *path,
+                     const traj_header_t *hdr, const circle_view_t *v,
+                     int nbuffers);
+
+/**
+ * Append the positions `v` at iteration `iteration` as a new frame,
+ * unless the iteration is skipped because of subsampling. With a
+ * writer thread, the positions are copied into a free buffer and the
+ * function returns immediately, unless no buffer is free. Returns 0
+ * on success, -1 on failure.
+ */
+int traj_writer_frame(traj_writer_t *w, int64_t iteration, int64_t overlaps,
+                      const circle_view_t *v);
+
+/**
+ * Wait for the pending frames, append the frame index and close the
+ * file. If the simulation had to wait for the writer thread, the
+ * stalls are reported on stderr. Returns 0 on success, -1 on failure.
+ */
+int traj_writer_close(traj_writer_t *w);
+
+/**
+ * Bytes that a writer of `ncircles` circles with `nbuffers` frame
+ * buffers allocates at most, when it writes `nframes` frames.
+ */
+uint64_t traj_writer_footprint(uint64_t ncircles, uint64_t nframes, int nbuffers);
+
+/**
+ * Append the entry of a frame of `size` bytes to the index `*index`,
+ * which holds `n` entries and has room for `*cap`. Returns 0 on
+ * success, -1 if out of memory.
+ */
+int traj_index_append(traj_index_entry_t **index, size_t *cap, uint64_t n,
+                      int64_t iteration, uint64_t offset, uint64_t size,
+                      uint32_t flags);
+
+/**
+ * Bytes of an index grown by traj_index_append() to `nframes` entries.
+ */
+uint64_t traj_index_footprint(uint64_t nframes);
+
+/**
+ * Map the trajectory `path` into memory. Returns 0 on success, -1 on
+ * failure (a message is printed on stderr).
+ */
+int traj_reader_open(traj_reader_t *rd, const char *path);
+
+/**
+ * Decode frame number `k` into `x[]`, `y[]` (ncircles elements each).
+ * If `present` is not NULL, present[i] is set to 1 iff circle `i` is
+ * stored in the frame (i.e., it was inside the region of interest);
+ * the coordinates of the other circles are undefined, since the delta
+ * state is reset at every keyframe, and must be skipped. If
+ * `fh` is not NULL, the header of the frame is copied into it.
+ * Returns 0 on success, -1 if the frame is corrupted.
+ */
+int traj_reader_frame(traj_reader_t *rd, uint64_t k, float *x, float *y,
+                      uint8_t *present, traj_frame_header_t *fh);
+
+void traj_reader_close(traj_reader_t *rd);
+
+#endif
@@ -0,0 +1,590 @@
+/****************************************************************************
+ *
+ * trajstat.c - Statistics of the frames of a trajectory file
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***
+% Trajectory statistics
+% Alessandro Monticelli
+
+Reads a trajectory written with `--trajectory` frame by frame and
+computes, for each frame, the overlapping pairs of circles (with the
+same test used by compute_forces()), the depth of the overlaps, the
+clusters of circles connected by overlaps, and how far each circle
+moved since the previous frame. The results are written as CSV files:
+
+- `PREFIX-frames.csv`: one line per frame with the iteration, the
+  overlapping pairs, the overlaps recorded by the simulation (which
+  were computed on the positions of the previous frame, -1 if
+  unknown), the mean and maximum relative depth of the overlaps
+  ((r1 + r2 - d) / (r1 + r2)), the number of clusters, the size of
+  the largest one and the mean displacement of the circles since the
+  previous frame;
+
+- `PREFIX-overlaps.csv`: histogram of the relative depths of all the
+  overlaps of all the frames;
+
+- `PREFIX-clusters.csv`: histogram of the sizes of the clusters of
+  all the frames (an isolated circle is a cluster of size 1);
+
+- `PREFIX-displacement.csv`: for each circle, the length of its path
+  and the distance between its first and last position.
+
+Frames are decoded sequentially, in a single pass over the file, by
+a separate thread that stays a few frames ahead of the analysis; each
+frame is then analysed by all the OpenMP threads. Overlapping pairs
+are found through a uniform grid whose cells are as large as the
+largest circle, so that only the circles in the 3x3 neighboring cells
+need to be tested. With a region of interest only the stored circles
+are considered.
+
+To compile:
+
+        gcc -std=c99 -fopenmp -O2 -Wall -Wpedantic trajstat.c trajectory.c filewriter.c asyncwriter.c memtrack.c -o trajstat -lm -pthread
+
+To execute:
+
+        ./trajstat FILE [PREFIX]
+
+where PREFIX defaults to `circles`. Use `OMP_NUM_THREADS` to choose
+the number of threads.
+
+***/
+
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <omp.h>
+#include "trajectory.h"
+#include "libcircles.h"
+
+/* Frames decoded ahead of the analysis */
+#define PREFETCH 4
+
+/* Bins of the histogram of the relative overlap depths */
+#define DEPTH_BINS 20
+
+typedef struct
+{
+    float *x, *y;
+    uint8_t *present;
+    traj_frame_header_t fh;
+    int status;                 /* 0, or -1 if the frame is corrupted */
+} frame_t;
+
+/* Decoder thread and the frames it has decoded */
+typedef struct
+{
+    traj_reader_t *rd;
+    frame_t frames[PREFETCH];
+    uint64_t decoded;           /* frames decoded so far */
+    uint64_t released;          /* frames the analysis is done with */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+} prefetcher_t;
+
+static void *decoder_main(void *arg)
+{
+    prefetcher_t *pf = (prefetcher_t *)arg;
+    const uint64_t nframes = pf->rd->hdr.nframes;
+    for (uint64_t k = 0; k < nframes; k++)
+    {
+        pthread_mutex_lock(&pf->lock);
+        while (pf->decoded - pf->released == PREFETCH)
+            pthread_cond_wait(&pf->cond, &pf->lock);
+        pthread_mutex_unlock(&pf->lock);
+
+        /* frames are decoded in order, so each one only applies its
+           own deltas to the decoder state */
+        frame_t *f = &pf->frames[k % PREFETCH];
+        f->status = traj_reader_frame(pf->rd, k, f->x, f->y, f->present, &f->fh);
+
+        pthread_mutex_lock(&pf->lock);
+        pf->decoded++;
+        pthread_cond_broadcast(&pf->cond);
+        pthread_mutex_unlock(&pf->lock);
+    }
+    return NULL;
+}
+
+int prefetcher_start(prefetcher_t *pf, traj_reader_t *rd)
+{
+    const uint64_t n = rd->hdr.ncircles;
+    memset(pf, 0, sizeof(*pf));
+    pf->rd = rd;
+    for (int b = 0; b < PREFETCH; b++)
+    {
+        frame_t *f = &pf->frames[b];
+        f->x = (float *)malloc((n + 1) * sizeof(*f->x));
+        f->y = (float *)malloc((n + 1) * sizeof(*f->y));
+        f->present = (uint8_t *)malloc(n + 1);
+        if (f->x == NULL || f->y == NULL || f->present == NULL)
+            return -1;
+    }
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->cond, NULL);
+    return pthread_create(&pf->thread, NULL, decoder_main, pf) == 0 ? 0 : -1;
+}
+
+/**
+ * Wait until frame `k` is decoded, and return it.
+ */
+frame_t *prefetcher_get(prefetcher_t *pf, uint64_t k)
+{
+    pthread_mutex_lock(&pf->lock);
+    while (pf->decoded <= k)
+        pthread_cond_wait(&pf->cond, &pf->lock);
+    pthread_mutex_unlock(&pf->lock);
+    return &pf->frames[k % PREFETCH];
+}
+
+/**
+ * Give the oldest frame back to the decoder.
+ */
+void prefetcher_release(prefetcher_t *pf)
+{
+    pthread_mutex_lock(&pf->lock);
+    pf->released++;
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+void prefetcher_stop(prefetcher_t *pf)
+{
+    pthread_join(pf->thread, NULL);
+    pthread_mutex_destroy(&pf->lock);
+    pthread_cond_destroy(&pf->cond);
+    for (int b = 0; b < PREFETCH; b++)
+    {
+        free(pf->frames[b].x);
+        free(pf->frames[b].y);
+        free(pf->frames[b].present);
+    }
+}
+
+/* Uniform grid over the circles of a frame */
+typedef struct
+{
+    float x0, y0, cell;
+    int gx, gy;
+    size_t *start;              /* [gx*gy+1] first circle of each cell in order[] */
+    uint32_t *order;            /* circles sorted by cell */
+    size_t cap;                 /* cells allocated */
+} grid_t;
+
+static int cell_of(const grid_t *g, float x, float y, int *cx, int *cy)
+{
+    *cx = (int)((x - g->x0) / g->cell);
+    *cy = (int)((y - g->y0) / g->cell);
+    if (*cx >= g->gx) *cx = g->gx - 1;
+    if (*cy >= g->gy) *cy = g->gy - 1;
+    return *cy * g->gx + *cx;
+}
+
+/**
+ * Sort the present circles of frame `f` into the cells of `g`, whose
+ * side is at least `cell`.
+ */
+int grid_build(grid_t *g, const frame_t *f, uint64_t n, float cell)
+{
+    float x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+#pragma omp parallel for reduction(min:x0, y0) reduction(max:x1, y1)
+    for (uint64_t i = 0; i < n; i++)
+    {
+        if (!f->present[i])
+            continue;
+        x0 = fminf(x0, f->x[i]);
+        y0 = fminf(y0, f->y[i]);
+        x1 = fmaxf(x1, f->x[i]);
+        y1 = fmaxf(y1, f->y[i]);
+    }
+    if (x0 > x1)
+        x0 = y0 = x1 = y1 = 0;
+    /* a few circles that flew far away must not blow up the grid */
+    const double limit = 2.0 * n + 16;
+    double w, h;
+    for (;;)
+    {
+        w = floor((x1 - x0) / cell) + 1;
+        h = floor((y1 - y0) / cell) + 1;
+        if (w * h <= limit)
+            break;
+        cell *= 2;
+    }
+    g->x0 = x0;
+    g->y0 = y0;
+    g->cell = cell;
+    g->gx = (int)w;
+    g->gy = (int)h;
+    const size_t ncells = (size_t)g->gx * g->gy;
+    if (ncells + 1 > g->cap)
+    {
+        size_t *p = (size_t *)realloc(g->start, (ncells + 1) * sizeof(*p));
+        if (p == NULL)
+            return -1;
+        g->start = p;
+        g->cap = ncells + 1;
+    }
+    /* counting sort */
+    memset(g->start, 0, (ncells + 1) * sizeof(*g->start));
+    int cx, cy;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        if (f->present[i])
+            g->start[cell_of(g, f->x[i], f->y[i], &cx, &cy) + 1]++;
+    }
+    for (size_t c = 0; c < ncells; c++)
+        g->start[c + 1] += g->start[c];
+    for (uint64_t i = 0; i < n; i++)
+    {
+        if (f->present[i])
+            g->order[g->start[cell_of(g, f->x[i], f->y[i], &cx, &cy)]++] = (uint32_t)i;
+    }
+    /* start[c] now points to the end of cell c: shift back */
+    memmove(g->start + 1, g->start, ncells * sizeof(*g->start));
+    g->start[0] = 0;
+    return 0;
+}
+
+/* Statistics of the overlaps of one frame */
+typedef struct
+{
+    uint64_t overlaps;
+    double depth_sum;
+    float depth_max;
+} overlap_stats_t;
+
+/* Edges of the overlap graph */
+typedef struct
+{
+    uint32_t *pairs;            /* [2*n] */
+    size_t n, cap;
+} edges_t;
+
+static int edges_add(edges_t *e, uint32_t i, uint32_t j)
+{
+    if (e->n == e->cap)
+    {
+        const size_t cap = e->cap ? 2 * e->cap : 1024;
+        uint32_t *p = (uint32_t *)realloc(e->pairs, 2 * cap * sizeof(*p));
+        if (p == NULL)
+            return -1;
+        e->pairs = p;
+        e->cap = cap;
+    }
+    e->pairs[2 * e->n] = i;
+    e->pairs[2 * e->n + 1] = j;
+    e->n++;
+    return 0;
+}
+
+/**
+ * Find the overlapping pairs of frame `f`: update the depth histogram
+ * `hist` and collect the pairs into `edges` (one list per thread).
+ */
+int find_overlaps(const grid_t *g, const frame_t *f, const float *r, uint64_t n,
+                  uint64_t *hist, edges_t *edges, overlap_stats_t *st)
+{
+    uint64_t overlaps = 0;
+    double depth_sum = 0;
+    float depth_max = 0;
+    int failed = 0;
+#pragma omp parallel reduction(+:overlaps, depth_sum) reduction(max:depth_max) reduction(|:failed)
+    {
+        uint64_t local[DEPTH_BINS] = {0};
+        edges_t *e = &edges[omp_get_thread_num()];
+        e->n = 0;
+#pragma omp for schedule(dynamic, 256)
+        for (uint64_t i = 0; i < n; i++)
+        {
+            if (!f->present[i])
+                continue;
+            int cx, cy;
+            cell_of(g, f->x[i], f->y[i], &cx, &cy);
+            for (int ny = cy - 1; ny <= cy + 1; ny++)
+            {
+                for (int nx = cx - 1; nx <= cx + 1; nx++)
+                {
+                    if (nx < 0 || ny < 0 || nx >= g->gx || ny >= g->gy)
+                        continue;
+                    const size_t c = (size_t)ny * g->gx + nx;
+                    for (size_t k = g->start[c]; k < g->start[c + 1]; k++)
+                    {
+                        const uint32_t j = g->order[k];
+                        if (j <= i)
+                            continue;
+                        /* same test (and rounding) as compute_forces() */
+                        const float deltax = f->x[j] - f->x[i];
+                        const float deltay = f->y[j] - f->y[i];
+                        const float dist = hypotf(deltax, deltay);
+                        const float Rsum = r[i] + r[j];
+                        if (dist < Rsum - CIRCLES_EPSILON)
+                        {
+                            const float depth = (Rsum - dist) / Rsum;
+                            int b = (int)(depth * DEPTH_BINS);
+                            if (b >= DEPTH_BINS)
+                                b = DEPTH_BINS - 1;
+                            local[b]++;
+                            overlaps++;
+                            depth_sum += depth;
+                            depth_max = fmaxf(depth_max, depth);
+                            failed |= edges_add(e, (uint32_t)i, j) != 0;
+                        }
+                    }
+                }
+            }
+        }
+        for (int b = 0; b < DEPTH_BINS; b++)
+        {
+#pragma omp atomic
+            hist[b] += local[b];
+        }
+    }
+    st->overlaps = overlaps;
+    st->depth_sum = depth_sum;
+    st->depth_max = depth_max;
+    return failed ? -1 : 0;
+}
+
+static uint32_t find_root(uint32_t *parent, uint32_t i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]]; /* path halving */
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * Group the present circles into clusters connected by the edges;
+ * add the cluster sizes to `sizes` and return the number of clusters
+ * and the size of the largest one.
+ */
+void clusters(const frame_t *f, uint64_t n, const edges_t *edges, int nthreads,
+              uint32_t *parent, uint32_t *count, uint64_t *sizes,
+              uint64_t *nclusters, uint64_t *largest)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        parent[i] = (uint32_t)i;
+        count[i] = 0;
+    }
+    for (int t = 0; t < nthreads; t++)
+    {
+        for (size_t k = 0; k < edges[t].n; k++)
+        {
+            const uint32_t a = find_root(parent, edges[t].pairs[2 * k]);
+            const uint32_t b = find_root(parent, edges[t].pairs[2 * k + 1]);
+            if (a != b)
+                parent[a < b ? b : a] = a < b ? a : b;
+        }
+    }
+    for (uint64_t i = 0; i < n; i++)
+    {
+        if (f->present[i])
+            count[find_root(parent, (uint32_t)i)]++;
+    }
+    *nclusters = *largest = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        if (count[i] == 0)
+            continue;
+        sizes[count[i]]++;
+        (*nclusters)++;
+        if (count[i] > *largest)
+            *largest = count[i];
+    }
+}
+
+FILE *open_csv(const char *prefix, const char *name, const char *columns)
+{
+    char fname[1024];
+    snprintf(fname, sizeof(fname), "%s-%s.csv", prefix, name);
+    FILE *f = fopen(fname, "w");
+    if (f == NULL)
+    {
+        perror(fname);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(f, "%s\n", columns);
+    return f;
+}
+
+int main(int argc, char *argv[])
+{
+    traj_reader_t rd;
+    prefetcher_t pf;
+    grid_t grid;
+
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s FILE [PREFIX]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *prefix = (argc > 2) ? argv[2] : "circles";
+
+    if (traj_reader_open(&rd, argv[1]) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    const uint64_t n = rd.hdr.ncircles;
+    const int nthreads = omp_get_max_threads();
+    float rmax = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        rmax = fmaxf(rmax, rd.r[i]);
+    }
+    memset(&grid, 0, sizeof(grid));
+    grid.order = (uint32_t *)malloc((n + 1) * sizeof(*grid.order));
+    edges_t *edges = (edges_t *)calloc(nthreads, sizeof(*edges));
+    uint32_t *parent = (uint32_t *)malloc((n + 1) * sizeof(*parent));
+    uint32_t *count = (uint32_t *)malloc((n + 1) * sizeof(*count));
+    uint64_t *sizes = (uint64_t *)calloc(n + 1, sizeof(*sizes));
+    float *px = (float *)malloc((n + 1) * sizeof(*px));
+    float *py = (float *)malloc((n + 1) * sizeof(*py));
+    float *fx = (float *)malloc((n + 1) * sizeof(*fx));
+    float *fy = (float *)malloc((n + 1) * sizeof(*fy));
+    uint8_t *seen = (uint8_t *)calloc(n + 1, 1);
+    double *path = (double *)calloc(n + 1, sizeof(*path));
+    uint64_t hist[DEPTH_BINS] = {0};
+    if (grid.order == NULL || edges == NULL || parent == NULL || count == NULL ||
+        sizes == NULL || px == NULL || py == NULL || fx == NULL || fy == NULL ||
+        seen == NULL || path == NULL || prefetcher_start(&pf, &rd) != 0)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = open_csv(prefix, "frames", "iteration,overlaps,sim_overlaps,mean_depth,"
+                                           "max_depth,clusters,largest_cluster,mean_step");
+    int status = EXIT_SUCCESS;
+    uint64_t k;
+    for (k = 0; k < rd.hdr.nframes; k++)
+    {
+        const frame_t *f = prefetcher_get(&pf, k);
+        if (f->status != 0)
+        {
+            fprintf(stderr, "%s: frame %llu is corrupted\n", argv[1], (unsigned long long)k);
+            status = EXIT_FAILURE;
+            break;
+        }
+        overlap_stats_t st;
+        uint64_t nclusters, largest;
+        if (grid_build(&grid, f, n, fmaxf(2 * rmax, 1e-3f)) != 0 ||
+            find_overlaps(&grid, f, rd.r, n, hist, edges, &st) != 0)
+        {
+            fprintf(stderr, "Out of memory\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+        clusters(f, n, edges, nthreads, parent, count, sizes, &nclusters, &largest);
+
+        /* displacements since the last frame each circle was stored in */
+        double step_sum = 0;
+        uint64_t nsteps = 0;
+#pragma omp parallel for reduction(+:step_sum, nsteps)
+        for (uint64_t i = 0; i < n; i++)
+        {
+            if (!f->present[i])
+                continue;
+            if (seen[i])
+            {
+                const double step = hypot(f->x[i] - px[i], f->y[i] - py[i]);
+                path[i] += step;
+                step_sum += step;
+                nsteps++;
+            }
+            else
+            {
+                fx[i] = f->x[i];
+                fy[i] = f->y[i];
+                seen[i] = 1;
+            }
+            px[i] = f->x[i];
+            py[i] = f->y[i];
+        }
+        fprintf(out, "%lld,%llu,%lld,%g,%g,%llu,%llu,%g\n",
+                (long long)f->fh.iteration, (unsigned long long)st.overlaps,
+                (long long)f->fh.overlaps,
+                st.overlaps ? st.depth_sum / st.overlaps : 0.0, st.depth_max,
+                (unsigned long long)nclusters, (unsigned long long)largest,
+                nsteps ? step_sum / nsteps : 0.0);
+        prefetcher_release(&pf);
+    }
+    /* let the decoder finish if we stopped early */
+    for (; k < rd.hdr.nframes; k++)
+    {
+        prefetcher_get(&pf, k);
+        prefetcher_release(&pf);
+    }
+    prefetcher_stop(&pf);
+    fclose(out);
+
+    out = open_csv(prefix, "overlaps", "depth_min,depth_max,pairs");
+    for (int b = 0; b < DEPTH_BINS; b++)
+    {
+        fprintf(out, "%g,%g,%llu\n", (double)b / DEPTH_BINS, (double)(b + 1) / DEPTH_BINS,
+                (unsigned long long)hist[b]);
+    }
+    fclose(out);
+
+    out = open_csv(prefix, "clusters", "size,count");
+    for (uint64_t s = 1; s <= n; s++)
+    {
+        if (sizes[s] > 0)
+            fprintf(out, "%llu,%llu\n", (unsigned long long)s, (unsigned long long)sizes[s]);
+    }
+    fclose(out);
+
+    out = open_csv(prefix, "displacement", "circle,r,path_length,net_displacement");
+    for (uint64_t i = 0; i < n; i++)
+    {
+        if (seen[i])
+            fprintf(out, "%llu,%g,%g,%g\n", (unsigned long long)i, rd.r[i], path[i],
+                    hypot(px[i] - fx[i], py[i] - fy[i]));
+    }
+    fclose(out);
+
+    if (status == EXIT_SUCCESS)
+    {
+        printf("%llu frames analysed\n", (unsigned long long)rd.hdr.nframes);
+    }
+    for (int t = 0; t < nthreads; t++)
+    {
+        free(edges[t].pairs);
+    }
+    free(edges);
+    free(grid.start);
+    free(grid.order);
+    free(parent);
+    free(count);
+    free(sizes);
+    free(px);
+    free(py);
+    free(fx);
+    free(fy);
+    free(seen);
+    free(path);
+    traj_reader_close(&rd);
+    return status;
+}
@@ -0,0 +1,447 @@
+/****************************************************************************
+ *
+ * validate.c - Check that the circles programs compute the same thing
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+/***
+% Cross-program validation
+% Alessandro Monticelli
+
+Compares the lossless trajectories of two or more runs of the circles
+programs, frame by frame, against the first one (the reference): the
+overlaps found in each iteration must be the same, and the positions
+of each circle must agree within a tolerance, given in units in the
+last place (ULP) of the reference value and/or as an absolute
+difference; a position is accepted if it is within either of them.
+For each run the first iteration and the first circle that differ
+are reported, together with the largest differences found; the exit
+status is 1 if any run differs, so that the check can gate a change
+to a kernel.
+
+The trajectories can be given as files (written with `--trajectory
+FILE --traj-quantum 0`), or with `--run` the programs are run by the
+validator on the same input: `N` circles placed by the programs from
+the same seed, the circles of a snapshot (`--input`) or those of a
+synthetic scenario (`--scenario`, see `gencircles`). Each program is
+a command line, so that options (e.g. of a new engine) can be added
+to it; OpenMP programs (`omp-*`) run with `--procs` threads, MPI
+programs (`mpi-*`) with `--procs` processes.
+
+The programs use floats and sum the forces acting on each circle in
+different orders (the OpenMP program with atomic updates, in the
+order in which the threads get there), so small differences are
+expected and grow with the iterations; the serial and MPI programs
+sum them in the same order and agree exactly.
+
+To compile:
+
+        gcc -std=c99 -Wall -Wpedantic validate.c argutil.c trajectory.c filewriter.c asyncwriter.c memtrack.c workload.c snapshot.c -o validate -lm -pthread
+
+To execute:
+
+        ./validate [options] REFERENCE.traj OTHER.traj...
+        ./validate [options] --run REFERENCE-PROGRAM OTHER-PROGRAM...
+
+for example
+
+        ./validate --procs 4 --run ./circles ./omp-circles ./mpi-circles
+        ./validate --ulps 0 --scenario point --run ./circles "./mpi-circles"
+
+Run `./validate` without arguments for the list of the options.
+
+***/
+
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "trajectory.h"
+#include "argutil.h"
+#include "workload.h"
+
+#define MAX_ARGS 64
+
+typedef struct
+{
+    int run;              /* run the programs, instead of reading files */
+    int size;             /* circles */
+    int iterations;
+    unsigned long long seed;
+    const char *input;    /* initial circles of the runs */
+    const char *scenario; /* synthetic initial circles of the runs */
+    int procs;            /* threads or processes of the parallel programs */
+    char mpirun[256];     /* launcher of the MPI programs */
+    double ulps;          /* tolerance in units in the last place */
+    double abs_tol;       /* absolute tolerance */
+    int verbose;          /* show the output of the programs */
+} validate_opt_t;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] REFERENCE.traj OTHER.traj...\n"
+            "       %s [options] --run REFERENCE-PROGRAM OTHER-PROGRAM...\n"
+            "\n"
+            "Options:\n"
+            "  --ulps U        accept positions within U units in the last\n"
+            "                  place of the reference (default 4)\n"
+            "  --abs A         accept positions within A (default 0)\n"
+            "  --run           run the programs (each one a command line)\n"
+            "                  on the same input and compare their trajectories\n"
+            "\n"
+            "Options of --run:\n"
+            "  --size N        circles (default 500)\n"
+            "  --iterations N  iterations (default 20)\n"
+            "  --seed N        seed of the initial circles (default 1)\n"
+            "  --input FILE    initial circles from FILE\n"
+            "  --scenario NAME initial circles of a synthetic workload:\n",
+            prog, prog);
+    workload_list(stderr);
+    fprintf(stderr,
+            "  --procs P       OpenMP threads or MPI processes (default 4)\n"
+            "  --mpirun CMD    launcher of the MPI programs (default \"mpirun\")\n"
+            "  --verbose       show the output of the programs\n");
+}
+
+/**
+ * Distance in units in the last place between two floats, i.e., the
+ * number of floats between them (0 if equal, 1 if adjacent).
+ */
+static double ulp_distance(float a, float b)
+{
+    int32_t ia, ib;
+    if (a == b)
+        return 0;
+    if (isnan(a) || isnan(b))
+        return INFINITY;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+    /* map the sign-magnitude bit patterns to a monotonic sequence */
+    const int64_t oa = (ia < 0) ? (int64_t)INT32_MIN - ia : ia;
+    const int64_t ob = (ib < 0) ? (int64_t)INT32_MIN - ib : ib;
+    return fabs((double)(oa - ob));
+}
+
+/**
+ * Run the command line `cmd` with the common options of the runs,
+ * writing the lossless trajectory `traj`; `input` is the snapshot of
+ * the initial circles, or NULL. Returns 0 on success, -1 on failure.
+ */
+static int run_program(const validate_opt_t *opt, const char *cmd, const char *traj, const char *input)
+{
+    char prog[1024], launcher[256], pstr[16], nstr[16], itstr[16], seed[32];
+    char *words[MAX_ARGS], *args[2 * MAX_ARGS + 16];
+    int nargs = 0;
+
+    snprintf(prog, sizeof(prog), "%s", cmd);
+    snprintf(launcher, sizeof(launcher), "%s", opt->mpirun);
+    if (arg_split(prog, words, MAX_ARGS) < 1)
+    {
+        fprintf(stderr, "validate: invalid command \"%s\"\n", cmd);
+        return -1;
+    }
+    const char *base = strrchr(words[0], '/');
+    base = (base != NULL) ? base + 1 : words[0];
+    const int mpi = (strncmp(base, "mpi-", 4) == 0);
+    const int omp = (strncmp(base, "omp-", 4) == 0);
+    snprintf(pstr, sizeof(pstr), "%d", opt->procs);
+    snprintf(nstr, sizeof(nstr), "%d", opt->size);
+    snprintf(itstr, sizeof(itstr), "%d", opt->iterations);
+    snprintf(seed, sizeof(seed), "%llu", opt->seed);
+    if (mpi)
+    {
+        char *launch[MAX_ARGS];
+        if (arg_split(launcher, launch, MAX_ARGS) < 1)
+        {
+            fprintf(stderr, "validate: invalid --mpirun\n");
+            return -1;
+        }
+        for (int i = 0; launch[i] != NULL; i++)
+            args[nargs++] = launch[i];
+        args[nargs++] = "-n";
+        args[nargs++] = pstr;
+    }
+    for (int i = 0; words[i] != NULL; i++)
+        args[nargs++] = words[i];
+    args[nargs++] = nstr;
+    args[nargs++] = itstr;
+    args[nargs++] = "--seed";
+    args[nargs++] = seed;
+    args[nargs++] = "--trajectory";
+    args[nargs++] = (char *)traj;
+    args[nargs++] = "--traj-quantum";
+    args[nargs++] = "0";
+    if (input != NULL)
+    {
+        args[nargs++] = "--input";
+        args[nargs++] = (char *)input;
+    }
+    args[nargs] = NULL;
+
+    if (arg_run(args, omp ? pstr : "1",
+                opt->verbose ? 0 : ARG_RUN_NO_STDOUT | ARG_RUN_NO_STDERR) != 0)
+    {
+        fprintf(stderr, "validate: \"%s\" failed (run with --verbose to see its output)\n", cmd);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Compare the trajectory `other` with the reference `ref`, printing
+ * the first difference and the largest ones; returns 0 if they agree,
+ * 1 if they differ, -1 if a file cannot be read.
+ */
+static int compare(const validate_opt_t *opt, const char *ref_name, traj_reader_t *ref,
+                   const char *name, traj_reader_t *other)
+{
+    const uint64_t n = ref->hdr.ncircles;
+    if (other->hdr.ncircles != n)
+    {
+        printf("%s: %llu circles instead of %llu\n", name,
+               (unsigned long long)other->hdr.ncircles, (unsigned long long)n);
+        return 1;
+    }
+    if (ref->hdr.quantum != 0 || other->hdr.quantum != 0)
+    {
+        printf("%s: the trajectories must be lossless (--traj-quantum 0)\n", name);
+        return 1;
+    }
+    for (uint64_t i = 0; i < n; i++)
+    {
+        if (ref->r[i] != other->r[i])
+        {
+            printf("%s: circle %llu has radius %.9g instead of %.9g (different input?)\n",
+                   name, (unsigned long long)i, other->r[i], ref->r[i]);
+            return 1;
+        }
+    }
+    const uint64_t nframes = ref->hdr.nframes < other->hdr.nframes ? ref->hdr.nframes : other->hdr.nframes;
+    float *rx = (float *)malloc(n * sizeof(float) + 1);
+    float *ry = (float *)malloc(n * sizeof(float) + 1);
+    float *ox = (float *)malloc(n * sizeof(float) + 1);
+    float *oy = (float *)malloc(n * sizeof(float) + 1);
+    if (rx == NULL || ry == NULL || ox == NULL || oy == NULL)
+    {
+        fprintf(stderr, "validate: out of memory\n");
+        free(rx);
+        free(ry);
+        free(ox);
+        free(oy);
+        return -1;
+    }
+    int result = 0;
+    int64_t first_overlaps = -1, first_position = -1;
+    double max_ulps = 0, max_abs = 0;
+    for (uint64_t k = 0; k < nframes && result >= 0; k++)
+    {
+        traj_frame_header_t rf, of;
+        if (traj_reader_frame(ref, k, rx, ry, NULL, &rf) != 0 ||
+            traj_reader_frame(other, k, ox, oy, NULL, &of) != 0)
+        {
+            fprintf(stderr, "validate: frame %llu is corrupted\n", (unsigned long long)k);
+            result = -1;
+            break;
+        }
+        if (rf.iteration != of.iteration)
+        {
+            printf("%s: frame %llu is iteration %lld instead of %lld\n", name,
+                   (unsigned long long)k, (long long)of.iteration, (long long)rf.iteration);
+            result = 1;
+            break;
+        }
+        if (rf.overlaps != of.overlaps && first_overlaps < 0)
+        {
+            first_overlaps = rf.iteration;
+            printf("%s: iteration %lld: %lld overlaps instead of %lld\n", name,
+                   (long long)rf.iteration, (long long)of.overlaps, (long long)rf.overlaps);
+            result = 1;
+        }
+        for (uint64_t i = 0; i < n; i++)
+        {
+            const float ref_v[2] = {rx[i], ry[i]}, other_v[2] = {ox[i], oy[i]};
+            for (int c = 0; c < 2; c++)
+            {
+                const double ulps = ulp_distance(ref_v[c], other_v[c]);
+                const double diff = fabs((double)ref_v[c] - other_v[c]);
+                if (ulps > max_ulps)
+                    max_ulps = ulps;
+                if (diff > max_abs || isnan(diff))
+                    max_abs = diff;
+                if (ulps > opt->ulps && !(diff <= opt->abs_tol) && first_position < 0)
+                {
+                    first_position = rf.iteration;
+                    printf("%s: iteration %lld: circle %llu has %c = %.9g instead of %.9g "
+                           "(%.0f ULP, %.3g apart)\n",
+                           name, (long long)rf.iteration, (unsigned long long)i, "xy"[c],
+                           other_v[c], ref_v[c], ulps, diff);
+                    result = 1;
+                }
+            }
+        }
+    }
+    if (result >= 0 && ref->hdr.nframes != other->hdr.nframes)
+    {
+        printf("%s: %llu frames instead of %llu\n", name,
+               (unsigned long long)other->hdr.nframes, (unsigned long long)ref->hdr.nframes);
+        result = 1;
+    }
+    if (result >= 0)
+    {
+        printf("%s: %s %s over %llu frames (largest difference %.0f ULP, %.3g)\n",
+               name, result == 0 ? "agrees with" : "DIFFERS from", ref_name,
+               (unsigned long long)nframes, max_ulps, max_abs);
+    }
+    free(rx);
+    free(ry);
+    free(ox);
+    free(oy);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    validate_opt_t opt;
+    const char *names[MAX_ARGS];
+    int nnames = 0;
+
+    memset(&opt, 0, sizeof(opt));
+    opt.size = 500;
+    opt.iterations = 20;
+    opt.seed = 1;
+    opt.procs = 4;
+    opt.ulps = 4;
+    snprintf(opt.mpirun, sizeof(opt.mpirun), "mpirun");
+    for (int i = 1; i < argc; i++)
+    {
+        const char *val = NULL;
+        int m = 1;
+        if (strcmp(argv[i], "--run") == 0)
+            opt.run = 1;
+        else if (strcmp(argv[i], "--verbose") == 0)
+            opt.verbose = 1;
+        else if ((m = arg_match("--size", argc, argv, &i, &val)) != 0)
+            opt.size = atoi(val);
+        else if ((m = arg_match("--iterations", argc, argv, &i, &val)) != 0)
+            opt.iterations = atoi(val);
+        else if ((m = arg_match("--seed", argc, argv, &i, &val)) != 0)
+            opt.seed = strtoull(val, NULL, 10);
+        else if ((m = arg_match("--input", argc, argv, &i, &val)) != 0)
+            opt.input = val;
+        else if ((m = arg_match("--scenario", argc, argv, &i, &val)) != 0)
+            opt.scenario = val;
+        else if ((m = arg_match("--procs", argc, argv, &i, &val)) != 0)
+            opt.procs = atoi(val);
+        else if ((m = arg_match("--mpirun", argc, argv, &i, &val)) != 0)
+            snprintf(opt.mpirun, sizeof(opt.mpirun), "%s", val);
+        else if ((m = arg_match("--ulps", argc, argv, &i, &val)) != 0)
+            opt.ulps = atof(val);
+        else if ((m = arg_match("--abs", argc, argv, &i, &val)) != 0)
+            opt.abs_tol = atof(val);
+        else if (argv[i][0] == '-' && argv[i][1] == '-')
+        {
+            fprintf(stderr, "%s: unknown option %s\n", argv[0], argv[i]);
+            m = -1;
+        }
+        else if (nnames < MAX_ARGS)
+            names[nnames++] = argv[i];
+        if (m < 0)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (nnames < 2 || opt.size < 1 || opt.iterations < 0 || opt.procs < 1 ||
+        opt.ulps < 0 || opt.abs_tol < 0 || (opt.scenario && !workload_valid(opt.scenario)))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* with --run, the trajectories are temporary files */
+    char paths[MAX_ARGS][32], input[32] = "";
+    const char *files[MAX_ARGS];
+    int status = EXIT_SUCCESS;
+    if (opt.run && opt.scenario)
+    {
+        strcpy(input, "/tmp/validate-XXXXXX");
+        const int fd = mkstemp(input);
+        if (fd < 0 || (close(fd), workload_save(input, opt.scenario, opt.size, opt.seed)) != 0)
+            return EXIT_FAILURE;
+    }
+    for (int p = 0; p < nnames; p++)
+    {
+        files[p] = names[p];
+        if (!opt.run)
+            continue;
+        strcpy(paths[p], "/tmp/validate-XXXXXX");
+        const int fd = mkstemp(paths[p]);
+        if (fd < 0)
+        {
+            perror("mkstemp");
+            status = EXIT_FAILURE;
+            nnames = p;
+            break;
+        }
+        close(fd);
+        files[p] = paths[p];
+        if (run_program(&opt, names[p], paths[p], input[0] ? input : opt.input) != 0)
+        {
+            status = EXIT_FAILURE;
+            nnames = p + 1;
+            break;
+        }
+    }
+
+    traj_reader_t ref;
+    if (status == EXIT_SUCCESS && traj_reader_open(&ref, files[0]) == 0)
+    {
+        printf("Reference: %s, %llu circles, %llu frames, tolerance %g ULP or %g\n",
+               names[0], (unsigned long long)ref.hdr.ncircles,
+               (unsigned long long)ref.hdr.nframes, opt.ulps, opt.abs_tol);
+        for (int p = 1; p < nnames; p++)
+        {
+            traj_reader_t other;
+            if (traj_reader_open(&other, files[p]) != 0)
+            {
+                status = EXIT_FAILURE;
+                continue;
+            }
+            const int r = compare(&opt, names[0], &ref, names[p], &other);
+            if (r != 0)
+                status = EXIT_FAILURE;
+            traj_reader_close(&other);
+        }
+        traj_reader_close(&ref);
+    }
+    else
+    {
+        status = EXIT_FAILURE;
+    }
+    if (opt.run)
+    {
+        for (int p = 0; p < nnames; p++)
+            unlink(paths[p]);
+        if (input[0])
+            unlink(input);
+    }
+    return status;
+}
@@ -0,0 +1,46 @@
+/****************************************************************************
+ *
+ * view.h - Strided view over the coordinates of a set of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * The I/O modules never see the `circle_t` type of the programs: they
+ * read and write the coordinates through a circle_view_t, which
+ * describes where the i-th x, y and r live. An array of structures
+ * is described by pointers to the fields of the first element and
+ * stride = sizeof(circle_t); a structure of arrays by the three
+ * column pointers and stride = sizeof(float).
+ *
+ ****************************************************************************/
+
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <stddef.h>
+
+typedef struct
+{
+    float *x, *y, *r; /* address of the first element of each field */
+    size_t stride;    /* distance in bytes between consecutive circles */
+} circle_view_t;
+
+#define VIEW_AT(p, v, i) (*(float *)((char *)(p) + (size_t)(i) * (v)->stride))
+#define VIEW_X(v, i) VIEW_AT((v)->x, v, i)
+#define VIEW_Y(v, i) VIEW_AT((v)->y, v, i)
+#define VIEW_R(v, i) VIEW_AT((v)->r, v, i)
+
+#endif
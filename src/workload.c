@@ -0,0 +1,277 @@
+/****************************************************************************
+ *
+ * workload.c - Synthetic initial configurations of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "workload.h"
+#include "snapshot.h"
+#include "libcircles.h"
+
+#define NCLUSTERS 8        /* clusters of the "clusters" scenario */
+#define CLUSTER_SIGMA 30.0 /* standard deviation of the clusters */
+#define LATTICE_R 50.0f    /* radius of the circles of the lattice */
+#define LATTICE_GAP 0.95f  /* distance of the neighbors, relative to 2r */
+#define BIMODAL_LARGE 0.05 /* fraction of large circles */
+#define POWER_ALPHA 2.5    /* exponent of the power-law radii */
+#define POWER_RMAX 500.0   /* largest power-law radius */
+#define SPARSE_SIDE 1e6f   /* side of the sparse domain */
+
+typedef struct
+{
+    uint64_t state;
+} rng_t;
+
+/**
+ * splitmix64: a tiny generator with 64 bits of state, good enough to
+ * place circles and identical on every platform.
+ */
+static uint64_t rng_next(rng_t *g)
+{
+    uint64_t z = (g->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/* uniform in [0, 1) */
+static double rng_unit(rng_t *g)
+{
+    return (rng_next(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static float rng_range(rng_t *g, double a, double b)
+{
+    return (float)(a + rng_unit(g) * (b - a));
+}
+
+/* standard normal (Box-Muller; the second value is dropped) */
+static double rng_normal(rng_t *g)
+{
+    const double u = 1.0 - rng_unit(g), v = rng_unit(g);
+    return sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v);
+}
+
+typedef void (*fill_fn)(rng_t *g, uint64_t n, const circle_view_t *dst, workload_domain_t *dom);
+
+static void fill_uniform(rng_t *g, uint64_t n, const circle_view_t *dst, workload_domain_t *dom)
+{
+    (void)dom;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        VIEW_X(dst, i) = rng_range(g, CIRCLES_XMIN, CIRCLES_XMAX);
+        VIEW_Y(dst, i) = rng_range(g, CIRCLES_YMIN, CIRCLES_YMAX);
+        VIEW_R(dst, i) = rng_range(g, CIRCLES_RMIN, CIRCLES_RMAX);
+    }
+}
+
+static void fill_clusters(rng_t *g, uint64_t n, const circle_view_t *dst, workload_domain_t *dom)
+{
+    float cx[NCLUSTERS], cy[NCLUSTERS];
+    (void)dom;
+    /* the centers stay away from the border, so that the clusters
+       are (mostly) inside the domain */
+    for (int c = 0; c < NCLUSTERS; c++)
+    {
+        cx[c] = rng_range(g, CIRCLES_XMIN + 0.1 * (CIRCLES_XMAX - CIRCLES_XMIN),
+                          CIRCLES_XMAX - 0.1 * (CIRCLES_XMAX - CIRCLES_XMIN));
+        cy[c] = rng_range(g, CIRCLES_YMIN + 0.1 * (CIRCLES_YMAX - CIRCLES_YMIN),
+                          CIRCLES_YMAX - 0.1 * (CIRCLES_YMAX - CIRCLES_YMIN));
+    }
+    for (uint64_t i = 0; i < n; i++)
+    {
+        const int c = (int)(rng_next(g) % NCLUSTERS);
+        VIEW_X(dst, i) = (float)(cx[c] + CLUSTER_SIGMA * rng_normal(g));
+        VIEW_Y(dst, i) = (float)(cy[c] + CLUSTER_SIGMA * rng_normal(g));
+        VIEW_R(dst, i) = rng_range(g, CIRCLES_RMIN, CIRCLES_RMAX);
+    }
+}
+
+/* hexagonal lattice, sqrt(n) circles per row, each one overlapping its
+   six neighbors by a few percent of the radius; the seed only affects
+   the order of the circles */
+static void fill_lattice(rng_t *g, uint64_t n, const circle_view_t *dst, workload_domain_t *dom)
+{
+    const uint64_t cols = (uint64_t)ceil(sqrt((double)n));
+    const uint64_t rows = (n + cols - 1) / (cols > 0 ? cols : 1);
+    const float dx = 2 * LATTICE_R * LATTICE_GAP;
+    const float dy = dx * 0.8660254f; /* sqrt(3)/2 */
+    for (uint64_t i = 0; i < n; i++)
+    {
+        const uint64_t row = i / cols, col = i % cols;
+        VIEW_X(dst, i) = LATTICE_R + col * dx + (row % 2) * dx / 2;
+        VIEW_Y(dst, i) = LATTICE_R + row * dy;
+        VIEW_R(dst, i) = LATTICE_R;
+    }
+    /* shuffle, so that neighbors in space are not neighbors in memory */
+    for (uint64_t i = n; i > 1; i--)
+    {
+        const uint64_t j = rng_next(g) % i;
+        const float x = VIEW_X(dst, i - 1), y = VIEW_Y(dst, i - 1);
+        VIEW_X(dst, i - 1) = VIEW_X(dst, j);
+        VIEW_Y(dst, i - 1) = VIEW_Y(dst, j);
+        VIEW_X(dst, j) = x;
+        VIEW_Y(dst, j) = y;
+    }
+    dom->xmin = dom->ymin = 0;
+    dom->xmax = 2 * LATTICE_R + cols * dx;
+    dom->ymax = 2 * LATTICE_R + rows * dy;
+}
+
+/* mostly small circles, and a few large ones that overlap many of them */
+static void fill_bimodal(rng_t *g, uint64_t n, const circle_view_t *dst, workload_domain_t *dom)
+{
+    (void)dom;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        VIEW_X(dst, i) = rng_range(g, CIRCLES_XMIN, CIRCLES_XMAX);
+        VIEW_Y(dst, i) = rng_range(g, CIRCLES_YMIN, CIRCLES_YMAX);
+        if (rng_unit(g) < BIMODAL_LARGE)
+            VIEW_R(dst, i) = rng_range(g, CIRCLES_RMAX, 2 * CIRCLES_RMAX);
+        else
+            VIEW_R(dst, i) = rng_range(g, CIRCLES_RMIN, 2 * CIRCLES_RMIN);
+    }
+}
+
+/* Pareto radii: P(r > x) = (CIRCLES_RMIN / x)^(alpha - 1), capped */
+static void fill_powerlaw(rng_t *g, uint64_t n, const circle_view_t *dst, workload_domain_t *dom)
+{
+    (void)dom;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        VIEW_X(dst, i) = rng_range(g, CIRCLES_XMIN, CIRCLES_XMAX);
+        VIEW_Y(dst, i) = rng_range(g, CIRCLES_YMIN, CIRCLES_YMAX);
+        const double r = CIRCLES_RMIN * pow(1.0 - rng_unit(g), -1.0 / (POWER_ALPHA - 1));
+        VIEW_R(dst, i) = (float)(r < POWER_RMAX ? r : POWER_RMAX);
+    }
+}
+
+/* every circle overlaps every other one at distance 0 */
+static void fill_point(rng_t *g, uint64_t n, const circle_view_t *dst, workload_domain_t *dom)
+{
+    (void)dom;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        VIEW_X(dst, i) = (CIRCLES_XMIN + CIRCLES_XMAX) / 2;
+        VIEW_Y(dst, i) = (CIRCLES_YMIN + CIRCLES_YMAX) / 2;
+        VIEW_R(dst, i) = rng_range(g, CIRCLES_RMIN, CIRCLES_RMAX);
+    }
+}
+
+/* the usual circles in a domain so large that they seldom overlap */
+static void fill_sparse(rng_t *g, uint64_t n, const circle_view_t *dst, workload_domain_t *dom)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        VIEW_X(dst, i) = rng_range(g, 0, SPARSE_SIDE);
+        VIEW_Y(dst, i) = rng_range(g, 0, SPARSE_SIDE);
+        VIEW_R(dst, i) = rng_range(g, CIRCLES_RMIN, CIRCLES_RMAX);
+    }
+    dom->xmin = dom->ymin = 0;
+    dom->xmax = dom->ymax = SPARSE_SIDE;
+}
+
+static const struct
+{
+    const char *name;
+    fill_fn fill;
+    const char *description;
+} scenarios[] = {
+    {"uniform", fill_uniform, "uniform positions and radii, as init_circles()"},
+    {"clusters", fill_clusters, "8 Gaussian clusters (sigma 30)"},
+    {"lattice", fill_lattice, "hexagonal lattice of equal circles overlapping their neighbors"},
+    {"bimodal", fill_bimodal, "95% radii in [10, 20], 5% in [100, 200]"},
+    {"powerlaw", fill_powerlaw, "Pareto radii (alpha 2.5) from 10 to 500"},
+    {"point", fill_point, "all the circles at the center of the domain"},
+    {"sparse", fill_sparse, "uniform circles in a 1e6 x 1e6 domain"},
+};
+
+#define NSCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static int find(const char *name)
+{
+    for (size_t s = 0; s < NSCENARIOS; s++)
+    {
+        if (strcmp(scenarios[s].name, name) == 0)
+            return (int)s;
+    }
+    return -1;
+}
+
+int workload_valid(const char *name)
+{
+    return find(name) >= 0;
+}
+
+int workload_count(void)
+{
+    return (int)NSCENARIOS;
+}
+
+const char *workload_name(int s)
+{
+    return scenarios[s].name;
+}
+
+void workload_list(FILE *out)
+{
+    for (size_t s = 0; s < NSCENARIOS; s++)
+        fprintf(out, "  %-10s %s\n", scenarios[s].name, scenarios[s].description);
+}
+
+int workload_fill(const char *name, uint64_t n, uint64_t seed,
+                  const circle_view_t *dst, workload_domain_t *dom)
+{
+    const int s = find(name);
+    if (s < 0)
+        return -1;
+    /* the same seed gives different sequences in different scenarios */
+    rng_t g = {seed * 0x2545F4914F6CDD1Dull + (uint64_t)s};
+    dom->xmin = CIRCLES_XMIN;
+    dom->xmax = CIRCLES_XMAX;
+    dom->ymin = CIRCLES_YMIN;
+    dom->ymax = CIRCLES_YMAX;
+    scenarios[s].fill(&g, n, dst, dom);
+    return 0;
+}
+
+int workload_save(const char *path, const char *name, uint64_t n, uint64_t seed)
+{
+    if (!workload_valid(name))
+    {
+        fprintf(stderr, "Unknown scenario %s\n", name);
+        return -1;
+    }
+    float *col = (float *)malloc(3 * (n > 0 ? n : 1) * sizeof(*col));
+    if (col == NULL)
+    {
+        fprintf(stderr, "Cannot allocate %llu circles\n", (unsigned long long)n);
+        return -1;
+    }
+    const circle_view_t v = {col, col + n, col + 2 * n, sizeof(float)};
+    workload_domain_t dom;
+    workload_fill(name, n, seed, &v, &dom);
+    snapshot_header_t hdr;
+    snapshot_header_init(&hdr, n, dom.xmin, dom.xmax, dom.ymin, dom.ymax);
+    hdr.seed = seed;
+    const int result = snapshot_save(path, &hdr, &v, SNAPSHOT_SOA);
+    free(col);
+    return result;
+}
@@ -0,0 +1,81 @@
+/****************************************************************************
+ *
+ * workload.h - Synthetic initial configurations of circles
+ *
+ * Copyright (C) 2024 by Alessandro Monticelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * --------------------------------------------------------------------------
+ *
+ * init_circles() places the circles uniformly in the domain with
+ * uniform radii, which is the easiest case for every kernel. The
+ * scenarios below reproduce the harder ones: dense clusters, a packed
+ * lattice where every circle overlaps its neighbors, radii spread
+ * over orders of magnitude, all the circles at the same point (the
+ * dist < EPSILON branch of the kernels) and a huge domain with almost
+ * no overlaps. The configurations depend only on the scenario, the
+ * number of circles and the seed: the random numbers come from a
+ * generator of our own rather than from rand(), so that the same
+ * seed gives the same circles on every platform.
+ *
+ ****************************************************************************/
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "view.h"
+
+typedef struct
+{
+    float xmin, xmax, ymin, ymax; /* domain of the circles */
+} workload_domain_t;
+
+/**
+ * Return nonzero iff `name` is a known scenario.
+ */
+int workload_valid(const char *name);
+
+/**
+ * Number of scenarios.
+ */
+int workload_count(void);
+
+/**
+ * Name of the scenario `s`, 0 <= s < workload_count().
+ */
+const char *workload_name(int s);
+
+/**
+ * Print the names and descriptions of the scenarios to `out`.
+ */
+void workload_list(FILE *out);
+
+/**
+ * Fill the `n` circles of `dst` according to the scenario `name`
+ * with the given seed, and store their domain into `dom`. Returns 0
+ * on success, -1 if the scenario is unknown.
+ */
+int workload_fill(const char *name, uint64_t n, uint64_t seed,
+                  const circle_view_t *dst, workload_domain_t *dom);
+
+/**
+ * Generate `n` circles of the scenario `name` with the given seed and
+ * write them to the binary snapshot `path`. Returns 0 on success, -1
+ * on failure (a message is printed on stderr).
+ */
+int workload_save(const char *path, const char *name, uint64_t n, uint64_t seed);
+
+#endif